@@ -0,0 +1,44 @@
+#ifndef __ArrayView__
+#define __ArrayView__
+
+#include <cstddef>
+#include <vector>
+
+/*!
+\brief Read-only view over a contiguous array, in the spirit of std::span.
+
+The view does not own the data: it remains valid as long as the array it has been
+created from is neither destroyed nor resized.
+*/
+template <typename T>
+class ArrayView
+{
+protected:
+  const T* p = nullptr; //!< First element.
+  size_t n = 0;         //!< Number of elements.
+public:
+  //! Empty view.
+  ArrayView() {}
+  //! View over an array given by its first element and its size.
+  ArrayView(const T* p, size_t n) : p(p), n(n) {}
+  //! View over a vector.
+  ArrayView(const std::vector<T>& v) : p(v.data()), n(v.size()) {}
+
+  //! Return the i-th element.
+  const T& operator[](size_t i) const { return p[i]; }
+
+  //! Pointer to the first element.
+  const T* data() const { return p; }
+  //! Number of elements.
+  size_t size() const { return n; }
+  //! Check if the view is empty.
+  bool empty() const { return n == 0; }
+
+  const T* begin() const { return p; }
+  const T* end() const { return p + n; }
+
+  //! Copy the viewed elements into a new vector.
+  std::vector<T> ToVector() const { return std::vector<T>(p, p + n); }
+};
+
+#endif
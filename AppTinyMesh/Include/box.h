@@ -41,6 +41,7 @@ public:
 
   bool Inside(const Box&) const;
   bool Inside(const Vector&) const;
+  bool Intersect(const Box&) const;
 
   double Volume() const;
   double Area() const;
@@ -57,6 +58,7 @@ public:
 public:
   static const double epsilon; //!< Internal \htmlonly\epsilon;\endhtmlonly for ray intersection tests.
   static const Box Null; //!< Empty box.
+  static const Box Infinity; //!< Box covering the whole space.
   static const int edge[24]; //!< Edge vertices.
   static const Vector normal[6]; //!< Face normals.
 };
@@ -153,6 +155,15 @@ inline bool Box::Inside(const Vector& p) const
   return ((a < p) && (b > p));
 }
 
+/*!
+\brief Check if two boxes intersect, boxes sharing a face or a vertex intersect.
+\param box The box.
+*/
+inline bool Box::Intersect(const Box& box) const
+{
+  return ((a <= box.b) && (box.a <= b));
+}
+
 /*!
 \brief Check if two boxes are (strictly) equal.
 \param a, b Boxes.
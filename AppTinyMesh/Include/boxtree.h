@@ -0,0 +1,44 @@
+#ifndef __BoxTree__
+#define __BoxTree__
+
+#include "camera.h"
+
+/*!
+\brief Bounding volume hierarchy over a set of boxes, used for culling.
+*/
+class BoxTree
+{
+protected:
+  //! Node of the hierarchy, leaves have a non zero count of items.
+  struct Node
+  {
+    Box box;        //!< Box of the node.
+    int left = -1;  //!< Children, right child is left + 1.
+    int first = 0;  //!< First item.
+    int count = 0;  //!< Number of items, zero for internal nodes.
+  };
+
+  std::vector<Node> nodes; //!< Nodes, root is the first one.
+  std::vector<int> items;  //!< Indexes of the boxes, sorted by leaf.
+  std::vector<Box> boxes;  //!< Boxes, in the order of the items.
+public:
+  //! Empty.
+  BoxTree() {}
+  explicit BoxTree(const std::vector<Box>&);
+
+  //! Empty.
+  ~BoxTree() {}
+
+  //! Number of boxes.
+  int Size() const { return int(items.size()); }
+
+  void Cull(const Frustum&, std::vector<int>&) const;
+protected:
+  void Build(int, const std::vector<Box>&, const std::vector<Vector>&, int, int);
+  void Cull(int, const Frustum&, int, std::vector<int>&) const;
+  void Collect(int, std::vector<int>&) const;
+
+  static const int LeafSize = 4; //!< Maximum number of items in a leaf.
+};
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef __BrickPolygonizer__
+#define __BrickPolygonizer__
+
+#include "implicits.h"
+
+#include <functional>
+#include <memory>
+
+class FieldGrid;
+
+/*!
+\brief Polygonizer splitting the domain into bricks of cells, re-polygonizing only the bricks touched by an edit.
+*/
+class BrickPolygonizer
+{
+protected:
+  //! Brick of cells, with its cached samples and mesh.
+  struct Brick
+  {
+    bool dirty = true;          //!< Flag set when the brick must be polygonized again.
+    Box region = Box::Null;     //!< Region where the field changed since the last polygonization.
+    bool full = true;           //!< Flag set when all the samples must be computed again.
+    std::vector<float> samples; //!< Field samples, kept only for bricks crossing the surface.
+    Mesh mesh;                  //!< Mesh of the brick.
+  };
+
+  const AnalyticScalarField* field; //!< Field.
+  Box box;                          //!< Domain.
+  int n;                            //!< Number of samples along every axis.
+  int size;                         //!< Number of cells along the side of a brick.
+  double epsilon;                   //!< Precision of the vertices.
+  Vector d;                         //!< Diagonal of a cell.
+  int nx, ny, nz;                   //!< Number of bricks along every axis.
+  std::vector<Brick> bricks;        //!< Bricks.
+  std::shared_ptr<const FieldGrid> grid; //!< Cached samples of the field, during an update.
+public:
+  explicit BrickPolygonizer(const AnalyticScalarField*, int, const Box&, int = 16, double = 1e-4);
+
+  //! Empty.
+  ~BrickPolygonizer() {}
+
+  void Invalidate(const Box&);
+  void Invalidate();
+  bool Update(std::vector<int>&, const std::function<bool(double)>& = nullptr);
+
+  //! Number of bricks.
+  int Bricks() const { return int(bricks.size()); }
+  //! Mesh of a brick, empty if the brick does not cross the surface.
+  const Mesh& GetMesh(int i) const { return bricks[i].mesh; }
+  Box GetBox(int) const;
+  Mesh GetMesh() const;
+  size_t Memory() const;
+protected:
+  void Cells(int, int[3], int[3]) const;
+  void Polygonize(int);
+};
+
+#endif
@@ -6,6 +6,8 @@
 #include "box.h"
 #include "ray.h"
 
+class Frustum;
+
 // Implements a non-standard camera class
 class Camera
 {
@@ -57,6 +59,30 @@ public:
   // Pixel and sub-pixel sampling
   Ray PixelToRay(int, int, int, int) const;
   bool VectorToPixel(const Vector&, double&, double&, int, int) const;
+
+  Frustum GetFrustum(int, int) const;
+};
+
+// Viewing frustum as the intersection of six half-spaces
+class Frustum
+{
+protected:
+  Vector n[6]; //!< Inward normals of the planes, left, right, bottom, top, near and far.
+  double c[6]; //!< Offsets, a point p is inside plane i if n[i] * p + c[i] >= 0.
+public:
+  //! Empty.
+  Frustum() {}
+  explicit Frustum(const Vector*, const double*);
+  explicit Frustum(const float*);
+
+  //! Empty.
+  ~Frustum() {}
+
+  int Classify(const Box&, int&) const;
+  bool Intersect(const Box&) const;
+  bool Inside(const Vector&) const;
+
+  static const int AllPlanes = 63; //!< Mask of the six planes.
 };
 
 //! Returns the look-at point.
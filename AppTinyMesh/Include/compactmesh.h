@@ -0,0 +1,175 @@
+#ifndef __CompactMesh__
+#define __CompactMesh__
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "meshcolor.h"
+
+/*!
+\brief Compact indexed triangle mesh in single precision.
+
+Positions, normals and optional colors are stored as separate flat arrays of floats (three per vertex),
+and triangles as 32 bits indices shared by all the attributes. This is the layout expected by OpenGL,
+so the arrays can be uploaded as they are.
+*/
+class CompactMesh
+{
+protected:
+  std::vector<float> positions;   //!< Positions, 3 floats per vertex.
+  std::vector<float> normals;     //!< Normals, 3 floats per vertex.
+  std::vector<float> colors;      //!< Colors, 3 floats per vertex, empty if the mesh has no colors.
+  std::vector<uint32_t> indices;  //!< Vertex indexes, 3 per triangle.
+  double inputACMR = -1.0;        //!< Average cache miss ratio of the triangle order before Optimize(), negative if the mesh has not been optimized.
+public:
+  explicit CompactMesh();
+  explicit CompactMesh(const Mesh&);
+  explicit CompactMesh(const MeshColor&);
+  CompactMesh(const CompactMesh&) = default;
+  CompactMesh(CompactMesh&&) = default;
+  ~CompactMesh();
+
+  CompactMesh& operator=(const CompactMesh&) = default;
+  CompactMesh& operator=(CompactMesh&&) = default;
+
+  int Vertexes() const;
+  int Triangles() const;
+  bool HasColors() const;
+
+  Vector Vertex(int) const;
+  Vector Normal(int) const;
+  Color GetColor(int) const;
+
+  const float* Positions() const;
+  const float* Normals() const;
+  const float* Colors() const;
+  const uint32_t* Indices() const;
+  int Indexes() const;
+
+  size_t Memory() const;
+  Box GetBox() const;
+
+  Mesh ToMesh() const;
+  MeshColor ToMeshColor() const;
+
+  // Optimization for rendering
+  double ACMR(int = 32) const;
+  double InputACMR() const;
+  void OptimizeVertexCache(int = 32);
+  void OptimizeOverdraw(int = 32);
+  void OptimizeVertexFetch();
+  CompactMesh& Optimize();
+
+  // Simplification
+  CompactMesh Simplify(double) const;
+  std::vector<std::pair<CompactMesh, double>> LevelsOfDetail(int) const;
+
+  // Compact vertex format for rendering
+  void PackPositions(const Box&, int, int, uint16_t*) const;
+  void PackNormals(int, int, int16_t*) const;
+  void PackColors(int, int, uint8_t*) const;
+  static void EncodeOctahedral(const Vector&, int16_t*);
+  static Vector DecodeOctahedral(const int16_t*);
+
+  // Binary files
+  bool Save(const std::string&) const;
+  bool Load(const std::string&);
+protected:
+  void Convert(const Mesh&, const std::vector<size_t>*, const std::vector<Color>*);
+  void AddVertex(const Vector&, const Vector&);
+};
+
+/*!
+\brief Get the number of vertices.
+*/
+inline int CompactMesh::Vertexes() const
+{
+  return int(positions.size() / 3);
+}
+
+/*!
+\brief Get the number of triangles.
+*/
+inline int CompactMesh::Triangles() const
+{
+  return int(indices.size() / 3);
+}
+
+/*!
+\brief Get the number of indexes, i.e. three times the number of triangles.
+*/
+inline int CompactMesh::Indexes() const
+{
+  return int(indices.size());
+}
+
+/*!
+\brief Check if the mesh has per vertex colors.
+*/
+inline bool CompactMesh::HasColors() const
+{
+  return !colors.empty();
+}
+
+/*!
+\brief Get a vertex.
+\param i Index.
+*/
+inline Vector CompactMesh::Vertex(int i) const
+{
+  return Vector(positions[3 * i], positions[3 * i + 1], positions[3 * i + 2]);
+}
+
+/*!
+\brief Get a normal.
+\param i Index.
+*/
+inline Vector CompactMesh::Normal(int i) const
+{
+  return Vector(normals[3 * i], normals[3 * i + 1], normals[3 * i + 2]);
+}
+
+/*!
+\brief Get a color.
+\param i Index.
+*/
+inline Color CompactMesh::GetColor(int i) const
+{
+  return Color(double(colors[3 * i]), double(colors[3 * i + 1]), double(colors[3 * i + 2]));
+}
+
+/*!
+\brief Return the array of positions.
+*/
+inline const float* CompactMesh::Positions() const
+{
+  return positions.data();
+}
+
+/*!
+\brief Return the array of normals.
+*/
+inline const float* CompactMesh::Normals() const
+{
+  return normals.data();
+}
+
+/*!
+\brief Return the array of colors, nullptr if the mesh has no colors.
+*/
+inline const float* CompactMesh::Colors() const
+{
+  return colors.empty() ? nullptr : colors.data();
+}
+
+/*!
+\brief Return the array of vertex indexes.
+*/
+inline const uint32_t* CompactMesh::Indices() const
+{
+  return indices.data();
+}
+
+#endif
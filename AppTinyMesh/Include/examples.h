@@ -0,0 +1,78 @@
+#ifndef __Examples__
+#define __Examples__
+
+#include "compactmesh.h"
+#include "implicits-tree.h"
+
+#include <functional>
+#include <string>
+#include <vector>
+
+class FieldCache;
+
+/*!
+\brief Settings of the example scenes.
+*/
+struct ExampleSettings
+{
+  int resolution = 0;           //!< Discretization of implicit surfaces and tessellation of parametric surfaces, 0 for the default of every example.
+  double epsilon = 0.0;         //!< Precision of the vertices of implicit surfaces, 0 for the default of every example.
+  FieldCache* cache = nullptr;  //!< Cache of samples of implicit surfaces, none by default.
+};
+
+/*!
+\brief Implicit table of the second implicit example: two plates blended with four capsule legs, and a bowl on top.
+
+Nodes reference each other, so that the table can be neither copied nor moved.
+*/
+struct ImplicitTable
+{
+  static constexpr double htsize = 0.25;  //!< Radius of the legs.
+  static constexpr double htheight = 3;   //!< Half height of the legs.
+  static constexpr double d = 5;          //!< Distance of the legs to the axis.
+
+  ImplicitTree::Capsule t0{ Vector{-d, -d, htheight}, Vector::Z, htheight, htsize };
+  ImplicitTree::Capsule t1{ Vector{d, -d, htheight}, Vector::Z, htheight, htsize };
+  ImplicitTree::Capsule t2{ Vector{-d, d, htheight}, Vector::Z, htheight, htsize };
+  ImplicitTree::Capsule t3{ Vector{d, d, htheight}, Vector::Z, htheight, htsize };
+
+  ImplicitTree::Union tt0{ t0, t1 };
+  ImplicitTree::Union tt1{ t2, t3 };
+  ImplicitTree::Union tunion{ tt0, tt1 };
+
+  ImplicitTree::InigoBox box{ Vector{0,0, htheight}, Vector{5,5,0.1} };
+  ImplicitTree::InigoBox box2{ Vector{0,0, 2*htheight}, Vector{5,5,0.1} };
+
+  ImplicitTree::Union bunion{ box, box2 };
+  ImplicitTree::Blend implicit{ bunion, tunion, 10 };
+
+  ImplicitTree::Sphere a{ Vector::Null, 3 };
+  ImplicitTree::Sphere b{ Vector{0,0,0.25}, 3 };
+  ImplicitTree::Sphere c{ Vector{-0.25,0.1,-1.2}, 1 };
+  ImplicitTree::Diff cc{ a, b };
+  ImplicitTree::Scale aze{ &cc, Vector{1.1, 1.3, 0.7} };
+  ImplicitTree::Union saladier{ c, aze };
+
+  ImplicitTree::Translate st{ &saladier, Vector{0,0,htheight*2 + 2} };
+  ImplicitTree::Union implicit2{ implicit, st };
+
+  ImplicitTree::Tree tree{ &implicit2 };
+
+  //! Empty.
+  ImplicitTable() {}
+  ImplicitTable(const ImplicitTable&) = delete;
+  ImplicitTable& operator=(const ImplicitTable&) = delete;
+};
+
+/*!
+\brief Example scenes, shared by the application and the command line tools.
+*/
+namespace Examples
+{
+  const std::vector<std::string>& Names();
+  bool Generate(const std::string&, std::vector<CompactMesh>&, const ExampleSettings& = ExampleSettings(), const std::function<bool(double)>& = nullptr);
+  bool Instanced(const std::string&);
+  bool Generate(const std::string&, CompactMesh&, std::vector<Vector>&, const ExampleSettings& = ExampleSettings(), const std::function<bool(double)>& = nullptr);
+}
+
+#endif
@@ -0,0 +1,112 @@
+#ifndef __FieldCache__
+#define __FieldCache__
+
+#include "box.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/*!
+\brief Grid of field samples stored as compressed bricks.
+*/
+class FieldGrid
+{
+protected:
+  static constexpr int Size = 16; //!< Number of samples along the side of a brick.
+
+  //! Brick of samples, collapsed into a single value if the samples are not needed.
+  struct Brick
+  {
+    std::vector<float> samples; //!< Samples, empty for collapsed bricks.
+    float value = 0.0f;         //!< Value of collapsed bricks.
+  };
+
+  int nx, ny, nz;               //!< Number of samples along every axis.
+  int bx, by, bz;               //!< Number of bricks along every axis.
+  std::vector<Brick> bricks;    //!< Bricks.
+
+  // Construction
+  int layers = 0;               //!< Number of layers added.
+  std::vector<float> slab;      //!< Layers of the slab of bricks being built.
+  std::vector<float> below;     //!< Last layer of the previous slab.
+public:
+  explicit FieldGrid(int, int, int);
+
+  //! Empty.
+  ~FieldGrid() {}
+
+  void AddLayer(const double*);
+  void Finish();
+
+  float operator()(int, int, int) const;
+  size_t Memory() const;
+  int Collapsed() const;
+
+  static float Round(double);
+protected:
+  void Compress(int, const float*);
+};
+
+/*!
+\brief Cache of grids of field samples, shared by the polygonizations.
+
+Grids are identified by the structural hash of the field, the domain and the resolution, and
+evicted in least recently used order when the memory used by the grids exceeds a budget.
+The cache can be shared by several threads.
+*/
+class FieldCache
+{
+protected:
+  //! Cached grid and its key.
+  struct Entry
+  {
+    uint64_t hash;                           //!< Hash of the field.
+    Box box;                                 //!< Domain.
+    int n;                                   //!< Resolution.
+    std::shared_ptr<const FieldGrid> grid;   //!< Samples.
+  };
+
+  std::list<Entry> entries;  //!< Grids, most recently used first.
+  std::mutex mutex;          //!< Lock.
+  size_t budget;             //!< Maximum memory used by the grids.
+  size_t memory = 0;         //!< Memory used by the grids.
+  int hits = 0;              //!< Number of successful searches.
+  int misses = 0;            //!< Number of failed searches.
+public:
+  explicit FieldCache(size_t = size_t(256) << 20);
+
+  //! Empty.
+  ~FieldCache() {}
+
+  std::shared_ptr<const FieldGrid> Find(uint64_t, const Box&, int);
+  void Insert(uint64_t, const Box&, int, const std::shared_ptr<const FieldGrid>&);
+  void SetBudget(size_t);
+  void Clear();
+
+  size_t Memory();
+  int Hits();
+  int Misses();
+protected:
+  void Evict();
+};
+
+/*!
+\brief Get a sample.
+\param i, j, k Integer coordinates of the sample.
+*/
+inline float FieldGrid::operator()(int i, int j, int k) const
+{
+  const Brick& brick = bricks[((k / Size) * by + (j / Size)) * bx + (i / Size)];
+  if (brick.samples.empty())
+    return brick.value;
+
+  const int sx = std::min(Size, nx - (i / Size) * Size);
+  const int sy = std::min(Size, ny - (j / Size) * Size);
+  return brick.samples[((k % Size) * sy + (j % Size)) * sx + (i % Size)];
+}
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef __FieldProfiler__
+#define __FieldProfiler__
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+struct Implicit;
+class Vector;
+
+/*!
+\brief Profiler of the evaluations of implicit trees.
+
+The profiler is compiled in with the TINYMESH_PROFILE definition, otherwise phases and
+evaluations compile to nothing and the exports return false.
+*/
+class FieldProfiler
+{
+public:
+  //! Phases of a polygonization.
+  enum Phase
+  {
+    Sampling = 0, //!< Sampling of the grid.
+    Dichotomy,    //!< Search of the vertices on the straddling edges.
+    Gradient,     //!< Computation of the normals.
+    Other,        //!< Evaluations outside of a polygonization.
+    Phases        //!< Number of phases.
+  };
+
+  /*!
+  \brief Scope of a phase, the evaluations of the scope are recorded in this phase.
+  */
+  class Scope
+  {
+#ifdef TINYMESH_PROFILE
+  protected:
+    int previous; //!< Phase of the enclosing scope.
+  public:
+    explicit Scope(Phase);
+    ~Scope();
+#else
+  public:
+    //! Empty.
+    explicit Scope(Phase) {}
+#endif
+  };
+
+  static double Evaluate(const Implicit*, const Vector&);
+#ifdef TINYMESH_PROFILE
+  static uint64_t Serial();
+#endif
+
+  //! Check if the profiler is compiled in.
+  static constexpr bool Enabled()
+  {
+#ifdef TINYMESH_PROFILE
+    return true;
+#else
+    return false;
+#endif
+  }
+
+  static void Reset();
+  static void Report(std::ostream&);
+  static bool SaveChromeTrace(const std::string&);
+  static bool SaveFolded(const std::string&);
+};
+
+#endif
@@ -3,20 +3,40 @@
 #include "implicits.h"
 #include "mathematics.h"
 #include <algorithm>
+#include <memory>
+#include <typeinfo>
+
+class NodeStore;
 
 namespace ImplicitTree {
-Vector absp(Vector p) {
+inline Vector absp(Vector p) {
   return Vector{abs(p[0]), abs(p[1]), abs(p[2]) };
 }
 
-Vector maxp(Vector p, double v){
+inline Vector maxp(Vector p, double v){
   return Vector{std::max(p[0], v), std::max(p[1],v), std::max(p[2], v) };
 }
 
-Vector minp(Vector p, double v){
+inline Vector minp(Vector p, double v){
   return Vector{std::min(p[0], v), std::min(p[1],v), std::min(p[2], v) };
 }
 
+//! Box of the points lying in two boxes, empty boxes have their lower corner above the upper one.
+inline ::Box Intersection(const ::Box& a, const ::Box& b) {
+  return ::Box(Vector::Max(a[0], b[0]), Vector::Min(a[1], b[1]));
+}
+
+//! Hash of the type of a node.
+inline uint64_t Tag(const Implicit& node) {
+  return uint64_t(typeid(node).hash_code());
+}
+
+//! Hash of a node with a child, 0 if the child cannot be hashed.
+inline uint64_t HashChild(uint64_t h, const Implicit* child) {
+  uint64_t c = child->Hash();
+  return (c == 0) ? 0 : HashCombine(h, c);
+}
+
 struct UnaryNode : public Implicit {
   UnaryNode(Implicit &a) : Implicit(), a(&a) {}
 protected:
@@ -26,28 +46,58 @@ protected:
 struct BinaryNode : public Implicit {
   BinaryNode(Implicit &a, Implicit &b) : Implicit(), a(&a), b(&b) {}
 
+  bool Influence(const Implicit* node, double level, ::Box& box) const override {
+    if (node == this) {
+      box = GetBox(level);
+      return true;
+    }
+    return Children(node, level, box);
+  }
+  uint64_t Hash() const override {
+    uint64_t h = HashChild(Tag(*this), a);
+    return (h == 0) ? 0 : HashChild(h, b);
+  }
+
 protected:
+  // Forward the query to both children, as a node may be shared
+  bool Children(const Implicit* node, double level, ::Box& box) const {
+    ::Box ba, bb;
+    bool fa = a->Influence(node, level, ba);
+    bool fb = b->Influence(node, level, bb);
+    box = (fa && fb) ? ::Box(ba, bb) : (fa ? ba : bb);
+    return fa || fb;
+  }
+
   Implicit *a, *b;
 };
 
 struct Union final : public BinaryNode {
   using BinaryNode::BinaryNode;
   double Value(const Vector &pos) const override {
-    return std::min(a->Value(pos), b->Value(pos));
+    return std::min(Evaluate(a, pos), Evaluate(b, pos));
+  }
+  ::Box GetBox(double level) const override {
+    return ::Box(a->GetBox(level), b->GetBox(level));
   }
 };
 
 struct Intersection final : public BinaryNode {
   using BinaryNode::BinaryNode;
   double Value(const Vector &pos) const {
-    return std::max(a->Value(pos), b->Value(pos));
+    return std::max(Evaluate(a, pos), Evaluate(b, pos));
+  }
+  ::Box GetBox(double level) const override {
+    return ImplicitTree::Intersection(a->GetBox(level), b->GetBox(level));
   }
 };
 
 struct Diff final : public BinaryNode {
   using BinaryNode::BinaryNode;
   double Value(const Vector &pos) const {
-    return std::max(a->Value(pos), -b->Value(pos));
+    return std::max(Evaluate(a, pos), -Evaluate(b, pos));
+  }
+  ::Box GetBox(double level) const override {
+    return a->GetBox(level);
   }
 };
 
@@ -56,29 +106,145 @@ struct Blend final : public BinaryNode {
       : BinaryNode(a, b), blend_size(blend_size) {}
 
   double Value(const Vector &pos) const {
-    double fa = a->Value(pos);
-    double fb = b->Value(pos);
+    double fa = Evaluate(a, pos);
+    double fb = Evaluate(b, pos);
     double h = std::max(0., blend_size - std::abs(fa - fb)) / blend_size;
     return std::min(fa, fb) - (blend_size / 6.) * std::pow(h, 3);
   }
 
+  // The blend lowers the field by at most blend_size / 6 where the fields differ by less than blend_size
+  ::Box GetBox(double level) const override {
+    return ::Box(a->GetBox(level + blend_size / 6.), b->GetBox(level + blend_size / 6.));
+  }
+  bool Influence(const Implicit* node, double level, ::Box& box) const override {
+    if (node == this) {
+      box = GetBox(level);
+      return true;
+    }
+    return Children(node, level + blend_size * 7. / 6., box);
+  }
+  uint64_t Hash() const override {
+    uint64_t h = BinaryNode::Hash();
+    return (h == 0) ? 0 : HashCombine(h, blend_size);
+  }
+
 private:
   double blend_size;
 };
 
+// Repetition of a node on a grid of cells, centered on the origin, infinite along the axes with a count of 0
 struct Replicate final : public Implicit {
-  Replicate(Implicit* a, const Vector& s): a(a), hsize(s) {}
+  Replicate(Implicit* a, const Vector& s, int nx = 0, int ny = 0, int nz = 0): a(a), hsize(s), n{ nx, ny, nz } {
+    // Instances reaching beyond their cell are evaluated in the neighbor cells too
+    const ::Box box = a->GetBox(0.0);
+    for (int k = 0; k < 3; k++) {
+      const double e = std::max(std::abs(box[0][k]), std::abs(box[1][k]));
+      reach[k] = (e > hsize[k] && e < HUGE_VAL) ? int(std::ceil((e - hsize[k]) / (2.0 * hsize[k]))) : 0;
+      if (n[k] > 0)
+        reach[k] = std::min(reach[k], 2 * n[k]);
+    }
+  }
   double Value(const Vector &pos) const {
-    return a->Value(Vector{
-      fmod(pos[0] + hsize[0], hsize[0] * 2),
-      fmod(pos[1] + hsize[1], hsize[1] * 2),
-      fmod(pos[2] + hsize[2], hsize[2] * 2),
-    } - hsize);
+    int c[3];
+    for (int k = 0; k < 3; k++) {
+      c[k] = int(std::floor(pos[k] / (2.0 * hsize[k]) + 0.5));
+      if (n[k] > 0)
+        c[k] = std::clamp(c[k], -n[k], n[k]);
+    }
+    if (reach[0] == 0 && reach[1] == 0 && reach[2] == 0)
+      return Evaluate(a, pos - Offset(c[0], c[1], c[2]));
+
+    double v = HUGE_VAL;
+    for (int i = c[0] - reach[0]; i <= c[0] + reach[0]; i++) {
+      for (int j = c[1] - reach[1]; j <= c[1] + reach[1]; j++) {
+        for (int k = c[2] - reach[2]; k <= c[2] + reach[2]; k++) {
+          if (Inside(i, 0) && Inside(j, 1) && Inside(k, 2))
+            v = std::min(v, Evaluate(a, pos - Offset(i, j, k)));
+        }
+      }
+    }
+    return v;
+  }
+  // The instances are bounded only along the axes with a finite count
+  ::Box GetBox(double level) const override {
+    return Repeated(a->GetBox(level));
+  }
+  bool Influence(const Implicit* node, double level, ::Box& box) const override {
+    if (node == this) {
+      box = GetBox(level);
+      return true;
+    }
+    if (!a->Influence(node, level, box))
+      return false;
+    box = Repeated(box);
+    return true;
+  }
+  uint64_t Hash() const override {
+    uint64_t h = HashChild(Tag(*this), a);
+    return (h == 0) ? 0 : HashCombine(HashCombine(h, hsize), Vector(n[0], n[1], n[2]));
+  }
+
+  // Bound of the surface in a cell, in the coordinates of the cell, including the instances of the neighbor cells
+  ::Box CellBox(double level) const {
+    ::Box box = a->GetBox(level);
+    for (int k = 0; k < 3; k++) {
+      if (box[0][k] < -hsize[k] || box[1][k] > hsize[k]) {
+        box[0][k] = -hsize[k];
+        box[1][k] = hsize[k];
+      }
+    }
+    return box;
+  }
+  // Translation of the instance of a cell
+  Vector Offset(int i, int j, int k) const {
+    return Vector(2.0 * hsize[0] * i, 2.0 * hsize[1] * j, 2.0 * hsize[2] * k);
+  }
+  // Number of cells on either side of the origin along an axis, 0 if infinite
+  int Count(int k) const { return n[k]; }
+  const Implicit* Child() const { return a; }
+
+  // Offsets of the instances intersecting a domain, false if the instances overlap so that the child cannot be instanced
+  bool Instances(const ::Box& domain, double level, std::vector<Vector>& offsets) const {
+    offsets.clear();
+    if (reach[0] != 0 || reach[1] != 0 || reach[2] != 0)
+      return false;
+    const ::Box box = a->GetBox(level);
+    int c0[3], c1[3];
+    for (int k = 0; k < 3; k++) {
+      if (box[0][k] == -HUGE_VAL || box[1][k] == HUGE_VAL)
+        return false;
+      const double size = 2.0 * hsize[k];
+      c0[k] = int(std::ceil((domain[0][k] - box[1][k]) / size));
+      c1[k] = int(std::floor((domain[1][k] - box[0][k]) / size));
+      if (n[k] > 0) {
+        c0[k] = std::max(c0[k], -n[k]);
+        c1[k] = std::min(c1[k], n[k]);
+      }
+    }
+    for (int k = c0[2]; k <= c1[2]; k++)
+      for (int j = c0[1]; j <= c1[1]; j++)
+        for (int i = c0[0]; i <= c1[0]; i++)
+          offsets.push_back(Offset(i, j, k));
+    return true;
   }
-  
+
 private:
+  bool Inside(int c, int k) const {
+    return n[k] == 0 || (c >= -n[k] && c <= n[k]);
+  }
+  ::Box Repeated(::Box box) const {
+    for (int k = 0; k < 3; k++) {
+      const double r = (n[k] == 0) ? HUGE_VAL : 2.0 * hsize[k] * n[k];
+      box[0][k] -= r;
+      box[1][k] += r;
+    }
+    return box;
+  }
+
   Implicit* a;
   Vector hsize;
+  int n[3];
+  int reach[3];
 };
 
 struct Sphere final : public Implicit {
@@ -86,6 +252,12 @@ struct Sphere final : public Implicit {
   double Value(const Vector &pos) const {
     return SquaredNorm(this->pos - pos) - size * size;
   }
+  ::Box GetBox(double level) const override {
+    return ::Box(pos, sqrt(std::max(0., size * size + level)));
+  }
+  uint64_t Hash() const override {
+    return HashCombine(HashCombine(Tag(*this), pos), size);
+  }
 
 private:
   Vector pos;
@@ -104,6 +276,12 @@ public:
     Vector q = absp(relp) - hsize;
     return Norm(maxp(q, 0.)) + std::min(std::max(q[0], std::max(q[1], q[2])), 0.); 
   }
+  ::Box GetBox(double level) const override {
+    return ::Box(pos - hsize - Vector(level), pos + hsize + Vector(level));
+  }
+  uint64_t Hash() const override {
+    return HashCombine(HashCombine(Tag(*this), pos), hsize);
+  }
 };
 
 // Ma version initiale de Box : Calcule les plans de chaque face et retourne le max du dot avec le point
@@ -138,6 +316,12 @@ struct Box final : public Implicit {
 
     return max;
   }
+  ::Box GetBox(double level) const override {
+    return ::Box(pos - size - Vector(level), pos + size + Vector(level));
+  }
+  uint64_t Hash() const override {
+    return HashCombine(HashCombine(Tag(*this), pos), size);
+  }
 
 private:
   Vector pos, size;
@@ -153,6 +337,16 @@ struct Capsule final : public Implicit {
     Vector dist = relp - pline;
     return Norm(dist) - size;
   }
+  ::Box GetBox(double level) const override {
+    Vector r = Vector(size + level);
+    return ::Box(Vector::Min(pos - hdir * len, pos + hdir * len) - r, Vector::Max(pos - hdir * len, pos + hdir * len) + r);
+  }
+  uint64_t Hash() const override {
+    return HashCombine(HashCombine(HashCombine(HashCombine(Tag(*this), pos), hdir), len), size);
+  }
+
+  Vector Position() const { return pos; }
+  void SetPosition(const Vector& p) { pos = p; }
 
 private:
   Vector pos, hdir;
@@ -168,6 +362,13 @@ struct InigoTore final : public Implicit {
     Vector q = Vector{Norm(l) - t[0], relp[1], 0};
     return Norm(q) - t[1];
   }
+  ::Box GetBox(double level) const override {
+    Vector r = Vector(t[0] + t[1] + level, t[1] + level, t[0] + t[1] + level);
+    return ::Box(pos - r, pos + r);
+  }
+  uint64_t Hash() const override {
+    return HashCombine(HashCombine(Tag(*this), pos), t);
+  }
 private:
   Vector pos, t;
 };
@@ -180,7 +381,21 @@ private:
 public:
   Translate(Implicit* a, Vector c) : Implicit(), a(a), c(c) {}
   double Value(const Vector &point) const override {
-    return a->Value(point - c);
+    return Evaluate(a, point - c);
+  }
+  ::Box GetBox(double level) const override {
+    ::Box box = a->GetBox(level);
+    return ::Box(box[0] + c, box[1] + c);
+  }
+  bool Influence(const Implicit* node, double level, ::Box& box) const override {
+    if (node != this && !a->Influence(node, level, box))
+      return false;
+    box = (node == this) ? GetBox(level) : ::Box(box[0] + c, box[1] + c);
+    return true;
+  }
+  uint64_t Hash() const override {
+    uint64_t h = HashChild(Tag(*this), a);
+    return (h == 0) ? 0 : HashCombine(h, c);
   }
 };
 
@@ -191,17 +406,48 @@ private:
 public:
   Scale(Implicit* a, Vector c) : Implicit(), a(a), c(c) {}
   double Value(const Vector &point) const override {
-    return a->Value(Vector{point[0] * 1/c[0], point[1] * 1/c[1], point[2] * 1/c[2]});
+    return Evaluate(a, Vector{point[0] * 1/c[0], point[1] * 1/c[1], point[2] * 1/c[2]});
+  }
+  ::Box GetBox(double level) const override {
+    return Scaled(a->GetBox(level));
+  }
+  bool Influence(const Implicit* node, double level, ::Box& box) const override {
+    if (node != this && !a->Influence(node, level, box))
+      return false;
+    box = (node == this) ? GetBox(level) : Scaled(box);
+    return true;
+  }
+  uint64_t Hash() const override {
+    uint64_t h = HashChild(Tag(*this), a);
+    return (h == 0) ? 0 : HashCombine(h, c);
+  }
+private:
+  ::Box Scaled(const ::Box& box) const {
+    Vector p = Vector{box[0][0] * c[0], box[0][1] * c[1], box[0][2] * c[2]};
+    Vector q = Vector{box[1][0] * c[0], box[1][1] * c[1], box[1][2] * c[2]};
+    return ::Box(Vector::Min(p, q), Vector::Max(p, q));
   }
 };
 
 struct Tree : public AnalyticScalarField {
   Tree(Implicit* a): start(a){};
+  // Tree sharing the ownership of the store of its nodes, see NodeStore
+  Tree(Implicit* a, std::shared_ptr<const NodeStore> store): start(a), store(std::move(store)){};
   double Value(const Vector &point) const override {
-    return start->Value(point);
+    return Evaluate(start, point);
+  }
+  ::Box GetBox(double level = 0.0) const override {
+    return start->GetBox(level);
+  }
+  bool Influence(const Implicit* node, double level, ::Box& box) const override {
+    return start->Influence(node, level, box);
+  }
+  uint64_t Hash() const override {
+    return start->Hash();
   }
 private: 
   Implicit* start;
+  std::shared_ptr<const NodeStore> store; // Owner of the nodes, null if they are owned elsewhere
 };
 
 } // namespace ImplicitTree
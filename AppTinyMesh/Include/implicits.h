@@ -2,14 +2,60 @@
 
 #pragma once
 
+#include <cstdint>
+#include <cstring>
+#include <functional>
 #include <iostream>
 
 #include "mesh.h"
+#include "fieldprofiler.h"
+
+class FieldCache;
+
+//! Combine a hash with a value, in the spirit of boost::hash_combine.
+inline uint64_t HashCombine(uint64_t h, uint64_t v) {
+  return h ^ (v + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2));
+}
+
+//! Combine a hash with the bits of a real value.
+inline uint64_t HashCombine(uint64_t h, double v) {
+  uint64_t u;
+  memcpy(&u, &v, sizeof(u));
+  return HashCombine(h, u);
+}
+
+//! Combine a hash with the coordinates of a vector.
+inline uint64_t HashCombine(uint64_t h, const Vector& v) {
+  return HashCombine(HashCombine(HashCombine(h, v[0]), v[1]), v[2]);
+}
 
 struct Implicit {
+#ifdef TINYMESH_PROFILE
+  uint64_t serial = FieldProfiler::Serial(); //!< Identifier of the node for the profiler, see FieldProfiler::Serial().
+#endif
   virtual double Value(const Vector&) const  { return 0; };
+  virtual Box GetBox(double = 0.0) const;
+  virtual bool Influence(const Implicit*, double, Box&) const;
+  //! Structural hash of the field, equal for fields built the same way, 0 if the field cannot be hashed.
+  virtual uint64_t Hash() const { return 0; }
 };
 
+/*!
+\brief Evaluate a node of a tree.
+
+Nodes evaluate their children with this function, so that the evaluations are counted and
+timed per node when the profiler is compiled in, see FieldProfiler.
+\param node The node.
+\param p Point.
+*/
+inline double Evaluate(const Implicit* node, const Vector& p) {
+#ifdef TINYMESH_PROFILE
+  return FieldProfiler::Evaluate(node, p);
+#else
+  return node->Value(p);
+#endif
+}
+
 class AnalyticScalarField : public Implicit
 {
 protected:
@@ -25,9 +71,17 @@ public:
   Vector Dichotomy(Vector, Vector, double, double, double, const double& = 1.0e-4) const;
 
   virtual void Polygonize(int, Mesh&, const Box&, const double& = 1e-4) const;
+  bool Polygonize(int, Mesh&, const Box&, const double&, const std::function<bool(double)>&) const;
+
+  //! Set the cache of samples used by Polygonize(), none by default.
+  void SetCache(FieldCache* c) { cache = c; }
+protected:
+  FieldCache* cache = nullptr; //!< Cache of samples, shared by the fields.
 protected:
   static const double Epsilon; //!< Epsilon value for partial derivatives
 protected:
   static int TriangleTable[256][16]; //!< Two dimensionnal array storing the straddling edges for every marching cubes configuration.
   static int edgeTable[256];    //!< Array storing straddling edges for every marching cubes configuration.
+
+  friend class BrickPolygonizer;
 };
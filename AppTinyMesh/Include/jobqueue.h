@@ -0,0 +1,76 @@
+#ifndef __JobQueue__
+#define __JobQueue__
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*!
+\brief Queue of jobs run by worker threads, with progress reporting and cancellation.
+
+Every submission or cancellation starts a new generation: jobs of older generations that
+are still pending are dropped, and running ones see their cancellation flag raised.
+*/
+class JobQueue
+{
+public:
+  /*!
+  \brief Handle given to a running job to report its progress and check for cancellation.
+  */
+  class Job
+  {
+  protected:
+    const JobQueue* queue;                  //!< Queue running the job.
+    unsigned int generation;                //!< Generation of the job.
+    std::function<void(double)> progress;   //!< Progress callback, called from the worker thread.
+  public:
+    Job(const JobQueue*, unsigned int, const std::function<void(double)>&);
+
+    //! Generation of the job.
+    unsigned int Generation() const { return generation; }
+    bool Cancelled() const;
+    bool Progress(double) const;
+  };
+
+  typedef std::function<void(Job&)> Task;
+protected:
+  //! Pending job.
+  struct Entry
+  {
+    Task task;                              //!< Work.
+    std::function<void(double)> progress;   //!< Progress callback.
+    unsigned int generation;                //!< Generation.
+  };
+
+  std::vector<std::thread> workers;         //!< Worker threads.
+  std::deque<Entry> pending;                //!< Jobs waiting for a worker.
+  std::mutex mutex;                         //!< Lock of the pending jobs.
+  std::condition_variable wake;             //!< Signaled when a job is pushed or the queue stops.
+  std::condition_variable idle;             //!< Signaled when a job completes.
+  std::atomic<unsigned int> generation;     //!< Current generation.
+  int running = 0;                          //!< Number of jobs being run.
+  bool stop = false;                        //!< Stop flag for the workers.
+public:
+  explicit JobQueue(int = 1);
+  ~JobQueue();
+
+  JobQueue(const JobQueue&) = delete;
+  JobQueue& operator=(const JobQueue&) = delete;
+
+  unsigned int Submit(const Task&, const std::function<void(double)>& = nullptr);
+  unsigned int Push(const Task&, const std::function<void(double)>& = nullptr);
+  void Cancel();
+  void Wait();
+  bool Busy();
+
+  //! Current generation.
+  unsigned int Generation() const { return generation.load(); }
+protected:
+  void Run();
+};
+
+#endif
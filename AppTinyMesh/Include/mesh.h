@@ -3,6 +3,9 @@
 #include "box.h"
 #include "ray.h"
 #include "mathematics.h"
+#include "arrayview.h"
+
+#include <string>
 
 // Triangle
 class Triangle
@@ -78,7 +81,11 @@ inline Triangle::Triangle(const Vector& a, const Vector& b, const Vector& c)
 }
 
 
-class QString;
+enum class NormalWeighting
+{
+  Area = 0,
+  Angle = 1,
+};
 
 class Mesh
 {
@@ -91,8 +98,14 @@ public:
   explicit Mesh();
   explicit Mesh(const std::vector<Vector>&, const std::vector<size_t>&);
   explicit Mesh(const std::vector<Vector>&, const std::vector<Vector>&, const std::vector<size_t>&, const std::vector<size_t>&);
+  explicit Mesh(std::vector<Vector>&&, std::vector<Vector>&&, std::vector<size_t>&&, std::vector<size_t>&&);
+  Mesh(const Mesh&) = default;
+  Mesh(Mesh&&) = default;
   ~Mesh();
 
+  Mesh& operator=(const Mesh&) = default;
+  Mesh& operator=(Mesh&&) = default;
+
   void Reserve(int, int, int, int);
 
   Triangle GetTriangle(int) const;
@@ -104,8 +117,14 @@ public:
   int Triangles() const;
   int Vertexes() const;
 
-  std::vector<size_t> VertexIndexes() const;
-  std::vector<size_t> NormalIndexes() const;
+  const std::vector<size_t>& VertexIndexes() const;
+  const std::vector<size_t>& NormalIndexes() const;
+
+  // Views
+  ArrayView<Vector> Vertices() const;
+  ArrayView<Vector> Normals() const;
+  ArrayView<size_t> VertexIndexArray() const;
+  ArrayView<size_t> NormalIndexArray() const;
 
   int VertexIndex(int, int) const;
   int NormalIndex(int, int) const;
@@ -116,13 +135,15 @@ public:
 
   void Scale(double);
 
-  void SmoothNormals();
+  void SmoothNormals(NormalWeighting = NormalWeighting::Area);
+
+  void VertexCorners(std::vector<int>&, std::vector<int>&) const;
 
   // Constructors from core classes
   explicit Mesh(const Box&);
 
-  void Load(const QString&);
-  void SaveObj(const QString&, const QString&) const;
+  bool Load(const std::string&);
+  bool SaveObj(const std::string&, const std::string&) const;
 protected:
   void AddTriangle(int, int, int, int);
   void AddSmoothTriangle(int, int, int, int, int, int);
@@ -133,7 +154,7 @@ protected:
 /*!
 \brief Return the set of vertex indexes.
 */
-inline std::vector<size_t> Mesh::VertexIndexes() const
+inline const std::vector<size_t>& Mesh::VertexIndexes() const
 {
   return varray;
 }
@@ -141,11 +162,43 @@ inline std::vector<size_t> Mesh::VertexIndexes() const
 /*!
 \brief Return the set of normal indexes.
 */
-inline std::vector<size_t> Mesh::NormalIndexes() const
+inline const std::vector<size_t>& Mesh::NormalIndexes() const
 {
   return narray;
 }
 
+/*!
+\brief Return a read-only view over the vertices.
+*/
+inline ArrayView<Vector> Mesh::Vertices() const
+{
+  return ArrayView<Vector>(vertices);
+}
+
+/*!
+\brief Return a read-only view over the normals.
+*/
+inline ArrayView<Vector> Mesh::Normals() const
+{
+  return ArrayView<Vector>(normals);
+}
+
+/*!
+\brief Return a read-only view over the vertex indexes, three per triangle.
+*/
+inline ArrayView<size_t> Mesh::VertexIndexArray() const
+{
+  return ArrayView<size_t>(varray);
+}
+
+/*!
+\brief Return a read-only view over the normal indexes, three per triangle.
+*/
+inline ArrayView<size_t> Mesh::NormalIndexArray() const
+{
+  return ArrayView<size_t>(narray);
+}
+
 /*!
 \brief Get the vertex index of a given triangle.
 \param t Triangle index.
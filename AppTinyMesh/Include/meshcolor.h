@@ -14,11 +14,22 @@ public:
   explicit MeshColor();
   explicit MeshColor(const Mesh&);
   explicit MeshColor(const Mesh&, const std::vector<Color>&, const std::vector<size_t>&);
+  explicit MeshColor(Mesh&&);
+  explicit MeshColor(Mesh&&, std::vector<Color>&&, std::vector<size_t>&&);
+  MeshColor(const MeshColor&) = default;
+  MeshColor(MeshColor&&) = default;
   ~MeshColor();
 
+  MeshColor& operator=(const MeshColor&) = default;
+  MeshColor& operator=(MeshColor&&) = default;
+
   Color GetColor(int) const;
-  std::vector<Color> GetColors() const;
-  std::vector<size_t> ColorIndexes() const;
+  const std::vector<Color>& GetColors() const;
+  const std::vector<size_t>& ColorIndexes() const;
+
+  // Views
+  ArrayView<Color> Colors() const;
+  ArrayView<size_t> ColorIndexArray() const;
 };
 
 /*!
@@ -34,7 +45,7 @@ inline Color MeshColor::GetColor(int i) const
 /*!
 \brief Get the array of colors.
 */
-inline std::vector<Color> MeshColor::GetColors() const
+inline const std::vector<Color>& MeshColor::GetColors() const
 {
   return colors;
 }
@@ -42,9 +53,25 @@ inline std::vector<Color> MeshColor::GetColors() const
 /*!
 \brief Return the set of color indices.
 */
-inline std::vector<size_t> MeshColor::ColorIndexes() const
+inline const std::vector<size_t>& MeshColor::ColorIndexes() const
 {
   return carray;
 }
 
+/*!
+\brief Return a read-only view over the colors.
+*/
+inline ArrayView<Color> MeshColor::Colors() const
+{
+  return ArrayView<Color>(colors);
+}
+
+/*!
+\brief Return a read-only view over the color indexes, three per triangle.
+*/
+inline ArrayView<size_t> MeshColor::ColorIndexArray() const
+{
+  return ArrayView<size_t>(carray);
+}
+
 #endif
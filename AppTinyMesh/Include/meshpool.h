@@ -0,0 +1,114 @@
+#ifndef __MeshPool__
+#define __MeshPool__
+
+#include "shader-api.h"
+
+#include <map>
+#include <memory>
+#include <vector>
+
+/*!
+\brief Allocator of ranges in an interval of integers, first fit with coalescing of the released ranges.
+*/
+class RangeAllocator
+{
+protected:
+  std::map<size_t, size_t> free; //!< Free ranges, indexed by their start.
+  size_t capacity = 0;           //!< Size of the interval.
+  size_t used = 0;               //!< Size of the allocated ranges.
+public:
+  explicit RangeAllocator(size_t = 0);
+
+  //! Empty.
+  ~RangeAllocator() {}
+
+  bool Allocate(size_t, size_t&);
+  void Release(size_t, size_t);
+
+  //! Size of the interval.
+  size_t Capacity() const { return capacity; }
+  //! Size of the allocated ranges.
+  size_t Used() const { return used; }
+};
+
+/*!
+\brief Large pooled buffers shared by the meshes, with a persistently mapped staging ring to stream the updates.
+*/
+class MeshPool
+{
+public:
+  static const int Regions = 3;  //!< Number of regions of the staging ring, one per frame in flight.
+
+  //! Vertex and index buffers of a given vertex format, with a vertex array describing them.
+  struct Page
+  {
+    bool compact = false;        //!< Compact vertex format flag.
+    bool colors = false;         //!< Color attribute flag.
+    size_t capacity = 0;         //!< Number of vertices.
+    GLuint vao = 0;              //!< Vertex array.
+    GLuint vertexBuffer = 0;     //!< Positions, normals and colors, in sections of capacity vertices.
+    GLuint indexBuffer = 0;      //!< Indexes.
+    RangeAllocator vertices;     //!< Allocated vertices.
+    RangeAllocator indexes;      //!< Allocated indexes.
+
+    size_t Offset(int) const;
+    size_t Stride(int) const;
+  };
+
+  //! Vertices and indexes of a mesh in a page.
+  struct Allocation
+  {
+    Page* page = nullptr;        //!< Page, null if nothing is allocated.
+    size_t vertex = 0;           //!< First vertex.
+    size_t vertices = 0;         //!< Number of vertices.
+    size_t index = 0;            //!< First index.
+    size_t indexes = 0;          //!< Number of indexes.
+  };
+protected:
+  std::vector<std::unique_ptr<Page>> pages; //!< Pages.
+  size_t pageVertices = size_t(1) << 20;    //!< Default number of vertices of a page.
+  size_t pageIndexes = size_t(6) << 20;     //!< Default number of indexes of a page.
+  GLuint drawBuffer = 0;                    //!< Draw indexes 0, 1, 2..., read per instance by the batched draws.
+  size_t draws = 0;                         //!< Number of draw indexes.
+
+  // Staging ring
+  bool initialized = false;      //!< Flag set once Init() has been called.
+  bool persistent = false;       //!< Flag set if buffers can be mapped persistently.
+  GLuint staging = 0;            //!< Staging buffer, persistently mapped.
+  unsigned char* mapped = nullptr; //!< Mapped staging buffer.
+  size_t region = 0;             //!< Size of a region of the ring.
+  GLsync fences[Regions] = {};   //!< Fences of the copies out of every region.
+  int frame = 0;                 //!< Frame counter, selecting the region written.
+  size_t cursor = 0;             //!< Number of bytes written in the current region.
+  int stalls = 0;                //!< Number of frames that waited for a region.
+public:
+  //! Empty.
+  MeshPool() {}
+
+  //! Empty, buffers are released by Release().
+  ~MeshPool() {}
+
+  void Init(size_t);
+  void Release();
+  void SetStagingSize(size_t);
+
+  Allocation Allocate(bool, bool, size_t, size_t);
+  void Free(Allocation&);
+  void ReserveDraws(size_t);
+
+  void BeginFrame();
+  void EndFrame();
+  size_t Available() const;
+  size_t Write(GLuint, size_t, const void*, size_t, bool);
+
+  int Pages() const;
+  size_t Memory() const;
+  size_t Used() const;
+  //! Number of frames that waited for a region of the staging ring.
+  int Stalls() const { return stalls; }
+protected:
+  Page* CreatePage(bool, bool, size_t, size_t);
+  void BindDraws(const Page&) const;
+};
+
+#endif
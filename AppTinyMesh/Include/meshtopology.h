@@ -0,0 +1,195 @@
+#ifndef __MeshTopology__
+#define __MeshTopology__
+
+#include "mesh.h"
+
+/*!
+\brief Index based half-edge adjacency of a triangle mesh.
+
+Half-edges are the corners of the mesh: half-edge h is the h-th entry of the vertex index array,
+it belongs to triangle h / 3 and goes from vertex varray[h] to the vertex of the next corner of the
+triangle. Next, previous, origin and face are implicit, only the opposite half-edges are stored.
+*/
+class MeshTopology
+{
+protected:
+  std::vector<int> varray;   //!< Vertex indexes, copy of the mesh vertex indexes as 32 bits integers.
+  std::vector<int> opposite; //!< Opposite half-edge, -1 on boundary and non-manifold edges.
+  std::vector<int> outgoing; //!< One outgoing half-edge per vertex, a boundary one if any, -1 if isolated.
+  std::vector<int> offsets;  //!< Vertex to corner adjacency offsets.
+  std::vector<int> corners;  //!< Vertex to corner adjacency.
+  int edges = 0;             //!< Number of edges.
+  int boundary = 0;          //!< Number of boundary edges.
+  int singular = 0;          //!< Number of non-manifold edges.
+public:
+  explicit MeshTopology(const Mesh&);
+  ~MeshTopology();
+
+  int Vertexes() const;
+  int Triangles() const;
+  int HalfEdges() const;
+  int Edges() const;
+  int BoundaryEdges() const;
+  int NonManifoldEdges() const;
+
+  // Half-edge navigation
+  static int Next(int);
+  static int Prev(int);
+  static int Face(int);
+  int Opposite(int) const;
+  int Origin(int) const;
+  int Target(int) const;
+  int Outgoing(int) const;
+
+  bool IsBoundary(int) const;
+  bool IsBoundaryVertex(int) const;
+  bool IsManifoldVertex(int) const;
+  bool IsManifold() const;
+  bool IsClosed() const;
+
+  int Valence(int) const;
+  std::vector<int> OneRing(int) const;
+  std::vector<int> Faces(int) const;
+  std::vector<std::vector<int>> BoundaryLoops() const;
+
+  size_t Memory() const;
+};
+
+/*!
+\brief Get the number of vertices.
+*/
+inline int MeshTopology::Vertexes() const
+{
+  return int(outgoing.size());
+}
+
+/*!
+\brief Get the number of triangles.
+*/
+inline int MeshTopology::Triangles() const
+{
+  return int(varray.size()) / 3;
+}
+
+/*!
+\brief Get the number of half-edges, i.e. three times the number of triangles.
+*/
+inline int MeshTopology::HalfEdges() const
+{
+  return int(varray.size());
+}
+
+/*!
+\brief Get the number of distinct edges.
+*/
+inline int MeshTopology::Edges() const
+{
+  return edges;
+}
+
+/*!
+\brief Get the number of boundary edges, i.e. edges with a single triangle.
+*/
+inline int MeshTopology::BoundaryEdges() const
+{
+  return boundary;
+}
+
+/*!
+\brief Get the number of non-manifold edges, i.e. edges shared by more than two triangles or by two triangles with inconsistent orientations.
+*/
+inline int MeshTopology::NonManifoldEdges() const
+{
+  return singular;
+}
+
+/*!
+\brief Next half-edge in the triangle.
+\param h Half-edge.
+*/
+inline int MeshTopology::Next(int h)
+{
+  return (h % 3 == 2) ? h - 2 : h + 1;
+}
+
+/*!
+\brief Previous half-edge in the triangle.
+\param h Half-edge.
+*/
+inline int MeshTopology::Prev(int h)
+{
+  return (h % 3 == 0) ? h + 2 : h - 1;
+}
+
+/*!
+\brief Triangle of a half-edge.
+\param h Half-edge.
+*/
+inline int MeshTopology::Face(int h)
+{
+  return h / 3;
+}
+
+/*!
+\brief Opposite half-edge, -1 if the edge is a boundary or a non-manifold edge.
+\param h Half-edge.
+*/
+inline int MeshTopology::Opposite(int h) const
+{
+  return opposite[h];
+}
+
+/*!
+\brief Origin vertex of a half-edge.
+\param h Half-edge.
+*/
+inline int MeshTopology::Origin(int h) const
+{
+  return varray[h];
+}
+
+/*!
+\brief Target vertex of a half-edge.
+\param h Half-edge.
+*/
+inline int MeshTopology::Target(int h) const
+{
+  return varray[Next(h)];
+}
+
+/*!
+\brief Outgoing half-edge of a vertex, on the boundary for boundary vertices, -1 for isolated vertices.
+\param v Vertex.
+*/
+inline int MeshTopology::Outgoing(int v) const
+{
+  return outgoing[v];
+}
+
+/*!
+\brief Check if a half-edge has no opposite half-edge.
+\param h Half-edge.
+*/
+inline bool MeshTopology::IsBoundary(int h) const
+{
+  return opposite[h] == -1;
+}
+
+/*!
+\brief Number of triangles incident to a vertex.
+\param v Vertex.
+*/
+inline int MeshTopology::Valence(int v) const
+{
+  return offsets[v + 1] - offsets[v];
+}
+
+/*!
+\brief Check if the mesh has neither boundary nor non-manifold edges.
+*/
+inline bool MeshTopology::IsClosed() const
+{
+  return boundary == 0 && singular == 0;
+}
+
+#endif
@@ -0,0 +1,97 @@
+#ifndef __NodeStore__
+#define __NodeStore__
+
+#include "implicits.h"
+
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <typeinfo>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/*!
+\brief Store owning the nodes of implicit trees, allocated in a bump arena and shared as a DAG.
+*/
+class NodeStore
+{
+protected:
+  //! Node of the store, with what is needed to compare it with a new node.
+  struct Entry
+  {
+    const Implicit* node;         //!< Node.
+    size_t size;                  //!< Size of the node.
+    const std::type_info* type;   //!< Type of the node.
+  };
+
+  size_t block;                                         //!< Size of the blocks of the arena.
+  std::vector<std::unique_ptr<unsigned char[]>> blocks; //!< Blocks of the arena, zeroed.
+  size_t used = 0;                                      //!< Bytes used in the last block.
+  size_t memory = 0;                                    //!< Bytes allocated.
+  std::unordered_multimap<uint64_t, Entry> table;       //!< Hashable nodes, by structural hash.
+  int nodes = 0;                                        //!< Number of nodes.
+  int shared = 0;                                       //!< Number of creations resolved to an existing node.
+  mutable std::mutex mutex;                             //!< Lock.
+public:
+  explicit NodeStore(size_t = size_t(64) << 10);
+
+  //! Empty, nodes are trivially destructible.
+  ~NodeStore() {}
+
+  NodeStore(const NodeStore&) = delete;
+  NodeStore& operator=(const NodeStore&) = delete;
+
+  template <typename T, typename... Args>
+  T* Create(Args&&...);
+
+  int Nodes() const;
+  int Shared() const;
+  size_t Memory() const;
+protected:
+  unsigned char* Allocate(size_t, size_t);
+  void Release(unsigned char*, size_t);
+  const Implicit* Find(uint64_t, const Implicit*, size_t, const std::type_info&) const;
+  void Insert(uint64_t, const Implicit*, size_t, const std::type_info&);
+};
+
+/*!
+\brief Create a node, or return the identical node created before.
+
+Nodes are constructed in place, so that a tree built bottom up has its subtrees stored
+contiguously, in the order of their evaluation. A node is identical to an existing one if
+they have the same type and the same bytes: since children are created first and shared,
+identical subtrees are detected by comparing their roots only.
+
+Nodes must not be modified once created, since they may be shared by several trees.
+\param args Arguments of the constructor of the node.
+*/
+template <typename T, typename... Args>
+T* NodeStore::Create(Args&&... args)
+{
+  static_assert(std::is_base_of<Implicit, T>::value, "Only implicit nodes are stored");
+  static_assert(std::is_trivially_destructible<T>::value, "Nodes in the arena are never destroyed");
+
+  std::lock_guard<std::mutex> lock(mutex);
+  unsigned char* memory = Allocate(sizeof(T), alignof(T));
+  T* node = new (memory) T(std::forward<Args>(args)...);
+
+  const uint64_t h = node->Hash();
+  if (h != 0)
+  {
+    const Implicit* existing = Find(h, node, sizeof(T), typeid(T));
+    if (existing != nullptr)
+    {
+      Release(memory, sizeof(T));
+      shared++;
+      return const_cast<T*>(static_cast<const T*>(existing));
+    }
+    Insert(h, node, sizeof(T), typeid(T));
+  }
+  nodes++;
+  return node;
+}
+
+#endif
@@ -4,6 +4,11 @@
 #include <QtWidgets/qmainwindow.h>
 #include "realtime.h"
 #include "meshcolor.h"
+#include "jobqueue.h"
+#include "fieldcache.h"
+#include "examples.h"
+
+#include <memory>
 
 QT_BEGIN_NAMESPACE
 	namespace Ui { class Assets; }
@@ -17,6 +22,12 @@ private:
 
   MeshWidget* meshWidget;   //!< Viewer
   MeshColor meshColor;		//!< Mesh.
+  FieldCache fieldCache;    //!< Samples of the implicit examples, generating them again skips the field evaluation.
+  JobQueue jobs;            //!< Background mesh generation.
+
+  struct ImplicitScene;
+  std::shared_ptr<ImplicitScene> scene; //!< Editable implicit scene, if any.
+  static const int LevelsOfDetail = 4; //!< Maximum number of coarser levels of detail of the generated meshes.
 
 public:
   MainWindow();
@@ -24,6 +35,10 @@ public:
   void CreateActions();
   void UpdateGeometry();
   void SetMesh(const MeshColor& mesh);
+  void Generate(const std::function<bool(JobQueue::Job&, std::vector<CompactMesh>&)>&);
+  void GenerateInstanced(const std::string&, const ExampleSettings&);
+  void UpdateScene(const std::function<void(ImplicitScene&)>&);
+  std::function<void(double)> Progress();
 
 public slots:
   void editingSceneLeft(const Ray&);
@@ -7,21 +7,103 @@
 
 #include "mesh.h"
 #include "meshcolor.h"
+#include "compactmesh.h"
+#include "boxtree.h"
+#include "meshpool.h"
 
 #include <QtCore/QMap>
 
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <vector>
+
+// Rolling statistics over the last samples
+class RollingStatistics
+{
+public:
+  static const int Size = 128;    //!< Number of samples kept.
+protected:
+  double samples[Size] = {};      //!< Ring of samples.
+  int count = 0;                  //!< Number of samples added.
+public:
+  /*!
+  \brief Add a sample, replacing the oldest one if the ring is full.
+  */
+  inline void Add(double x)
+  {
+    samples[count % Size] = x;
+    count++;
+  }
+
+  //! Number of samples available.
+  inline int Samples() const
+  {
+    return count < Size ? count : Size;
+  }
+
+  //! Last sample.
+  inline double Last() const
+  {
+    return count == 0 ? 0.0 : samples[(count - 1) % Size];
+  }
+
+  //! Average of the available samples.
+  inline double Mean() const
+  {
+    const int n = Samples();
+    double s = 0.0;
+    for (int i = 0; i < n; i++)
+      s += samples[i];
+    return n == 0 ? 0.0 : s / n;
+  }
+
+  /*!
+  \brief Percentile of the available samples.
+  \param p Percentile, between 0 and 100.
+  */
+  inline double Percentile(double p) const
+  {
+    const int n = Samples();
+    if (n == 0)
+      return 0.0;
+    std::vector<double> sorted(samples, samples + n);
+    int k = int(p / 100.0 * (n - 1) + 0.5);
+    std::nth_element(sorted.begin(), sorted.begin() + k, sorted.end());
+    return sorted[k];
+  }
+};
+
 // Utility class for profiling CPU & GPU
 typedef std::chrono::time_point<std::chrono::high_resolution_clock> MyChrono;
 class RenderingProfiler
 {
 public:
+  //! Profiled GPU passes.
+  enum Pass
+  {
+    Skybox = 0,
+    Meshes = 1,
+    Overlay = 2,
+    Passes = 3,
+  };
+
+  static const int Latency = 4;	//!< Number of frames in the ring of queries, results are read back Latency frames later.
+
   bool enabled = false;			//!< Flag linked to UI.
 
-  GLuint query;					//!< GL Query for stats
-  GLuint64 elapsedTimeGPU;		//!< GPU rendering time for a frame.
+  GLuint queries[Latency][Passes];	//!< Ring of GL timer queries, one per pass and per frame in flight.
+  bool issued[Latency][Passes] = {};	//!< Queries waiting for their result.
+  int frame = 0;					//!< GPU frame counter.
+  int dropped = 0;				//!< Results not available in time, hence discarded.
+
+  RollingStatistics gpu[Passes];	//!< GPU time per pass, in ms.
+  RollingStatistics gpuFrame;		//!< GPU time of all the passes, in ms.
+  RollingStatistics cpuFrame;		//!< CPU time between frames, in ms.
 
   int nbframes = 0;				//!< CPU Frame counter.
   MyChrono start;					//!< CPU profiler.
+  MyChrono last;					//!< CPU time of the last frame.
   double msPerFrame = 0;			//!< Recorded info.
   double framePerSecond = 0;		//!< Recorded info.
 
@@ -30,48 +112,93 @@ public:
   */
   inline void Init()
   {
-    glGenQueries(1, &query);
-    start = std::chrono::high_resolution_clock::now();
+    glGenQueries(Latency * Passes, &queries[0][0]);
+    start = last = std::chrono::high_resolution_clock::now();
+  }
+
+  /*!
+  \brief Start a GPU frame: collect the results of the queries issued Latency frames ago.
+
+  Results are never waited for: a query that is still not available is discarded.
+  */
+  inline void BeginFrame()
+  {
+    const int slot = frame % Latency;
+    double total = 0.0;
+    bool complete = true;
+    for (int p = 0; p < Passes; p++)
+    {
+      if (!issued[slot][p])
+      {
+        complete = false;
+        continue;
+      }
+      issued[slot][p] = false;
+
+      GLint available = 0;
+      glGetQueryObjectiv(queries[slot][p], GL_QUERY_RESULT_AVAILABLE, &available);
+      if (!available)
+      {
+        dropped++;
+        complete = false;
+        continue;
+      }
+      GLuint64 ns = 0;
+      glGetQueryObjectui64v(queries[slot][p], GL_QUERY_RESULT, &ns);
+      gpu[p].Add(ns / 1000000.0);
+      total += ns / 1000000.0;
+    }
+    if (complete)
+      gpuFrame.Add(total);
   }
 
   /*!
-  \brief Starts profiling the GPU if enabled.
+  \brief Starts profiling a GPU pass if enabled. Passes must not be nested.
   */
-  inline void BeginGPU()
+  inline void Begin(Pass pass)
   {
     if (enabled)
-      glBeginQuery(GL_TIME_ELAPSED, query);
+      glBeginQuery(GL_TIME_ELAPSED, queries[frame % Latency][pass]);
   }
 
   /*!
-  \brief Ends the GPU profiling if enabled.
+  \brief Ends the profiling of a GPU pass if enabled.
   */
-  inline void EndGPU()
+  inline void End(Pass pass)
   {
     if (enabled)
     {
       glEndQuery(GL_TIME_ELAPSED);
-      int done = 0;
-      while (!done)
-        glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &done);
-      glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsedTimeGPU);
+      issued[frame % Latency][pass] = true;
     }
   }
 
+  /*!
+  \brief End the GPU frame.
+  */
+  inline void EndFrame()
+  {
+    frame++;
+  }
+
   /*!
   \brief Update the CPU profiling.
   */
   inline void Update()
   {
+    MyChrono now = std::chrono::high_resolution_clock::now();
+    cpuFrame.Add(std::chrono::duration_cast<std::chrono::microseconds>(now - last).count() / 1000.0);
+    last = now;
+
     nbframes++;
-    auto microseconds = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - start).count();
+    auto microseconds = std::chrono::duration_cast<std::chrono::microseconds>(now - start).count();
     const double seconds = static_cast<double>(microseconds) / 1000000.0;
     if (seconds >= 1.0)
     {
       msPerFrame = seconds * 1000.0 / nbframes;
       framePerSecond = nbframes / seconds;
       nbframes = 0;
-      start = std::chrono::high_resolution_clock::now();
+      start = now;
     }
   }
 };
@@ -97,24 +224,54 @@ protected:
   {
   public:
     bool enabled;				//!< Render flag. Mesh is not rendered if enabled equals false.
-    GLuint vao;					//!< Mesh VAO.
-    GLuint fullBuffer;			//!< Mesh buffer. Contains 3D normals, 2D vertices and heights.
-    GLuint indexBuffer;			//!< Mesh index buffer.
+    bool compact;				//!< Flag set if the vertices are stored in the compact format, see CompactMesh::PackPositions().
+    MeshPool* pool;				//!< Pool of the buffers.
+    MeshPool::Allocation range;	//!< Vertices and indexes in the pool, the page is null until Allocate() is called.
     int triangleCount;			//!< Triangle count to draw.
+    double acmr;				//!< Average cache miss ratio of the triangle order.
+    double acmrInput;			//!< Average cache miss ratio of the triangle order before optimization, see CompactMesh::InputACMR().
+
+    std::vector<MeshGL> lods;	//!< Coarser levels of detail, sorted by increasing error.
+    double error;				//!< Geometric error of the mesh with respect to the original one.
+    int level;					//!< Level of detail drawn, 0 for the mesh itself.
+
     float TRSMatrix[16];		//!< Translation-Rotation-Scale Matrix.
     Box bbox;					//!< Bounding box of the mesh.
 
+    std::vector<GLfloat> instances;	//!< Offsets of the instances, 4 floats per instance with the last one unused, empty if the mesh is not instanced.
+    Box instanceBox;			//!< Bounding box of the offsets of the instances.
+    BoxTree instanceTree;		//!< Hierarchy of the world boxes of the instances.
+    bool instanceDirty;			//!< Flag set when the instances or the frame changed.
+    std::vector<int> visible;	//!< Instances drawn in the current frame.
+    GLuint instanceBuffer;		//!< Buffer with the offsets of the drawn instances.
+    GLuint instanceTexture;		//!< Buffer texture of the offsets, read by the vertex shader.
+
     MeshShading shading;		//!< Render flag.
     MeshMaterial material;		//!< Render flag.
     bool useWireframe;			//!< Render flag.
 
   public:
     MeshGL();
-    MeshGL(const Mesh& mesh, const Vector& position = Vector::Null);
-    MeshGL(const MeshColor& mesh, const Vector& position = Vector::Null);
+    MeshGL(MeshPool& pool, const Mesh& mesh, const Vector& position = Vector::Null, bool compact = false);
+    MeshGL(MeshPool& pool, const MeshColor& mesh, const Vector& position = Vector::Null, bool compact = false);
+    MeshGL(MeshPool& pool, const CompactMesh& mesh, const Vector& position = Vector::Null, bool compact = false);
+
+    void Allocate(MeshPool&, const CompactMesh&);
+    size_t Upload(const CompactMesh&, size_t, size_t, bool);
+    size_t Bytes(const CompactMesh&) const;
 
     void Delete();
     void SetFrame(const Vector& position);
+    Box WorldBox() const;
+    Box Transformed(const Box&) const;
+
+    void SetInstances(const std::vector<Vector>&);
+    Box InstanceBox(int) const;
+    void CullInstances(const Frustum*);
+
+    void AddLevel(const CompactMesh&, double);
+    const MeshGL& Level() const;
+    void SelectLevel(double, double);
   };
 
   typedef QMap<QString, MeshGL*>::iterator MeshIterator;
@@ -130,23 +287,131 @@ protected:
   Vector toAt = Vector::Null;
   int stepAt = 0;
 
+  /*!
+  \brief Per frame uniforms shared by all the meshes, in the std140 layout of the Frame uniform block.
+  */
+  struct FrameUniforms
+  {
+    GLfloat ModelViewMatrix[16];
+    GLfloat ProjectionMatrix[16];
+    GLfloat viewDir[3];
+    GLfloat pad0;
+    GLfloat WIN_SCALE[2];
+    GLfloat pad1[2];
+  };
+
+  /*!
+  \brief Per object data of the batched draws, in the std430 layout of the Objects storage block.
+  */
+  struct ObjectData
+  {
+    GLfloat TRSMatrix[16];
+    GLfloat positionOrigin[4];
+    GLfloat positionScale[4];
+    GLint state[4];              //!< Material, shading, wireframe and compact vertex format flags.
+  };
+
+  //! Command of an indirect multi-draw, as read by glMultiDrawElementsIndirect().
+  struct DrawCommand
+  {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+  };
+
   // Meshes
-  GLuint mainShaderProgram;
+  ShaderProgram mainShader;
   QMap<QString, MeshGL*> objects;
+  MeshPool pool;                 //!< Buffers of the meshes.
+
+  // Batching
+  ShaderProgram batchShader;     //!< Mesh shader reading the per object data from a storage buffer.
+  bool batching = false;         //!< Flag set if indirect multi-draws and storage buffers are supported.
+  bool useBatching = true;       //!< Batching flag.
+  GLuint objectBuffer = 0;       //!< Storage buffer with the ObjectData of the batched objects.
+  GLuint commandBuffer = 0;      //!< Indirect buffer with the DrawCommand of the batched objects.
+  std::vector<MeshGL*> batched;  //!< Objects drawn in batches in the current frame, sorted by page.
+  std::vector<MeshGL*> singles;  //!< Objects drawn one by one in the current frame.
+  std::vector<ObjectData> objectData; //!< Per object data of the current frame.
+  std::vector<DrawCommand> commands;  //!< Draw commands of the current frame.
+  int drawCalls = 0;             //!< Number of draw calls of the meshes in the last frame.
+  GLuint frameBuffer = 0;        //!< Uniform buffer with the FrameUniforms.
+  int uTRSMatrix = -1;           //!< Uniform slots of the mesh shader.
+  int uUseWireframe = -1;
+  int uMaterial = -1;
+  int uShading = -1;
+  int uUseInstances = -1;
+  int uCompactVertices = -1;
+  int uPositionOrigin = -1;
+  int uPositionScale = -1;
+  bool compactVertices = false;  //!< Compact vertex format flag, applied to the meshes added next.
+
+  // Culling
+  bool useCulling = true;        //!< Frustum culling flag.
+  BoxTree objectTree;            //!< Hierarchy of the world boxes of the objects.
+  std::vector<MeshGL*> treeObjects; //!< Objects in the hierarchy, indexed as its boxes.
+  bool treeDirty = true;         //!< Flag set when objects are added, removed or moved.
+  std::vector<MeshGL*> drawList; //!< Objects drawn in the current frame.
+  int culledCount = 0;           //!< Number of enabled objects culled in the last frame.
+  static const int TreeThreshold = 64; //!< Minimum number of objects to cull with the hierarchy.
+
+  // Levels of detail
+  double lodTolerance = 1.0;     //!< Maximum projected error of the levels of detail, in pixels.
+
+  //! Mesh being uploaded over several frames.
+  struct PendingMesh
+  {
+    QString name;                //!< Name of the mesh.
+    CompactMesh mesh;            //!< Data.
+    MeshGL* object = nullptr;    //!< Object, created on the first upload.
+    size_t uploaded = 0;         //!< Number of bytes uploaded so far.
+    bool scene = false;          //!< Flag set if the mesh belongs to a scene replacing all the meshes, see QueueScene().
+    std::vector<std::pair<CompactMesh, double>> levels; //!< Coarser levels of detail and their errors, uploaded after the mesh.
+    int level = 0;               //!< Level being uploaded, 0 for the mesh itself.
+  };
+
+  // Staged uploads
+  std::deque<PendingMesh> pending; //!< Meshes waiting to be uploaded, in order.
+  std::vector<std::pair<QString, MeshGL*>> staged; //!< Uploaded meshes of the queued scene, displayed once it is complete.
+  size_t uploadBudget = 8 << 20; //!< Maximum number of bytes uploaded per frame, size of a region of the staging ring of the pool.
 
   // Skybox
-  GLuint skyboxShader = 0;
+  ShaderProgram skyboxShader;
   GLuint skyboxVAO = 0;
+  int uCamPos = -1;              //!< Uniform slots of the skybox shader.
+  int uCamLookAt = -1;
+  int uCamUp = -1;
+  int uResolution = -1;
 
   // Profiling
   RenderingProfiler profiler;
 
 public:
+  //! Mesh of a scene queued with QueueScene().
+  struct SceneMesh
+  {
+    QString name;                //!< Name of the mesh.
+    CompactMesh mesh;            //!< Data.
+    std::vector<std::pair<CompactMesh, double>> levels; //!< Coarser levels of detail and their errors, may be empty, see CompactMesh::LevelsOfDetail().
+  };
+
   MeshWidget();
   ~MeshWidget();
 
   void AddMesh(const QString&, const Mesh&, const Vector & = Vector::Null);
   void AddMesh(const QString&, const MeshColor&, const Vector & = Vector::Null);
+  void AddMesh(const QString&, const CompactMesh&, const Vector & = Vector::Null);
+  void AddMesh(const QString&, const CompactMesh&, int, const Vector & = Vector::Null);
+  void AddLevel(const QString&, const CompactMesh&, double);
+  void SetInstances(const QString&, const std::vector<Vector>&);
+  void SetLevelOfDetailTolerance(double);
+  void QueueMesh(const QString&, CompactMesh&&, const Vector & = Vector::Null);
+  void QueueMesh(const QString&, CompactMesh&&, std::vector<std::pair<CompactMesh, double>>&&, const Vector & = Vector::Null);
+  void QueueScene(std::vector<SceneMesh>&&);
+  void SetUploadBudget(size_t);
+  void UseCompactVertices(bool);
   void DeleteMesh(const QString&);
   void ClearAll();
 
@@ -169,6 +434,10 @@ public:
   void SetShading(const QString&, MeshShading);
   void SetShadingGlobal(MeshShading);
 
+  void ReloadShaders();
+  void UseCulling(bool);
+  void UseBatching(bool);
+
 private:
   void _InternalGetMouseGlobalPosition(QMouseEvent* e, int& x0, int& y0) const;
 
@@ -177,6 +446,11 @@ protected:
   virtual void resizeGL(int, int);
   virtual void paintGL();
   virtual void RenderStats();
+  void CullObjects(const Frustum&);
+  void DrawBatches();
+  void SelectLevels();
+  void UploadPending();
+  void DeletePending(const QString&);
 
 signals:
   void _signalUpdate();
@@ -185,6 +459,7 @@ signals:
   void _signalMouseRelease();
   void _signalEditSceneLeft(const Ray&);
   void _signalEditSceneRight(const Ray&);
+  void _signalMeshUploaded(const QString&);
 
 public slots:
   virtual void mousePressEvent(QMouseEvent*);
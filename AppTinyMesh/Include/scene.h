@@ -0,0 +1,76 @@
+#ifndef __Scene__
+#define __Scene__
+
+#include "examples.h"
+#include "nodestore.h"
+
+#include <functional>
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/*!
+\brief Scene loaded from a file: implicit trees, parametric surfaces and the meshes to generate.
+*/
+class Scene
+{
+public:
+  //! Types of records.
+  enum class Type : uint8_t
+  {
+    Sphere, Box, Planes, Capsule, Torus,            // Primitives
+    Union, Intersection, Diff, Blend,               // Combinators
+    Translate, Scale, Replicate,                    // Transforms
+    Bezier, Revolution,                             // Parametric surfaces
+    Polygonize, Tessellate,                         // Meshes to generate
+    Types
+  };
+
+  //! Line of the scene, defining a node or a surface, or a mesh to generate.
+  struct Record
+  {
+    Type type;                    //!< Type.
+    std::string name;             //!< Name of the node or surface, empty for meshes.
+    std::vector<int> refs;        //!< Referenced records.
+    std::vector<double> values;   //!< Parameters.
+  };
+protected:
+  std::vector<Record> records;                //!< Records, referenced records come first.
+  std::shared_ptr<NodeStore> store;           //!< Storage of the implicit nodes.
+  std::vector<Implicit*> nodes;               //!< Implicit nodes of the records, null for other records.
+  std::string error;                          //!< Last error.
+public:
+  explicit Scene();
+
+  //! Empty.
+  ~Scene() {}
+
+  Scene(const Scene&) = delete;
+  Scene& operator=(const Scene&) = delete;
+
+  bool Load(const std::string&);
+  bool Save(const std::string&, bool = false) const;
+  bool Read(std::istream&, const std::string& = "scene");
+  void Write(std::ostream&) const;
+  bool ReadBinary(std::istream&);
+  void WriteBinary(std::ostream&) const;
+
+  //! Last error, with the line of text scenes.
+  const std::string& Error() const { return error; }
+  //! Records of the scene.
+  const std::vector<Record>& Records() const { return records; }
+  //! Memory used by the implicit nodes, in bytes.
+  size_t Memory() const { return store ? store->Memory() : 0; }
+  //! Store of the implicit nodes, shared with the trees that outlive the scene.
+  std::shared_ptr<const NodeStore> Store() const { return store; }
+  Implicit* Node(const std::string&) const;
+
+  bool Generate(std::vector<CompactMesh>&, const ExampleSettings& = ExampleSettings(), const std::function<bool(double)>& = nullptr) const;
+protected:
+  bool Check(const Record&, std::string&) const;
+  void Build();
+};
+
+#endif
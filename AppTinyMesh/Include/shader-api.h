@@ -23,6 +23,7 @@
 #endif
 
 #include <string>
+#include <vector>
 
 // Shader API
 GLuint read_program(const char *filename, const char *definitions = "");
@@ -31,4 +32,64 @@ int reload_program(const GLuint program, const char *filename, const char *defin
 int program_format_errors(const GLuint program, std::string& errors);
 int program_print_errors(const GLuint program);
 
+/*!
+\brief Shader program with cached uniform locations.
+
+Uniforms are registered once by name and identified by a slot; their locations are resolved when the
+program is linked and every time it is reloaded, so that no location is looked up by name while rendering.
+Uniform blocks are bound to fixed binding points at the same time.
+*/
+class ShaderProgram
+{
+protected:
+  GLuint program = 0;                 //!< Program.
+  std::string filename;               //!< Source file.
+  std::string definitions;            //!< Definitions inserted in the source.
+  std::vector<std::string> names;     //!< Names of the registered uniforms.
+  std::vector<GLint> locations;       //!< Locations of the registered uniforms.
+  std::vector<std::string> blocks;    //!< Names of the registered uniform blocks.
+  std::vector<GLuint> bindings;       //!< Binding points of the registered uniform blocks.
+public:
+  //! Empty.
+  ShaderProgram() {}
+
+  bool Load(const std::string&, const std::string& = "");
+  bool Reload();
+  void Release();
+
+  int Uniform(const std::string&);
+  void UniformBlock(const std::string&, GLuint);
+
+  GLint Location(int) const;
+  GLuint Id() const;
+  void Use() const;
+protected:
+  void Resolve();
+};
+
+/*!
+\brief Return the location of a registered uniform, -1 if the uniform is not active.
+\param slot Slot returned by Uniform().
+*/
+inline GLint ShaderProgram::Location(int slot) const
+{
+  return locations[slot];
+}
+
+/*!
+\brief Return the OpenGL name of the program.
+*/
+inline GLuint ShaderProgram::Id() const
+{
+  return program;
+}
+
+/*!
+\brief Make the program current.
+*/
+inline void ShaderProgram::Use() const
+{
+  glUseProgram(program);
+}
+
 #endif
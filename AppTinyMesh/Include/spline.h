@@ -0,0 +1,470 @@
+// B-Splines and NURBS
+
+#pragma once
+
+#include "tp_math.h"
+
+/*!
+\brief Knot vector of a B-spline basis.
+
+Invalid parameters give an empty knot vector, with no control point, see count().
+
+Provides the knot span lookup and the evaluation of the non vanishing basis functions and their derivatives,
+so that the cost of evaluating a curve or a surface only depends on the degree, not on the number of control points.
+
+After Les Piegl and Wayne Tiller, <I>The NURBS Book</I>, Springer, 1997 (algorithms A2.1, A2.2 and A2.3).
+*/
+class KnotVector {
+public:
+  static constexpr int MaxDegree = 7; //!< Maximum supported degree.
+
+private:
+  std::vector<double> knots;
+  int p = 0;              //!< Degree.
+  int n = -1;             //!< Index of the last control point, -1 if the knot vector is empty.
+  bool uniform = false;   //!< Evenly spaced interior knots, the span is computed directly.
+
+public:
+  KnotVector(){}
+
+  /*!
+  \brief Clamped uniform knot vector.
+  \param count Number of control points.
+  \param degree Degree, lowered to count-1 and to MaxDegree if needed.
+  */
+  KnotVector(uint count, uint degree) {
+    if (count == 0 || count > (1u << 30)) return;
+    p = std::min<int>(std::min<uint>(degree, MaxDegree), int(count) - 1);
+    n = int(count) - 1;
+    uniform = true;
+    int m = n + p + 1;
+    knots.resize(m + 1);
+    for (int i = 0; i <= m; i++){
+      if (i <= p) knots[i] = 0.0;
+      else if (i >= m - p) knots[i] = 1.0;
+      else knots[i] = double(i - p) / (n - p + 1);
+    }
+  }
+
+  /*!
+  \brief Arbitrary non decreasing knot vector.
+  \param degree Degree.
+  \param degree Degree, at most MaxDegree.
+  \param knots Knots, there must be number of control points + degree + 1 of them, with a non empty domain.
+  */
+  KnotVector(uint degree, const std::vector<double>& knots) {
+    if (degree > uint(MaxDegree) || knots.size() < 2 * size_t(degree) + 2) return;
+    for (size_t i = 1; i < knots.size(); i++)
+      if (!(knots[i - 1] <= knots[i])) return;
+    if (!(knots[degree] < knots[knots.size() - degree - 1])) return;
+    this->knots = knots;
+    p = int(degree);
+    n = int(knots.size()) - int(degree) - 2;
+  }
+
+  int degree() const { return p; }
+  //! Number of control points, 0 if the knot vector is empty.
+  int count() const { return n + 1; }
+
+  //! Start of the parametric domain.
+  double start() const { return knots[p]; }
+  //! End of the parametric domain.
+  double end() const { return knots[n + 1]; }
+
+  //! Map t in [0,1] to the parametric domain.
+  double map(double t) const { return start() + t * (end() - start()); }
+
+  /*!
+  \brief Find the knot span containing u, i.e. the index i such that knots[i] <= u < knots[i+1].
+  */
+  int span(double u) const {
+    if (u >= knots[n + 1]) return n;
+    if (u <= knots[p]) return p;
+
+    if (uniform){
+      int s = p + int((u - knots[p]) / (knots[n + 1] - knots[p]) * (n - p + 1));
+      s = std::clamp(s, p, n);
+      // Round off
+      while (s > p && u < knots[s]) s--;
+      while (s < n && u >= knots[s + 1]) s++;
+      return s;
+    }
+
+    int low = p, high = n + 1;
+    int mid = (low + high) / 2;
+    while (u < knots[mid] || u >= knots[mid + 1]){
+      if (u < knots[mid]) high = mid;
+      else low = mid;
+      mid = (low + high) / 2;
+    }
+    return mid;
+  }
+
+  /*!
+  \brief Compute the p+1 non vanishing basis functions at u.
+  \param s Knot span of u.
+  \param u Parameter.
+  \param N Returned basis functions N[s-p..s].
+  */
+  void basis(int s, double u, double* N) const {
+    double left[MaxDegree + 1], right[MaxDegree + 1];
+    N[0] = 1.0;
+    for (int j = 1; j <= p; j++){
+      left[j] = u - knots[s + 1 - j];
+      right[j] = knots[s + j] - u;
+      double saved = 0.0;
+      for (int r = 0; r < j; r++){
+        double temp = N[r] / (right[r + 1] + left[j - r]);
+        N[r] = saved + right[r + 1] * temp;
+        saved = left[j - r] * temp;
+      }
+      N[j] = saved;
+    }
+  }
+
+  /*!
+  \brief Compute the non vanishing basis functions and their derivatives at u.
+
+  Derivatives of order greater than the degree are null.
+  \param s Knot span of u.
+  \param u Parameter.
+  \param nd Derivative order.
+  \param ders Returned derivatives, ders[k][j] is the k-th derivative of N[s-p+j].
+  */
+  void derivatives(int s, double u, int nd, double ders[][MaxDegree + 1]) const {
+    double ndu[MaxDegree + 1][MaxDegree + 1];
+    double a[2][MaxDegree + 1];
+    double left[MaxDegree + 1], right[MaxDegree + 1];
+
+    ndu[0][0] = 1.0;
+    for (int j = 1; j <= p; j++){
+      left[j] = u - knots[s + 1 - j];
+      right[j] = knots[s + j] - u;
+      double saved = 0.0;
+      for (int r = 0; r < j; r++){
+        // Lower triangle: knot differences, upper triangle: basis functions
+        ndu[j][r] = right[r + 1] + left[j - r];
+        double temp = ndu[r][j - 1] / ndu[j][r];
+        ndu[r][j] = saved + right[r + 1] * temp;
+        saved = left[j - r] * temp;
+      }
+      ndu[j][j] = saved;
+    }
+
+    for (int j = 0; j <= p; j++)
+      ders[0][j] = ndu[j][p];
+
+    const int nk = std::min(nd, p);
+    for (int r = 0; r <= p; r++){
+      int s1 = 0, s2 = 1;
+      a[0][0] = 1.0;
+      for (int k = 1; k <= nk; k++){
+        double d = 0.0;
+        int rk = r - k, pk = p - k;
+        if (r >= k){
+          a[s2][0] = a[s1][0] / ndu[pk + 1][rk];
+          d = a[s2][0] * ndu[rk][pk];
+        }
+        int j1 = rk >= -1 ? 1 : -rk;
+        int j2 = (r - 1 <= pk) ? k - 1 : p - r;
+        for (int j = j1; j <= j2; j++){
+          a[s2][j] = (a[s1][j] - a[s1][j - 1]) / ndu[pk + 1][rk + j];
+          d += a[s2][j] * ndu[rk + j][pk];
+        }
+        if (r <= pk){
+          a[s2][k] = -a[s1][k - 1] / ndu[pk + 1][r];
+          d += a[s2][k] * ndu[r][pk];
+        }
+        ders[k][r] = d;
+        std::swap(s1, s2);
+      }
+    }
+
+    double f = p;
+    for (int k = 1; k <= nk; k++){
+      for (int j = 0; j <= p; j++)
+        ders[k][j] *= f;
+      f *= (p - k);
+    }
+    for (int k = nk + 1; k <= nd; k++)
+      for (int j = 0; j <= p; j++)
+        ders[k][j] = 0.0;
+  }
+};
+
+/*!
+\brief Uniform or non-uniform B-spline curve.
+
+The curve is parameterized over [0,1], which is mapped to the domain of the knot vector.
+Control points that do not match the knot vector are rejected: the curve is empty and evaluates to the origin.
+*/
+class BSplineCurve : public Curve {
+protected:
+  std::vector<Vector> controls;
+  KnotVector knots;
+public:
+  BSplineCurve(){}
+  //! Clamped uniform B-spline of given degree.
+  BSplineCurve(const std::vector<Vector>& controls, uint degree) : controls(controls), knots(uint(controls.size()), degree) {}
+  //! Non-uniform B-spline.
+  BSplineCurve(const std::vector<Vector>& controls, const KnotVector& knots) : controls(controls), knots(knots) {
+    if (knots.count() != int(controls.size())) clear();
+  }
+
+  Vector position(double t) override {
+    if (controls.empty()) return Vector(0.0);
+    double u = knots.map(t);
+    int s = knots.span(u);
+    double N[KnotVector::MaxDegree + 1];
+    knots.basis(s, u, N);
+    Vector sum(0,0,0);
+    for (int i = 0; i <= knots.degree(); i++)
+      sum += controls[s - knots.degree() + i] * N[i];
+    return sum;
+  }
+
+  /*!
+  \brief Position and derivatives from a single evaluation of the basis functions.
+  */
+  CurvePoint evaluate(double t, int order = 2) override {
+    if (controls.empty()) return CurvePoint();
+    double u = knots.map(t);
+    int s = knots.span(u);
+    double ders[4][KnotVector::MaxDegree + 1];
+    order = std::clamp(order, 0, 3);
+    knots.derivatives(s, u, order, ders);
+    CurvePoint cp;
+    for (int i = 0; i <= knots.degree(); i++){
+      const Vector& c = controls[s - knots.degree() + i];
+      cp.p += c * ders[0][i];
+      for (int k = 1; k <= order; k++)
+        cp.d[k - 1] += c * ders[k][i];
+    }
+    scale(cp, order);
+    return cp;
+  }
+
+  CurveFrame frame(double t) override {
+    CurvePoint cp = evaluate(t, 1);
+    CurveFrame f;
+    f.p = cp.p;
+    f.t = Normalized(cp.d[0]);
+    f.n = Normalized(f.t/Vector(0,1,0));
+    f.b = Normalized(f.t / f.n);
+    return f;
+  }
+
+  Vector delta_1(double t, double, double) override {
+    return evaluate(t, 1).d[0];
+  }
+
+  Vector delta_2(double t, double, double) override {
+    return evaluate(t, 2).d[1];
+  }
+
+  Vector normal(double t) override {
+    return Normalized(tangente(t)/Vector(0,1,0));
+  }
+
+protected:
+  //! Reject the control points.
+  void clear() {
+    controls.clear();
+    knots = KnotVector();
+  }
+
+  //! Convert derivatives with respect to the knot parameter into derivatives with respect to t.
+  void scale(CurvePoint& cp, int order) const {
+    double f = knots.end() - knots.start(), fk = f;
+    for (int k = 0; k < order; k++, fk *= f)
+      cp.d[k] *= fk;
+  }
+};
+
+/*!
+\brief Rational B-spline curve.
+*/
+class NURBSCurve : public BSplineCurve {
+protected:
+  std::vector<double> weights;
+public:
+  NURBSCurve(){}
+  NURBSCurve(const std::vector<Vector>& controls, const std::vector<double>& weights, uint degree) : BSplineCurve(controls, degree), weights(weights) {
+    if (weights.size() != this->controls.size()) clear();
+  }
+  NURBSCurve(const std::vector<Vector>& controls, const std::vector<double>& weights, const KnotVector& knots) : BSplineCurve(controls, knots), weights(weights) {
+    if (weights.size() != this->controls.size()) clear();
+  }
+
+  Vector position(double t) override {
+    if (controls.empty()) return Vector(0.0);
+    double u = knots.map(t);
+    int s = knots.span(u);
+    double N[KnotVector::MaxDegree + 1];
+    knots.basis(s, u, N);
+    Vector sum(0,0,0);
+    double w = 0.0;
+    for (int i = 0; i <= knots.degree(); i++){
+      int c = s - knots.degree() + i;
+      sum += controls[c] * (N[i] * weights[c]);
+      w += N[i] * weights[c];
+    }
+    return sum / w;
+  }
+
+  /*!
+  \brief Position and derivatives of the rational curve, from the derivatives of its homogeneous form.
+  */
+  CurvePoint evaluate(double t, int order = 2) override {
+    if (controls.empty()) return CurvePoint();
+    double u = knots.map(t);
+    int s = knots.span(u);
+    double ders[4][KnotVector::MaxDegree + 1];
+    order = std::clamp(order, 0, 3);
+    knots.derivatives(s, u, order, ders);
+
+    // Derivatives of the weighted numerator A and of the denominator w
+    Vector A[4] = { Vector(0.0), Vector(0.0), Vector(0.0), Vector(0.0) };
+    double w[4] = { 0.0, 0.0, 0.0, 0.0 };
+    for (int i = 0; i <= knots.degree(); i++){
+      int c = s - knots.degree() + i;
+      for (int k = 0; k <= order; k++){
+        A[k] += controls[c] * (ders[k][i] * weights[c]);
+        w[k] += ders[k][i] * weights[c];
+      }
+    }
+
+    // C = A/w, C' = (A' - w'C)/w, C'' = (A'' - 2w'C' - w''C)/w, C''' = (A''' - 3w'C'' - 3w''C' - w'''C)/w
+    CurvePoint cp;
+    cp.p = A[0] / w[0];
+    if (order >= 1) cp.d[0] = (A[1] - w[1] * cp.p) / w[0];
+    if (order >= 2) cp.d[1] = (A[2] - 2.0 * w[1] * cp.d[0] - w[2] * cp.p) / w[0];
+    if (order >= 3) cp.d[2] = (A[3] - 3.0 * w[1] * cp.d[1] - 3.0 * w[2] * cp.d[0] - w[3] * cp.p) / w[0];
+    scale(cp, order);
+    return cp;
+  }
+};
+
+/*!
+\brief Uniform or non-uniform tensor product B-spline surface.
+
+Each sample only involves the (p+1)x(q+1) control points of its knot spans.
+A control net that does not match the knot vectors is rejected: the surface is empty and evaluates to the origin.
+*/
+class BSplineSurface {
+protected:
+  std::vector<Vector> controls; // 2D array
+  uint size_x = 0, size_y = 0;
+  KnotVector knots_u, knots_v;
+public:
+  BSplineSurface(){}
+  //! Clamped uniform B-spline surface.
+  BSplineSurface(uint sx, uint sy, const std::vector<Vector>& controls, uint pu, uint pv)
+    : controls(controls), size_x(sx), size_y(sy), knots_u(sx, pu), knots_v(sy, pv) {
+    check();
+  }
+  //! Non-uniform B-spline surface.
+  BSplineSurface(uint sx, uint sy, const std::vector<Vector>& controls, const KnotVector& ku, const KnotVector& kv)
+    : controls(controls), size_x(sx), size_y(sy), knots_u(ku), knots_v(kv) {
+    check();
+  }
+  virtual ~BSplineSurface(){}
+
+  const Vector& control(uint x, uint y) const {
+    assert(x < size_x && y < size_y);
+    return controls[y * size_x + x];
+  }
+
+  Vector& control(uint x, uint y) {
+    assert(x < size_x && y < size_y);
+    return controls[y * size_x + x];
+  }
+
+  Vector position(double u, double v) const {
+    Vector p, du, dv;
+    evaluate(u, v, p, du, dv, false);
+    return p;
+  }
+
+  Vector normal(double u, double v) const {
+    Vector p, du, dv;
+    evaluate(u, v, p, du, dv, true);
+    // /!\ cross product
+    return Normalized(du / dv);
+  }
+
+protected:
+  virtual double weight(uint, uint) const { return 1.0; }
+
+  //! Reject the control net if it does not match the knot vectors.
+  void check() {
+    if (knots_u.count() == 0 || knots_v.count() == 0 || knots_u.count() != int(size_x) || knots_v.count() != int(size_y) || controls.size() != size_t(size_x) * size_y)
+      clear();
+  }
+
+  //! Reject the control net.
+  void clear() {
+    controls.clear();
+    size_x = size_y = 0;
+    knots_u = knots_v = KnotVector();
+  }
+
+  //! Position and optionally first order partial derivatives.
+  void evaluate(double tu, double tv, Vector& p, Vector& du, Vector& dv, bool derivatives) const {
+    if (controls.empty()){
+      p = du = dv = Vector(0.0);
+      return;
+    }
+    const int pu = knots_u.degree(), pv = knots_v.degree();
+    double u = knots_u.map(tu), v = knots_v.map(tv);
+    int su = knots_u.span(u), sv = knots_v.span(v);
+    double Nu[2][KnotVector::MaxDegree + 1], Nv[2][KnotVector::MaxDegree + 1];
+    knots_u.derivatives(su, u, derivatives ? 1 : 0, Nu);
+    knots_v.derivatives(sv, v, derivatives ? 1 : 0, Nv);
+
+    // Homogeneous sums, weights are 1 for non rational surfaces
+    Vector A(0.0), Au(0.0), Av(0.0);
+    double w = 0.0, wu = 0.0, wv = 0.0;
+    for (int j = 0; j <= pv; j++){
+      for (int i = 0; i <= pu; i++){
+        uint x = su - pu + i, y = sv - pv + j;
+        double c = weight(x, y);
+        const Vector& P = control(x, y);
+        A += P * (Nu[0][i] * Nv[0][j] * c);
+        w += Nu[0][i] * Nv[0][j] * c;
+        if (derivatives){
+          Au += P * (Nu[1][i] * Nv[0][j] * c);
+          Av += P * (Nu[0][i] * Nv[1][j] * c);
+          wu += Nu[1][i] * Nv[0][j] * c;
+          wv += Nu[0][i] * Nv[1][j] * c;
+        }
+      }
+    }
+    p = A / w;
+    if (derivatives){
+      du = (Au - wu * p) / w * (knots_u.end() - knots_u.start());
+      dv = (Av - wv * p) / w * (knots_v.end() - knots_v.start());
+    }
+  }
+};
+
+/*!
+\brief Rational tensor product B-spline surface.
+*/
+class NURBSSurface : public BSplineSurface {
+protected:
+  std::vector<double> weights; // 2D array
+public:
+  NURBSSurface(){}
+  NURBSSurface(uint sx, uint sy, const std::vector<Vector>& controls, const std::vector<double>& weights, uint pu, uint pv)
+    : BSplineSurface(sx, sy, controls, pu, pv), weights(weights) {
+    if (weights.size() != this->controls.size()) clear();
+  }
+  NURBSSurface(uint sx, uint sy, const std::vector<Vector>& controls, const std::vector<double>& weights, const KnotVector& ku, const KnotVector& kv)
+    : BSplineSurface(sx, sy, controls, ku, kv), weights(weights) {
+    if (weights.size() != this->controls.size()) clear();
+  }
+
+protected:
+  double weight(uint x, uint y) const override { return weights[y * size_x + x]; }
+};
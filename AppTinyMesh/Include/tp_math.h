@@ -9,14 +9,19 @@
 #include <functional>
 #include <vector>
 #include <array>
+#include <cstdint>
+#include <queue>
+#include <unordered_map>
+#include <unordered_set>
 #include <mathematics.h>
 #include <math.h>
 
 using uchar = unsigned char;
 using uint = unsigned int;
 
+// Caches are per thread, so that surfaces can be tessellated by concurrent jobs
 class Factorial{
-  static std::vector<size_t> cache;
+  static thread_local std::vector<size_t> cache;
 public:
   inline static size_t compute(uint k){
     if (k == 0) return 1;
@@ -28,7 +33,7 @@ public:
 };
 
 class Binomial{
-  static std::vector<size_t> cache;
+  static thread_local std::vector<size_t> cache;
 
   static void compute_line(uint sum, uint n){
     uint sum_n1 = ((n-1) * (n-1) + (n-1))/2;
@@ -52,13 +57,24 @@ public:
 
 // todo : faire binomial sans factoriel
 
-inline std::vector<size_t> Binomial::cache = {};
-inline std::vector<size_t> Factorial::cache = {};
+inline thread_local std::vector<size_t> Binomial::cache = {};
+inline thread_local std::vector<size_t> Factorial::cache = {};
 
 inline double bernstein(uint n, uint k, double u){
   return Binomial::compute(n,k) * std::pow(u, k) * std::pow(1 - u, n - k);
 }
 
+//! Position and derivatives of a curve at a given parameter.
+struct CurvePoint {
+  Vector p = Vector(0.0);             //!< Position.
+  Vector d[3] = { Vector(0.0), Vector(0.0), Vector(0.0) }; //!< First, second and third derivatives.
+};
+
+//! Moving frame of a curve: position, tangent, normal and binormal.
+struct CurveFrame {
+  Vector p, t, n, b;
+};
+
 class Curve {
   static constexpr double epsilon = 0.001;
 public:
@@ -66,6 +82,40 @@ public:
 
   // Default methods for any curve
 
+  /*!
+  \brief Position and derivatives up to the given order (at most 3) in one pass.
+
+  The default implementation uses central differences sharing their samples: at most
+  5 evaluations of the position, instead of nesting delta_1 calls.
+  */
+  virtual CurvePoint evaluate(double t, int order = 2){
+    const double e = epsilon;
+    CurvePoint cp;
+    cp.p = position(t);
+    if (order < 1) return cp;
+    Vector p0 = position(t-e);
+    Vector p1 = position(t+e);
+    cp.d[0] = (p1-p0)/(2*e);
+    if (order < 2) return cp;
+    cp.d[1] = (p1 - 2*cp.p + p0)/(e*e);
+    if (order < 3) return cp;
+    cp.d[2] = (position(t+2*e) - 2*p1 + 2*p0 - position(t-2*e))/(2*e*e*e);
+    return cp;
+  }
+
+  /*!
+  \brief Moving frame, computed from a single evaluation.
+  */
+  virtual CurveFrame frame(double t){
+    CurvePoint cp = evaluate(t, 2);
+    CurveFrame f;
+    f.p = cp.p;
+    f.t = Normalized(cp.d[0]);
+    f.n = Normalized(cp.d[1]);
+    f.b = Normalized(f.t / f.n);
+    return f;
+  }
+
   virtual Vector delta_1(double t, double e0 = Curve::epsilon, double e1 = Curve::epsilon){
     Vector p0 = position(t-e0);
     Vector p1 = position(t+e1);
@@ -92,15 +142,15 @@ public:
   };
 
   virtual Vector tangente(double t){
-    return Normalized(delta_1(t));
+    return Normalized(evaluate(t, 1).d[0]);
   }
 
   virtual Vector normal(double t){
-    return Normalized(delta_2(t));
+    return Normalized(evaluate(t, 2).d[1]);
   }
 
   virtual Vector binormal(double t){
-    return Normalized(tangente(t) / normal(t));
+    return frame(t).b;
   }
 };
 
@@ -108,9 +158,44 @@ class BezierCurve : public Curve{
   std::vector<Vector> controls;
 public:
   BezierCurve(const std::vector<Vector>& controls) : controls(controls) {}
-  BezierCurve(std::vector<Vector>&& controls) : controls(controls) {}
+  BezierCurve(std::vector<Vector>&& controls) : controls(std::move(controls)) {}
   BezierCurve(){}
 
+  /*!
+  \brief Position and derivatives with a single de Casteljau pass.
+
+  The derivatives are the hodographs evaluated from the intermediate points of the last levels of the
+  de Casteljau triangle, e.g. C'(t) = n (b1 - b0) at level n-1.
+  */
+  CurvePoint evaluate(double t, int order = 2) override {
+    assert(controls.size() > 0);
+    const int n = int(controls.size()) - 1;
+    std::vector<Vector> b = controls;
+    CurvePoint cp;
+    for (int level = n; level > 0; level--){
+      // b holds the level+1 points of the current level, which define the derivative of order level
+      if (level <= order){
+        if (level == 1) cp.d[0] = n * (b[1] - b[0]);
+        else if (level == 2) cp.d[1] = n * (n-1) * (b[2] - 2*b[1] + b[0]);
+        else if (level == 3) cp.d[2] = n * (n-1) * (n-2) * (b[3] - 3*b[2] + 3*b[1] - b[0]);
+      }
+      for (int i = 0; i < level; i++)
+        b[i] = (1-t) * b[i] + t * b[i+1];
+    }
+    cp.p = b[0];
+    return cp;
+  }
+
+  CurveFrame frame(double t) override {
+    CurvePoint cp = evaluate(t, 1);
+    CurveFrame f;
+    f.p = cp.p;
+    f.t = Normalized(cp.d[0]);
+    f.n = Normalized(f.t/Vector(0,1,0));
+    f.b = Normalized(f.t / f.n);
+    return f;
+  }
+
   Vector position(double t) override{
     Vector sum(0,0,0);
     assert(controls.size() > 0);
@@ -152,7 +237,7 @@ class BezierSurface {
   uint size_x, size_y;
 public:
   BezierSurface(uint sx, uint sy, const std::vector<Vector>& controls) : controls(controls), size_x(sx), size_y(sy) {}
-  BezierSurface(uint sx, uint sy, std::vector<Vector>&& controls) : controls(controls), size_x(sx), size_y(sy){}
+  BezierSurface(uint sx, uint sy, std::vector<Vector>&& controls) : controls(std::move(controls)), size_x(sx), size_y(sy){}
   BezierSurface(){}
 
   const Vector& control(uint x, uint y) const {
@@ -205,14 +290,27 @@ struct ExtrusionSurface {
   ExtrusionSurface(){};
   ExtrusionSurface(Curve* curve, const RadialFunction& rad): curve(curve), radial(rad) {};
 
-  Vector position(double u, double v) const {
+  //! Frame of the curve at u, shared by all the points of a section.
+  CurveFrame frame(double u) const {
+    return curve->frame(u);
+  }
+
+  Vector position(const CurveFrame& f, double v) const {
     double tpiv = 2 * M_PI * v;
-    return curve->position(u) + radial(tpiv) * (cos(tpiv) * curve->normal(u) + sin(tpiv) * curve->binormal(u));
+    return f.p + radial(tpiv) * (cos(tpiv) * f.n + sin(tpiv) * f.b);
   }
 
-  Vector normal(double u, double v) const {
+  Vector normal(const CurveFrame& f, double v) const {
     double tpiv = 2 * M_PI * v;
-    return Normalized(cos(tpiv) * curve->normal(u) + sin(tpiv) * curve->binormal(u));
+    return Normalized(cos(tpiv) * f.n + sin(tpiv) * f.b);
+  }
+
+  Vector position(double u, double v) const {
+    return position(frame(u), v);
+  }
+
+  Vector normal(double u, double v) const {
+    return normal(frame(u), v);
   }
 
 private:
@@ -220,7 +318,13 @@ private:
   RadialFunction radial;
 };
 
-inline MeshColor mesh_bezier_surface(const BezierSurface& bezier, uint dim_x, uint dim_y){
+/*!
+\brief Uniform tessellation of a parametric surface providing position(u,v) and normal(u,v).
+\param surf Surface.
+\param dim_x, dim_y Number of samples along u and v.
+*/
+template <typename Surface>
+inline MeshColor mesh_surface(const Surface& surf, uint dim_x, uint dim_y){
   std::vector<Vector> vertices;
   std::vector<Vector> normals;
   std::vector<size_t> indices;
@@ -235,9 +339,9 @@ inline MeshColor mesh_bezier_surface(const BezierSurface& bezier, uint dim_x, ui
       double u = double(x)/(dim_x-1);
       double v = double(y)/(dim_y-1);
       // Vertices
-      vertices.push_back(bezier.position(u,v));
+      vertices.push_back(surf.position(u,v));
       // Normals
-      normals.push_back(bezier.normal(u,v));
+      normals.push_back(surf.normal(u,v));
       // Triangles
       if (x < dim_x - 1 && y < dim_y - 1){
         indices.push_back(id(x,y));
@@ -252,14 +356,19 @@ inline MeshColor mesh_bezier_surface(const BezierSurface& bezier, uint dim_x, ui
   }
 
   normal_indices = indices;
+  std::vector<size_t> color_indices = indices;
+  std::vector<Color> cols(vertices.size(), Color(0.8, 0.8, 0.8));
 
-  Mesh mesh = Mesh(vertices, normals, indices, normal_indices);
-  std::vector<Color> cols;
-  cols.resize(mesh.Vertexes());
-  for (size_t i = 0; i < cols.size(); i++)
-    cols[i] = Color(0.8, 0.8, 0.8);
+  Mesh mesh(std::move(vertices), std::move(normals), std::move(indices), std::move(normal_indices));
+  return MeshColor(std::move(mesh), std::move(cols), std::move(color_indices));
+}
 
-  return MeshColor(mesh, cols, mesh.VertexIndexes());
+/*!
+\brief Uniform tessellation of a Bezier surface.
+\sa mesh_surface
+*/
+inline MeshColor mesh_bezier_surface(const BezierSurface& bezier, uint dim_x, uint dim_y){
+  return mesh_surface(bezier, dim_x, dim_y);
 }
 
 
@@ -275,13 +384,14 @@ inline MeshColor mesh_extrusion_surface(const ExtrusionSurface& surf, uint div_c
   };
 
   for (uint c = 0; c < div_curve; c++){
+    double u = double(c)/(div_curve-1);
+    CurveFrame frame = surf.frame(u);
     for (uint r = 0; r < div_radius; r++){
-      double u = double(c)/(div_curve-1);
       double v = double(r)/(div_radius-1);
       // Vertices
-      vertices.push_back(surf.position(u,v));
+      vertices.push_back(surf.position(frame,v));
       // Normals
-      normals.push_back(surf.normal(u,v));
+      normals.push_back(surf.normal(frame,v));
       // Triangles
       if (c < div_curve - 1){
         indices.push_back(id(c,r));
@@ -296,12 +406,225 @@ inline MeshColor mesh_extrusion_surface(const ExtrusionSurface& surf, uint div_c
   }
 
   normal_indices = indices;
+  std::vector<size_t> color_indices = indices;
+  std::vector<Color> cols(vertices.size(), Color(0.8, 0.8, 0.8));
+
+  Mesh mesh(std::move(vertices), std::move(normals), std::move(indices), std::move(normal_indices));
+  return MeshColor(std::move(mesh), std::move(cols), std::move(color_indices));
+}
+
+
+/*!
+\brief Adaptive tessellation of a parametric surface.
+
+The (u,v) domain is refined as a quadtree: a cell is split while the chordal deviation between the surface and
+the bilinear patch spanned by its corners (measured at the edge midpoints and at the center) exceeds the tolerance.
+Cells with the largest error are split first, so the triangle budget is spent where the surface bends.
+
+Cells are triangulated with the corners of their neighbours lying on their edges (fan around the cell center when
+such T-junction vertices exist), so the resulting mesh has no cracks.
 
-  Mesh mesh = Mesh(vertices, normals, indices, normal_indices);
-  std::vector<Color> cols;
-  cols.resize(mesh.Vertexes());
-  for (size_t i = 0; i < cols.size(); i++)
-    cols[i] = Color(0.8, 0.8, 0.8);
+Surface must provide position(u,v) and normal(u,v).
+
+\param surf Surface.
+\param tolerance Maximum chordal deviation.
+\param max_triangles Triangle budget, never exceeded except by the two triangles of the whole domain if it is lower than that.
+\param periodic_v Set for surfaces closed in v, so that v=0 and v=1 share their vertices.
+\param min_depth Depth of the initial uniform grid (2^min_depth cells per side), lowered so that the grid fits in the budget.
+\param max_depth Maximum quadtree depth.
+*/
+template <typename Surface>
+inline MeshColor mesh_adaptive_surface(const Surface& surf, double tolerance, uint max_triangles, bool periodic_v = false, uint min_depth = 3, uint max_depth = 12){
+  assert(min_depth <= max_depth && max_depth < 31);
+  const int res = 1 << max_depth;
+
+  const auto key = [&](int x, int y){
+    if (periodic_v) y = (y + res) % res;
+    return (uint64_t(x) << 32) | uint64_t(y);
+  };
+
+  // Surface samples, shared between error estimation and triangulation
+  std::unordered_map<uint64_t, Vector> samples;
+  const auto sample = [&](int x, int y) -> const Vector& {
+    auto it = samples.find(key(x, y));
+    if (it == samples.end())
+      it = samples.emplace(key(x, y), surf.position(double(x) / res, double(y) / res)).first;
+    return it->second;
+  };
+
+  struct Cell {
+    int x, y, s;
+    double error;
+    bool operator<(const Cell& c) const { return error < c.error; }
+  };
+
+  const auto make_cell = [&](int x, int y, int s){
+    const Vector& p00 = sample(x, y);
+    const Vector& p10 = sample(x + s, y);
+    const Vector& p11 = sample(x + s, y + s);
+    const Vector& p01 = sample(x, y + s);
+    int h = s / 2;
+    double e = 0;
+    if (h > 0){
+      e = std::max(e, SquaredNorm(sample(x + h, y) - 0.5 * (p00 + p10)));
+      e = std::max(e, SquaredNorm(sample(x + s, y + h) - 0.5 * (p10 + p11)));
+      e = std::max(e, SquaredNorm(sample(x + h, y + s) - 0.5 * (p01 + p11)));
+      e = std::max(e, SquaredNorm(sample(x, y + h) - 0.5 * (p00 + p01)));
+      e = std::max(e, SquaredNorm(sample(x + h, y + h) - 0.25 * (p00 + p10 + p11 + p01)));
+    }
+    return Cell{x, y, s, sqrt(e)};
+  };
+
+  // Corners of the leaf cells, and leaf cells (size, triangle count) indexed by their lower corner
+  std::unordered_set<uint64_t> corners;
+  std::unordered_map<uint64_t, std::pair<int, int>> leaves;
+
+  // Boundary of a cell: its corners and the corners of neighbouring cells lying on its edges
+  std::vector<std::pair<int, int>> ring;
+  const auto edge = [&](const auto& self, int x0, int y0, int x1, int y1) -> void {
+    if (std::abs(x1 - x0) + std::abs(y1 - y0) < 2) return;
+    int mx = (x0 + x1) / 2, my = (y0 + y1) / 2;
+    if (corners.count(key(mx, my)) == 0) return;
+    self(self, x0, y0, mx, my);
+    ring.emplace_back(mx, my);
+    self(self, mx, my, x1, y1);
+  };
+  const auto make_ring = [&](int x, int y, int s){
+    ring.clear();
+    ring.emplace_back(x, y); edge(edge, x, y, x + s, y);
+    ring.emplace_back(x + s, y); edge(edge, x + s, y, x + s, y + s);
+    ring.emplace_back(x + s, y + s); edge(edge, x + s, y + s, x, y + s);
+    ring.emplace_back(x, y + s); edge(edge, x, y + s, x, y);
+    return ring.size() == 4 ? 2 : int(ring.size());
+  };
+
+  int triangles = 0;
+  const auto add_leaf = [&](int x, int y, int s){
+    corners.insert(key(x, y));
+    corners.insert(key(x + s, y));
+    corners.insert(key(x + s, y + s));
+    corners.insert(key(x, y + s));
+    leaves[key(x, y)] = { s, 0 };
+  };
+  const auto update_leaf = [&](int x, int y){
+    auto& leaf = leaves[key(x, y)];
+    triangles -= leaf.second;
+    leaf.second = make_ring(x, y, leaf.first);
+    triangles += leaf.second;
+  };
+
+  // Update the leaf lying across an edge, containing the point (px,py) of the outer side
+  const auto update_neighbour = [&](int px, int py, int s){
+    if (px < 0 || px >= res) return;
+    if (periodic_v) py = (py + res) % res;
+    else if (py < 0 || py >= res) return;
+    for (; s <= res; s *= 2){
+      int nx = px - px % s, ny = py - py % s;
+      auto it = leaves.find(key(nx, ny));
+      if (it != leaves.end() && it->second.first == s){
+        update_leaf(nx, ny);
+        return;
+      }
+    }
+  };
+
+  // Initial uniform grid, with 2 triangles per cell
+  while (min_depth > 0 && (uint64_t(2) << (2 * min_depth)) > max_triangles)
+    min_depth--;
+  std::priority_queue<Cell> queue;
+  const int s0 = res >> min_depth;
+  for (int x = 0; x < res; x += s0)
+    for (int y = 0; y < res; y += s0){
+      queue.push(make_cell(x, y, s0));
+      add_leaf(x, y, s0);
+    }
+  for (const auto& leaf : leaves)
+    update_leaf(int(leaf.first >> 32), int(leaf.first & 0xffffffff));
+
+  // Split the worst cells first, a split never adds more than 24 triangles
+  while (!queue.empty()){
+    Cell c = queue.top();
+    if (c.error <= tolerance || triangles + 24 > int(max_triangles))
+      break;
+    queue.pop();
+    if (c.s < 2)
+      continue;
+
+    int h = c.s / 2;
+    triangles -= leaves[key(c.x, c.y)].second;
+    leaves.erase(key(c.x, c.y));
+    add_leaf(c.x, c.y, h);
+    add_leaf(c.x + h, c.y, h);
+    add_leaf(c.x, c.y + h, h);
+    add_leaf(c.x + h, c.y + h, h);
+    update_leaf(c.x, c.y);
+    update_leaf(c.x + h, c.y);
+    update_leaf(c.x, c.y + h);
+    update_leaf(c.x + h, c.y + h);
+    update_neighbour(c.x + h, c.y - 1, c.s);
+    update_neighbour(c.x + c.s, c.y + h, c.s);
+    update_neighbour(c.x + h, c.y + c.s, c.s);
+    update_neighbour(c.x - 1, c.y + h, c.s);
+
+    queue.push(make_cell(c.x, c.y, h));
+    queue.push(make_cell(c.x + h, c.y, h));
+    queue.push(make_cell(c.x, c.y + h, h));
+    queue.push(make_cell(c.x + h, c.y + h, h));
+  }
+
+  std::vector<Vector> vertices;
+  std::vector<Vector> normals;
+  std::vector<size_t> indices;
+  std::unordered_map<uint64_t, size_t> ids;
+  indices.reserve(3 * triangles);
+
+  const auto vertex = [&](int x, int y){
+    auto it = ids.find(key(x, y));
+    if (it != ids.end()) return it->second;
+    size_t id = vertices.size();
+    vertices.push_back(sample(x, y));
+    normals.push_back(surf.normal(double(x) / res, double(y) / res));
+    ids.emplace(key(x, y), id);
+    return id;
+  };
+
+  for (const auto& leaf : leaves){
+    int x = int(leaf.first >> 32), y = int(leaf.first & 0xffffffff), s = leaf.second.first;
+    if (make_ring(x, y, s) == 2){
+      size_t a = vertex(x, y), b = vertex(x + s, y), c = vertex(x + s, y + s), d = vertex(x, y + s);
+      indices.insert(indices.end(), { a, b, c, a, c, d });
+    }
+    else {
+      // T-junctions: fan around the cell center
+      size_t m = vertex(x + s / 2, y + s / 2);
+      for (size_t i = 0; i < ring.size(); i++){
+        const auto& p = ring[i];
+        const auto& q = ring[(i + 1) % ring.size()];
+        indices.insert(indices.end(), { m, vertex(p.first, p.second), vertex(q.first, q.second) });
+      }
+    }
+  }
+
+  std::vector<size_t> normal_indices = indices;
+  std::vector<size_t> color_indices = indices;
+  std::vector<Color> cols(vertices.size(), Color(0.8, 0.8, 0.8));
+
+  Mesh mesh(std::move(vertices), std::move(normals), std::move(indices), std::move(normal_indices));
+  return MeshColor(std::move(mesh), std::move(cols), std::move(color_indices));
+}
+
+/*!
+\brief Adaptive tessellation of a Bezier surface.
+\sa mesh_adaptive_surface
+*/
+inline MeshColor mesh_bezier_surface_adaptive(const BezierSurface& bezier, double tolerance, uint max_triangles){
+  return mesh_adaptive_surface(bezier, tolerance, max_triangles);
+}
 
-  return MeshColor(mesh, cols, mesh.VertexIndexes());
+/*!
+\brief Adaptive tessellation of an extrusion surface, closed around the curve.
+\sa mesh_adaptive_surface
+*/
+inline MeshColor mesh_extrusion_surface_adaptive(const ExtrusionSurface& surf, double tolerance, uint max_triangles){
+  return mesh_adaptive_surface(surf, tolerance, max_triangles, true);
 }
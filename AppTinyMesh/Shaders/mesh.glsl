@@ -1,25 +1,89 @@
 #version 150
 
+// Per frame data, shared by all the meshes (std140 layout, see MeshWidget::FrameUniforms)
+layout(std140) uniform Frame
+{
+	mat4 ModelViewMatrix;
+	mat4 ProjectionMatrix;
+	vec3 viewDir;
+	vec2 WIN_SCALE;
+};
+
 #ifdef VERTEX_SHADER
+#ifdef BATCHED
+// Attributes of the vertex arrays of the pool, see MeshPool::CreatePage()
+layout(location = 0) in vec3 vertex;
+layout(location = 1) in vec3 normal;
+layout(location = 2) in vec3 color;
+
+// Per object data of the batched draws (std430 layout, see MeshWidget::ObjectData)
+struct Object
+{
+	mat4 TRSMatrix;
+	vec4 positionOrigin;
+	vec4 positionScale;
+	ivec4 state;					// Material, shading, wireframe and compact vertex format flags
+};
+layout(std430, binding = 0) readonly buffer Objects
+{
+	Object objects[];
+};
+layout(location = 3) in uint drawIndex;	// Index of the object, read at the base instance of the draw
+
+flat out ivec3 geomState;
+
+#define TRSMatrix objects[drawIndex].TRSMatrix
+#define useInstances 0
+#define compactVertices objects[drawIndex].state.w
+#define positionOrigin objects[drawIndex].positionOrigin.xyz
+#define positionScale objects[drawIndex].positionScale.xyz
+#else
 in vec3 vertex;
 in vec3 normal;
 in vec3 color;
 
-uniform mat4 ModelViewMatrix;
-uniform mat4 ProjectionMatrix;
 uniform mat4 TRSMatrix;
+uniform int useInstances;
+uniform int compactVertices;		// Compact vertex format, see MeshWidget::UseCompactVertices()
+uniform vec3 positionOrigin;		// Quantization box of the positions of the compact format
+uniform vec3 positionScale;
+#endif
+uniform samplerBuffer instances;	// Offsets of the drawn instances, see MeshWidget::MeshGL::CullInstances()
 
 out vec3 geomNormal;
 out vec3 geomVertex;
 out vec3 geomColor;
 
+// Decode a normal encoded with the octahedral mapping, see CompactMesh::EncodeOctahedral()
+vec3 DecodeNormal(vec2 e)
+{
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	if (n.z < 0.0)
+		n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+	return n;
+}
+
 void main(void)
 {
+	vec3 p = vertex;
+	vec3 n = normal;
+	if (compactVertices == 1)
+	{
+		p = positionOrigin + positionScale * vertex;
+		n = DecodeNormal(normal.xy);
+	}
+	vec3 v = p;
+	if (useInstances == 1)
+		p += texelFetch(instances, gl_InstanceID).xyz;
+
 	mat4 MVP      = ProjectionMatrix * ModelViewMatrix;
-	gl_Position   = MVP * TRSMatrix * (vec4(vertex, 1.0)); 
-	geomNormal	  = (TRSMatrix * vec4(normalize(normal), 0.0f)).xyz;
-	geomVertex 	  = vertex;
+	gl_Position   = MVP * TRSMatrix * (vec4(p, 1.0)); 
+	geomNormal	  = (TRSMatrix * vec4(normalize(n), 0.0f)).xyz;
+	geomVertex 	  = v;
 	geomColor	  = color;
+#ifdef BATCHED
+	geomState	  = objects[drawIndex].state.xyz;
+#endif
 } 
 #endif
 
@@ -27,7 +91,6 @@ void main(void)
 layout(triangles) in;
 layout(triangle_strip, max_vertices = 3) out;
 
-uniform vec2 WIN_SCALE;
 
 in vec3 geomVertex[];
 in vec3 geomNormal[];
@@ -39,6 +102,14 @@ out vec3 fragColor;
 out vec3 dist;
 out float ratio;
 
+#ifdef BATCHED
+flat in ivec3 geomState[];
+flat out ivec3 fragState;
+#define EmitState(i) fragState = geomState[i]
+#else
+#define EmitState(i)
+#endif
+
 void main()
 {	
 	vec2 p0 = WIN_SCALE * gl_in[0].gl_Position.xy / gl_in[0].gl_Position.w;
@@ -61,17 +132,17 @@ void main()
 
 	dist = vec3(area / length(v0), 0, 0);
 	gl_Position = gl_in[0].gl_Position;
-	fragVertex = geomVertex[0]; fragNormal = geomNormal[0]; fragColor = geomColor[0];
+	fragVertex = geomVertex[0]; fragNormal = geomNormal[0]; fragColor = geomColor[0]; EmitState(0);
 	EmitVertex();
 
 	dist = vec3(0, area / length(v1), 0);
 	gl_Position = gl_in[1].gl_Position;
-	fragVertex = geomVertex[1]; fragNormal = geomNormal[1]; fragColor = geomColor[1];
+	fragVertex = geomVertex[1]; fragNormal = geomNormal[1]; fragColor = geomColor[1]; EmitState(1);
 	EmitVertex();
 
 	dist = vec3(0, 0, area / length(v2));
 	gl_Position = gl_in[2].gl_Position;
-	fragVertex = geomVertex[2]; fragNormal = geomNormal[2]; fragColor = geomColor[2];
+	fragVertex = geomVertex[2]; fragNormal = geomNormal[2]; fragColor = geomColor[2]; EmitState(2);
 	EmitVertex();
 
 	EndPrimitive();
@@ -86,10 +157,17 @@ in vec3 fragColor;
 in vec3 dist;
 in float ratio;
 
+#ifdef BATCHED
+flat in ivec3 fragState;
+
+#define material fragState.x
+#define shading fragState.y
+#define useWireframe fragState.z
+#else
 uniform int material;
 uniform int shading;
 uniform int useWireframe;
-uniform vec3 viewDir;
+#endif
 
 out vec4 fragment;
 
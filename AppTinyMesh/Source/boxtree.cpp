@@ -0,0 +1,141 @@
+#include "boxtree.h"
+
+#include <algorithm>
+
+/*!
+\class BoxTree boxtree.h
+
+\brief Bounding volume hierarchy over a set of boxes.
+
+The tree is built by splitting the boxes at the median of their centers along the longest axis.
+Culling traverses the tree and keeps track of the planes of the frustum that still intersect
+the current node, so that nodes inside the frustum are accepted without testing their children.
+*/
+
+/*!
+\brief Build the hierarchy.
+\param boxes The boxes.
+*/
+BoxTree::BoxTree(const std::vector<Box>& boxes)
+{
+  const int n = int(boxes.size());
+  if (n == 0)
+    return;
+
+  std::vector<Vector> centers(n);
+  items.resize(n);
+  for (int i = 0; i < n; i++)
+  {
+    centers[i] = boxes[i].Center();
+    items[i] = i;
+  }
+  nodes.reserve(2 * (n / LeafSize + 1));
+  nodes.push_back(Node());
+  Build(0, boxes, centers, 0, n);
+
+  BoxTree::boxes.resize(n);
+  for (int i = 0; i < n; i++)
+    BoxTree::boxes[i] = boxes[items[i]];
+}
+
+/*!
+\brief Recursively build a node.
+\param node Node.
+\param boxes, centers The boxes and their centers.
+\param first, count Range of items.
+*/
+void BoxTree::Build(int node, const std::vector<Box>& boxes, const std::vector<Vector>& centers, int first, int count)
+{
+  Box box = boxes[items[first]];
+  Vector a = centers[items[first]], b = a;
+  for (int i = first + 1; i < first + count; i++)
+  {
+    box = Box(box, boxes[items[i]]);
+    a = Vector::Min(a, centers[items[i]]);
+    b = Vector::Max(b, centers[items[i]]);
+  }
+  nodes[node].box = box;
+
+  if (count <= LeafSize)
+  {
+    nodes[node].first = first;
+    nodes[node].count = count;
+    return;
+  }
+
+  // Median split along the longest axis of the centers
+  Vector d = b - a;
+  int axis = (d[0] > d[1]) ? ((d[0] > d[2]) ? 0 : 2) : ((d[1] > d[2]) ? 1 : 2);
+  int half = count / 2;
+  std::nth_element(items.begin() + first, items.begin() + first + half, items.begin() + first + count,
+    [&centers, axis](int i, int j) { return centers[i][axis] < centers[j][axis]; });
+
+  // Children are stored next to each other
+  const int left = int(nodes.size());
+  nodes[node].left = left;
+  nodes.resize(left + 2);
+  Build(left, boxes, centers, first, half);
+  Build(left + 1, boxes, centers, first + half, count - half);
+}
+
+/*!
+\brief Compute the indexes of the boxes that intersect a frustum.
+\param frustum The frustum.
+\param visible Indexes of the visible boxes, appended in no particular order.
+*/
+void BoxTree::Cull(const Frustum& frustum, std::vector<int>& visible) const
+{
+  if (nodes.empty())
+    return;
+  Cull(0, frustum, Frustum::AllPlanes, visible);
+}
+
+/*!
+\brief Recursively cull a node.
+\param node Node.
+\param frustum The frustum.
+\param mask Planes of the frustum intersecting the parent node.
+\param visible Indexes of the visible boxes.
+*/
+void BoxTree::Cull(int node, const Frustum& frustum, int mask, std::vector<int>& visible) const
+{
+  const Node& n = nodes[node];
+  int c = frustum.Classify(n.box, mask);
+  if (c < 0)
+    return;
+  if (c > 0)
+  {
+    Collect(node, visible);
+    return;
+  }
+  if (n.count > 0)
+  {
+    for (int i = n.first; i < n.first + n.count; i++)
+    {
+      int m = mask;
+      if (frustum.Classify(boxes[i], m) >= 0)
+        visible.push_back(items[i]);
+    }
+    return;
+  }
+  Cull(n.left, frustum, mask, visible);
+  Cull(n.left + 1, frustum, mask, visible);
+}
+
+/*!
+\brief Append all the items of a node.
+\param node Node.
+\param visible Indexes of the visible boxes.
+*/
+void BoxTree::Collect(int node, std::vector<int>& visible) const
+{
+  const Node& n = nodes[node];
+  if (n.count > 0)
+  {
+    for (int i = n.first; i < n.first + n.count; i++)
+      visible.push_back(items[i]);
+    return;
+  }
+  Collect(n.left, visible);
+  Collect(n.left + 1, visible);
+}
@@ -0,0 +1,356 @@
+#include "brickpolygonizer.h"
+#include "fieldcache.h"
+
+#include <algorithm>
+
+/*!
+\class BrickPolygonizer brickpolygonizer.h
+
+\brief Polygonizer splitting the domain into bricks of cells, re-polygonizing only the bricks touched by an edit.
+
+The grid of samples is the same as the one of AnalyticScalarField::Polygonize(): the domain is
+sampled at n points along every axis. Cells are grouped into bricks, and every brick keeps its mesh
+and, if it crosses the surface, its samples. Neighboring bricks share their boundary samples, so that
+their vertices match exactly and meshes join without cracks.
+
+When the field is edited, the region where the edit may change the surface, given by
+Implicit::Influence(), is invalidated: the bricks intersecting the region are polygonized again by
+Update(), computing only the samples inside the region if their samples are cached.
+
+If the field has a cache of samples holding its grid, see AnalyticScalarField::SetCache(), the
+samples of the bricks polygonized from scratch are read from the cache.
+\code
+ImplicitTree::Tree tree(&root);
+BrickPolygonizer polygonizer(&tree, 500, Box(30.0));
+std::vector<int> updated;
+polygonizer.Update(updated); // Polygonize everything
+
+Box region;
+tree.Influence(&capsule, 0.0, region); // Region before the edit
+polygonizer.Invalidate(region);
+capsule.SetPosition(Vector(1.0, 2.0, 3.0));
+tree.Influence(&capsule, 0.0, region); // Region after the edit
+polygonizer.Invalidate(region);
+polygonizer.Update(updated); // Only the updated bricks need to be uploaded again
+\endcode
+*/
+
+/*!
+\brief Create the polygonizer, all the bricks need to be polygonized.
+\param field The field.
+\param n Discretization parameter, number of samples along every axis.
+\param box Domain.
+\param size Number of cells along the side of a brick.
+\param epsilon Epsilon value for computing vertices on straddling edges.
+*/
+BrickPolygonizer::BrickPolygonizer(const AnalyticScalarField* field, int n, const Box& box, int size, double epsilon) : field(field), box(box), n(std::max(n, 2)), size(std::max(size, 1)), epsilon(epsilon)
+{
+  d = box.Diagonal() / (BrickPolygonizer::n - 1);
+
+  const int cells = BrickPolygonizer::n - 1;
+  nx = ny = nz = (cells + BrickPolygonizer::size - 1) / BrickPolygonizer::size;
+  bricks.resize(nx * ny * nz);
+}
+
+/*!
+\brief Compute the range of cells of a brick.
+\param i Brick.
+\param first First cell along every axis.
+\param count Number of cells along every axis.
+*/
+void BrickPolygonizer::Cells(int i, int first[3], int count[3]) const
+{
+  const int b[3] = { i % nx, (i / nx) % ny, i / (nx * ny) };
+  for (int k = 0; k < 3; k++)
+  {
+    first[k] = b[k] * size;
+    count[k] = std::min(size, n - 1 - first[k]);
+  }
+}
+
+/*!
+\brief Compute the box of a brick.
+\param i Brick.
+*/
+Box BrickPolygonizer::GetBox(int i) const
+{
+  int first[3], count[3];
+  Cells(i, first, count);
+  Vector a = box[0] + Vector(first[0] * d[0], first[1] * d[1], first[2] * d[2]);
+  Vector b = box[0] + Vector((first[0] + count[0]) * d[0], (first[1] + count[1]) * d[1], (first[2] + count[2]) * d[2]);
+  return Box(a, b);
+}
+
+/*!
+\brief Invalidate the bricks intersecting a region where the field has changed.
+
+The region is enlarged by a cell so that the cells straddling its boundary are updated.
+\param region The region.
+*/
+void BrickPolygonizer::Invalidate(const Box& region)
+{
+  const Box r(region[0] - d, region[1] + d);
+  for (int i = 0; i < int(bricks.size()); i++)
+  {
+    const Box b = GetBox(i);
+    if (!b.Intersect(r))
+      continue;
+
+    // Part of the region inside the brick
+    Box inside(Vector::Max(r[0], b[0]), Vector::Min(r[1], b[1]));
+    Brick& brick = bricks[i];
+    brick.region = brick.dirty ? Box(brick.region, inside) : inside;
+    brick.dirty = true;
+  }
+}
+
+/*!
+\brief Invalidate all the bricks, for instance when the whole field has changed.
+*/
+void BrickPolygonizer::Invalidate()
+{
+  for (Brick& brick : bricks)
+  {
+    brick.dirty = true;
+    brick.full = true;
+  }
+}
+
+/*!
+\brief Polygonize the invalidated bricks.
+
+Bricks are processed in parallel. The progress callback is called after every brick with the
+fraction of the bricks processed so far; the update stops as soon as it returns false, and the
+bricks that have not been processed remain invalidated.
+\param updated Returned indexes of the bricks that have been polygonized, in increasing order.
+\param progress Progress callback, may be empty.
+\return False if the update was cancelled.
+*/
+bool BrickPolygonizer::Update(std::vector<int>& updated, const std::function<bool(double)>& progress)
+{
+  updated.clear();
+
+  std::vector<int> dirty;
+  for (int i = 0; i < int(bricks.size()); i++)
+  {
+    if (bricks[i].dirty)
+      dirty.push_back(i);
+  }
+
+  // Samples cached by a previous polygonization of the same field
+  grid = nullptr;
+  if (field->cache != nullptr && !dirty.empty())
+  {
+    const uint64_t hash = field->Hash();
+    if (hash != 0)
+      grid = field->cache->Find(hash, box, n);
+  }
+
+  bool cancelled = false;
+#pragma omp parallel for schedule(dynamic)
+  for (int k = 0; k < int(dirty.size()); k++)
+  {
+    bool stop;
+#pragma omp atomic read
+    stop = cancelled;
+    if (stop)
+      continue;
+
+    Polygonize(dirty[k]);
+
+#pragma omp critical
+    {
+      updated.push_back(dirty[k]);
+      if (progress && !progress(double(updated.size()) / dirty.size()))
+      {
+#pragma omp atomic write
+        cancelled = true;
+      }
+    }
+  }
+
+  grid = nullptr;
+  std::sort(updated.begin(), updated.end());
+  return !cancelled;
+}
+
+/*!
+\brief Polygonize a brick.
+
+Samples are computed again inside the invalidated region only, unless the brick has no samples.
+Bricks that do not cross the surface release their samples.
+\param i Brick.
+*/
+void BrickPolygonizer::Polygonize(int i)
+{
+  FieldProfiler::Scope scope(FieldProfiler::Sampling);
+
+  Brick& brick = bricks[i];
+
+  int first[3], count[3];
+  Cells(i, first, count);
+  const int sx = count[0] + 1;
+  const int sy = count[1] + 1;
+  const int sz = count[2] + 1;
+
+  const auto Point = [&](int x, int y, int z)
+  {
+    return box[0] + Vector((first[0] + x) * d[0], (first[1] + y) * d[1], (first[2] + z) * d[2]);
+  };
+
+  // Range of samples to compute
+  int lo[3] = { 0, 0, 0 };
+  int hi[3] = { sx - 1, sy - 1, sz - 1 };
+  if (brick.full || int(brick.samples.size()) != sx * sy * sz)
+  {
+    brick.samples.resize(sx * sy * sz);
+  }
+  else
+  {
+    for (int k = 0; k < 3; k++)
+    {
+      lo[k] = std::max(lo[k], int(ceil((brick.region[0][k] - box[0][k]) / d[k])) - first[k]);
+      hi[k] = std::min(hi[k], int(floor((brick.region[1][k] - box[0][k]) / d[k])) - first[k]);
+    }
+  }
+
+  float* s = brick.samples.data();
+  for (int z = lo[2]; z <= hi[2]; z++)
+  {
+    for (int y = lo[1]; y <= hi[1]; y++)
+    {
+      for (int x = lo[0]; x <= hi[0]; x++)
+      {
+        s[(z * sy + y) * sx + x] = (grid != nullptr) ? (*grid)(first[0] + x, first[1] + y, first[2] + z) : FieldGrid::Round(field->Value(Point(x, y, z)));
+      }
+    }
+  }
+
+  brick.dirty = false;
+  brick.full = false;
+
+  // Bricks that do not cross the surface
+  int negative = 0;
+  for (float v : brick.samples)
+  {
+    if (v < 0.0f)
+      negative++;
+  }
+  if (negative == 0 || negative == int(brick.samples.size()))
+  {
+    brick.mesh = Mesh();
+    std::vector<float>().swap(brick.samples);
+    brick.full = true;
+    return;
+  }
+
+  std::vector<Vector> vertex;
+  std::vector<Vector> normal;
+  std::vector<size_t> triangle;
+
+  // Vertex indexes of the straddling edges, along x, y and z
+  std::vector<int> edges[3] = {
+    std::vector<int>(count[0] * sy * sz, -1),
+    std::vector<int>(sx * count[1] * sz, -1),
+    std::vector<int>(sx * sy * count[2], -1),
+  };
+
+  // Axis and origin of the twelve edges of a cell, in the order of the triangle table
+  static const int table[12][4] = {
+    { 0, 0, 0, 0 }, { 0, 0, 1, 0 }, { 0, 0, 0, 1 }, { 0, 0, 1, 1 },
+    { 1, 0, 0, 0 }, { 1, 1, 0, 0 }, { 1, 0, 0, 1 }, { 1, 1, 0, 1 },
+    { 2, 0, 0, 0 }, { 2, 1, 0, 0 }, { 2, 0, 1, 0 }, { 2, 1, 1, 0 },
+  };
+
+  const auto Edge = [&](int e, int x, int y, int z)
+  {
+    const int axis = table[e][0];
+    x += table[e][1];
+    y += table[e][2];
+    z += table[e][3];
+
+    int& v = (axis == 0) ? edges[0][(z * sy + y) * count[0] + x] : (axis == 1) ? edges[1][(z * count[1] + y) * sx + x] : edges[2][(z * sy + y) * sx + x];
+    if (v == -1)
+    {
+      const int x1 = x + (axis == 0), y1 = y + (axis == 1), z1 = z + (axis == 2);
+      vertex.push_back(field->Dichotomy(Point(x, y, z), Point(x1, y1, z1), s[(z * sy + y) * sx + x], s[(z1 * sy + y1) * sx + x1], d[axis], epsilon));
+      normal.push_back(field->Normal(vertex.back()));
+      v = int(vertex.size()) - 1;
+    }
+    return v;
+  };
+
+  for (int z = 0; z < count[2]; z++)
+  {
+    for (int y = 0; y < count[1]; y++)
+    {
+      for (int x = 0; x < count[0]; x++)
+      {
+        const float* a = &s[(z * sy + y) * sx + x];
+        const float* b = a + sx * sy;
+
+        int cubeindex = 0;
+        if (a[0] < 0.0f)      cubeindex |= 1;
+        if (a[1] < 0.0f)      cubeindex |= 2;
+        if (a[sx] < 0.0f)     cubeindex |= 4;
+        if (a[sx + 1] < 0.0f) cubeindex |= 8;
+        if (b[0] < 0.0f)      cubeindex |= 16;
+        if (b[1] < 0.0f)      cubeindex |= 32;
+        if (b[sx] < 0.0f)     cubeindex |= 64;
+        if (b[sx + 1] < 0.0f) cubeindex |= 128;
+
+        // Cube is straddling the surface
+        if ((cubeindex != 255) && (cubeindex != 0))
+        {
+          for (int h = 0; AnalyticScalarField::TriangleTable[cubeindex][h] != -1; h += 3)
+          {
+            triangle.push_back(Edge(AnalyticScalarField::TriangleTable[cubeindex][h + 0], x, y, z));
+            triangle.push_back(Edge(AnalyticScalarField::TriangleTable[cubeindex][h + 1], x, y, z));
+            triangle.push_back(Edge(AnalyticScalarField::TriangleTable[cubeindex][h + 2], x, y, z));
+          }
+        }
+      }
+    }
+  }
+
+  std::vector<size_t> normals = triangle;
+  brick.mesh = Mesh(std::move(vertex), std::move(normal), std::move(triangle), std::move(normals));
+}
+
+/*!
+\brief Merge the meshes of all the bricks.
+
+Vertices on the boundaries between bricks are duplicated.
+*/
+Mesh BrickPolygonizer::GetMesh() const
+{
+  std::vector<Vector> vertex;
+  std::vector<Vector> normal;
+  std::vector<size_t> triangle;
+
+  for (const Brick& brick : bricks)
+  {
+    const size_t offset = vertex.size();
+    vertex.insert(vertex.end(), brick.mesh.Vertices().begin(), brick.mesh.Vertices().end());
+    normal.insert(normal.end(), brick.mesh.Normals().begin(), brick.mesh.Normals().end());
+    for (size_t v : brick.mesh.VertexIndexArray())
+      triangle.push_back(offset + v);
+  }
+
+  std::vector<size_t> normals = triangle;
+  return Mesh(std::move(vertex), std::move(normal), std::move(triangle), std::move(normals));
+}
+
+/*!
+\brief Memory used by the cached samples and meshes, in bytes.
+*/
+size_t BrickPolygonizer::Memory() const
+{
+  size_t memory = 0;
+  for (const Brick& brick : bricks)
+  {
+    memory += sizeof(float) * brick.samples.size();
+    memory += 2 * sizeof(Vector) * brick.mesh.Vertexes() + 6 * sizeof(size_t) * brick.mesh.Triangles();
+  }
+  return memory;
+}
@@ -315,3 +315,132 @@ void Camera::SetPlanes(double n, double f)
   nearplane = n;
   farplane = f;
 }
+
+/*!
+\brief Compute the viewing frustum of a perspective camera.
+\param w,h Size of the viewing window.
+*/
+Frustum Camera::GetFrustum(int w, int h) const
+{
+  Vector view = Normalized(At() - Eye());
+  Vector horizontal = Normalized(view / Up());
+  Vector vertical = Normalized(horizontal / view);
+
+  double vLength = tan(GetAngleOfViewV(w, h) / 2.0);
+  double hLength = vLength * (double(w) / double(h));
+
+  // Side planes contain the eye, their normals are oriented towards the view direction
+  Vector n[6];
+  n[0] = Normalized((view - hLength * horizontal) / vertical);
+  n[1] = Normalized(vertical / (view + hLength * horizontal));
+  n[2] = Normalized(horizontal / (view - vLength * vertical));
+  n[3] = Normalized((view + vLength * vertical) / horizontal);
+  n[4] = view;
+  n[5] = -view;
+
+  double c[6];
+  for (int i = 0; i < 4; i++)
+  {
+    c[i] = -(n[i] * Eye());
+  }
+  c[4] = -(view * Eye() + nearplane);
+  c[5] = view * Eye() + farplane;
+
+  return Frustum(n, c);
+}
+
+/*!
+\class Frustum camera.h
+\brief Viewing frustum, used for culling.
+*/
+
+/*!
+\brief Create a frustum from its planes.
+\param normals Inward normals of the six planes.
+\param offsets Offsets of the six planes.
+*/
+Frustum::Frustum(const Vector* normals, const double* offsets)
+{
+  for (int i = 0; i < 6; i++)
+  {
+    n[i] = normals[i];
+    c[i] = offsets[i];
+  }
+}
+
+/*!
+\brief Extract the frustum from a clip matrix, i.e. the product of the projection and the modelview matrices.
+
+This is the method by Gribb and Hartmann: planes are sums and differences of the rows of the matrix.
+\param m Matrix, in column-major order as in OpenGL.
+*/
+Frustum::Frustum(const float* m)
+{
+  for (int i = 0; i < 6; i++)
+  {
+    // Row i / 2 of the matrix, added to or subtracted from the last row
+    const int r = i / 2;
+    const double s = (i % 2 == 0) ? 1.0 : -1.0;
+    Vector p(m[3] + s * m[r], m[7] + s * m[4 + r], m[11] + s * m[8 + r]);
+    double d = m[15] + s * m[12 + r];
+
+    double l = Norm(p);
+    n[i] = p / l;
+    c[i] = d / l;
+  }
+}
+
+/*!
+\brief Classify a box with respect to the frustum.
+\param box The box.
+\param mask Planes to be tested, updated to the planes that intersect the box.
+\return -1 if the box is outside, 1 if it is inside all the planes of the mask, and 0 otherwise.
+*/
+int Frustum::Classify(const Box& box, int& mask) const
+{
+  for (int i = 0; i < 6; i++)
+  {
+    const int bit = 1 << i;
+    if (!(mask & bit))
+      continue;
+
+    // Vertices of the box farthest along and against the normal
+    Vector p, q;
+    for (int k = 0; k < 3; k++)
+    {
+      p[k] = (n[i][k] >= 0.0) ? box[1][k] : box[0][k];
+      q[k] = (n[i][k] >= 0.0) ? box[0][k] : box[1][k];
+    }
+    if (n[i] * p + c[i] < 0.0)
+      return -1;
+    if (n[i] * q + c[i] >= 0.0)
+      mask &= ~bit;
+  }
+  return (mask == 0) ? 1 : 0;
+}
+
+/*!
+\brief Check if a box intersects or is inside the frustum.
+
+The test is conservative: some boxes near the edges of the frustum may be reported as intersecting.
+\param box The box.
+*/
+bool Frustum::Intersect(const Box& box) const
+{
+  int mask = AllPlanes;
+  return Classify(box, mask) >= 0;
+}
+
+/*!
+\brief Check if a point is inside the frustum.
+\param p Point.
+*/
+bool Frustum::Inside(const Vector& p) const
+{
+  for (int i = 0; i < 6; i++)
+  {
+    if (n[i] * p + c[i] < 0.0)
+      return false;
+  }
+  return true;
+}
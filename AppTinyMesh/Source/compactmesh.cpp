@@ -0,0 +1,785 @@
+#include "compactmesh.h"
+
+#include <algorithm>
+#include <array>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <unordered_map>
+
+/*!
+\class CompactMesh compactmesh.h
+
+\brief Compact single precision triangle mesh.
+
+A vertex of a Mesh is 24 bytes for its position and 24 bytes for its normal, and every triangle
+stores two arrays of three 8 bytes indexes. The compact mesh uses 12 bytes per position and normal
+and a single array of 4 bytes indexes, i.e. less than half of the memory.
+
+Meshes with the same vertex and normal indexes (and color indexes) are converted directly, otherwise
+every distinct vertex/normal pair becomes a vertex of the compact mesh.
+
+Triangles and vertices can be reordered before upload to reduce the cost of drawing: triangles are
+sorted for the post-transform vertex cache, clusters of triangles are sorted to reduce overdraw, and
+vertices are sorted in the order they are used. ACMR() measures the average number of vertex
+shader invocations per triangle.
+*/
+
+/*!
+\brief Create an empty mesh.
+*/
+CompactMesh::CompactMesh()
+{
+}
+
+/*!
+\brief Convert a mesh.
+\param mesh The mesh.
+*/
+CompactMesh::CompactMesh(const Mesh& mesh)
+{
+  Convert(mesh, nullptr, nullptr);
+}
+
+/*!
+\brief Convert a colored mesh.
+\param mesh The mesh.
+*/
+CompactMesh::CompactMesh(const MeshColor& mesh)
+{
+  Convert(mesh, &mesh.ColorIndexes(), &mesh.GetColors());
+}
+
+/*!
+\brief Empty.
+*/
+CompactMesh::~CompactMesh()
+{
+}
+
+/*!
+\brief Append a vertex.
+\param p, n Position and normal.
+*/
+void CompactMesh::AddVertex(const Vector& p, const Vector& n)
+{
+  positions.push_back(float(p[0]));
+  positions.push_back(float(p[1]));
+  positions.push_back(float(p[2]));
+  normals.push_back(float(n[0]));
+  normals.push_back(float(n[1]));
+  normals.push_back(float(n[2]));
+}
+
+/*!
+\brief Build the arrays from a mesh.
+\param mesh The mesh.
+\param carray, cols Color indexes and colors, may be nullptr.
+*/
+void CompactMesh::Convert(const Mesh& mesh, const std::vector<size_t>* carray, const std::vector<Color>* cols)
+{
+  positions.clear();
+  normals.clear();
+  colors.clear();
+  indices.clear();
+
+  const std::vector<size_t>& varray = mesh.VertexIndexes();
+  const std::vector<size_t>& narray = mesh.NormalIndexes();
+  const bool useColors = (carray != nullptr) && (carray->size() == varray.size());
+
+  // Shared indexes: direct conversion
+  bool shared = (narray == varray) && (!useColors || *carray == varray);
+  if (shared)
+  {
+    positions.reserve(3 * mesh.Vertexes());
+    normals.reserve(3 * mesh.Vertexes());
+    for (int i = 0; i < mesh.Vertexes(); i++)
+      AddVertex(mesh.Vertex(i), mesh.Normal(i));
+    if (useColors)
+    {
+      colors.reserve(3 * mesh.Vertexes());
+      for (int i = 0; i < mesh.Vertexes(); i++)
+      {
+        const Color& c = (*cols)[i];
+        colors.push_back(float(c[0]));
+        colors.push_back(float(c[1]));
+        colors.push_back(float(c[2]));
+      }
+    }
+    indices.assign(varray.begin(), varray.end());
+    return;
+  }
+
+  // Otherwise create a vertex for every distinct (vertex, normal, color) corner
+  struct CornerHash
+  {
+    size_t operator()(const std::array<size_t, 3>& c) const
+    {
+      return (c[0] * 73856093) ^ (c[1] * 19349663) ^ (c[2] * 83492791);
+    }
+  };
+  std::unordered_map<std::array<size_t, 3>, uint32_t, CornerHash> corners;
+  corners.reserve(varray.size());
+  indices.reserve(varray.size());
+  for (size_t i = 0; i < varray.size(); i++)
+  {
+    std::array<size_t, 3> corner = { varray[i], narray[i], useColors ? (*carray)[i] : 0 };
+    auto it = corners.find(corner);
+    if (it == corners.end())
+    {
+      it = corners.emplace(corner, uint32_t(Vertexes())).first;
+      AddVertex(mesh.Vertex(int(corner[0])), mesh.Normal(int(corner[1])));
+      if (useColors)
+      {
+        const Color& c = (*cols)[corner[2]];
+        colors.push_back(float(c[0]));
+        colors.push_back(float(c[1]));
+        colors.push_back(float(c[2]));
+      }
+    }
+    indices.push_back(it->second);
+  }
+}
+
+/*!
+\brief Memory used by the arrays, in bytes.
+*/
+size_t CompactMesh::Memory() const
+{
+  return sizeof(float) * (positions.size() + normals.size() + colors.size()) + sizeof(uint32_t) * indices.size();
+}
+
+/*!
+\brief Compute the bounding box of the mesh.
+*/
+Box CompactMesh::GetBox() const
+{
+  if (positions.empty())
+  {
+    return Box::Null;
+  }
+  Vector a = Vertex(0), b = a;
+  for (int i = 1; i < Vertexes(); i++)
+  {
+    a = Vector::Min(a, Vertex(i));
+    b = Vector::Max(b, Vertex(i));
+  }
+  return Box(a, b);
+}
+
+/*!
+\brief Quantize a range of positions on 16 bits per coordinate.
+
+Coordinates are mapped linearly from the box to [0, 65535], so that they decode as normalized
+unsigned shorts scaled by the size of the box, with an error below 1/131070 of the size of the box.
+\param box Quantization box, usually GetBox().
+\param first, count Range of vertices.
+\param out Quantized coordinates, 3 per vertex.
+*/
+void CompactMesh::PackPositions(const Box& box, int first, int count, uint16_t* out) const
+{
+  const Vector d = box.Diagonal();
+  for (int i = 0; i < count; i++)
+  {
+    for (int k = 0; k < 3; k++)
+    {
+      const double t = (d[k] > 0.0) ? (positions[3 * (first + i) + k] - box[0][k]) / d[k] : 0.0;
+      out[3 * i + k] = uint16_t(std::lround(std::clamp(t, 0.0, 1.0) * 65535.0));
+    }
+  }
+}
+
+/*!
+\brief Encode a range of normals with the octahedral mapping on two signed 16 bits values.
+\param first, count Range of vertices.
+\param out Encoded normals, 2 per vertex.
+\sa EncodeOctahedral()
+*/
+void CompactMesh::PackNormals(int first, int count, int16_t* out) const
+{
+  for (int i = 0; i < count; i++)
+    EncodeOctahedral(Normal(first + i), out + 2 * i);
+}
+
+/*!
+\brief Convert a range of colors to RGBA8, with an opaque alpha.
+\param first, count Range of vertices.
+\param out Colors, 4 bytes per vertex.
+*/
+void CompactMesh::PackColors(int first, int count, uint8_t* out) const
+{
+  for (int i = 0; i < count; i++)
+  {
+    for (int k = 0; k < 3; k++)
+      out[4 * i + k] = uint8_t(std::lround(std::clamp(double(colors[3 * (first + i) + k]), 0.0, 1.0) * 255.0));
+    out[4 * i + 3] = 255;
+  }
+}
+
+/*!
+\brief Encode a unit vector with the octahedral mapping.
+
+The vector is projected on the octahedron |x|+|y|+|z|=1, the lower half of which is folded over
+the upper one, and the two coordinates in [-1, 1] are stored as normalized signed shorts.
+\param n Unit vector.
+\param out Encoded vector, 2 values.
+*/
+void CompactMesh::EncodeOctahedral(const Vector& n, int16_t* out)
+{
+  const double l = std::abs(n[0]) + std::abs(n[1]) + std::abs(n[2]);
+  double x = (l > 0.0) ? n[0] / l : 0.0;
+  double y = (l > 0.0) ? n[1] / l : 0.0;
+  if (n[2] < 0.0)
+  {
+    const double fx = (1.0 - std::abs(y)) * (x >= 0.0 ? 1.0 : -1.0);
+    const double fy = (1.0 - std::abs(x)) * (y >= 0.0 ? 1.0 : -1.0);
+    x = fx;
+    y = fy;
+  }
+  out[0] = int16_t(std::lround(std::clamp(x, -1.0, 1.0) * 32767.0));
+  out[1] = int16_t(std::lround(std::clamp(y, -1.0, 1.0) * 32767.0));
+}
+
+/*!
+\brief Decode a unit vector encoded with EncodeOctahedral().
+\param e Encoded vector.
+*/
+Vector CompactMesh::DecodeOctahedral(const int16_t* e)
+{
+  const double x = std::max(e[0] / 32767.0, -1.0);
+  const double y = std::max(e[1] / 32767.0, -1.0);
+  Vector n(x, y, 1.0 - std::abs(x) - std::abs(y));
+  if (n[2] < 0.0)
+  {
+    n[0] = (1.0 - std::abs(y)) * (x >= 0.0 ? 1.0 : -1.0);
+    n[1] = (1.0 - std::abs(x)) * (y >= 0.0 ? 1.0 : -1.0);
+  }
+  return Normalized(n);
+}
+
+//! Header of binary mesh files.
+struct CompactMeshHeader
+{
+  char magic[4] = { 'T', 'M', 'S', 'H' };  //!< File identifier.
+  uint32_t version = 1;                     //!< Version of the format.
+  uint32_t vertexes = 0;                    //!< Number of vertices.
+  uint32_t indexes = 0;                     //!< Number of indexes.
+  uint32_t colors = 0;                      //!< 1 if the mesh has colors.
+};
+
+/*!
+\brief Save the mesh in a binary file.
+
+The file is a small header followed by the arrays as they are stored in memory, so that
+it is written and read back without any conversion.
+\param filename File name.
+\return False if the file could not be written.
+*/
+bool CompactMesh::Save(const std::string& filename) const
+{
+  std::ofstream out(filename, std::ios::binary);
+  if (!out)
+    return false;
+
+  CompactMeshHeader header;
+  header.vertexes = uint32_t(Vertexes());
+  header.indexes = uint32_t(indices.size());
+  header.colors = HasColors() ? 1 : 0;
+  out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  out.write(reinterpret_cast<const char*>(positions.data()), sizeof(float) * positions.size());
+  out.write(reinterpret_cast<const char*>(normals.data()), sizeof(float) * normals.size());
+  out.write(reinterpret_cast<const char*>(colors.data()), sizeof(float) * colors.size());
+  out.write(reinterpret_cast<const char*>(indices.data()), sizeof(uint32_t) * indices.size());
+  return bool(out);
+}
+
+/*!
+\brief Load a mesh saved with Save().
+
+The sizes of the header are checked against the size of the file before anything is allocated,
+and the indexes against the number of vertices.
+\param filename File name.
+\return False if the file could not be read or is not a valid mesh file, the mesh is left empty.
+*/
+bool CompactMesh::Load(const std::string& filename)
+{
+  *this = CompactMesh();
+
+  std::ifstream in(filename, std::ios::binary);
+  CompactMeshHeader header, expected;
+  if (!in.read(reinterpret_cast<char*>(&header), sizeof(header)))
+    return false;
+  if (memcmp(header.magic, expected.magic, sizeof(header.magic)) != 0 || header.version != expected.version)
+    return false;
+  if (header.colors > 1 || header.indexes % 3 != 0)
+    return false;
+
+  // Bytes left in the file
+  const std::streampos position = in.tellg();
+  in.seekg(0, std::ios::end);
+  const std::streampos end = in.tellg();
+  in.seekg(position);
+  if (!in || end < position)
+    return false;
+  const uint64_t floats = uint64_t(header.colors ? 9 : 6) * header.vertexes;
+  if (sizeof(float) * floats + sizeof(uint32_t) * uint64_t(header.indexes) > uint64_t(end - position))
+    return false;
+
+  positions.resize(3 * size_t(header.vertexes));
+  normals.resize(3 * size_t(header.vertexes));
+  colors.resize(header.colors ? 3 * size_t(header.vertexes) : 0);
+  indices.resize(header.indexes);
+  in.read(reinterpret_cast<char*>(positions.data()), sizeof(float) * positions.size());
+  in.read(reinterpret_cast<char*>(normals.data()), sizeof(float) * normals.size());
+  in.read(reinterpret_cast<char*>(colors.data()), sizeof(float) * colors.size());
+  in.read(reinterpret_cast<char*>(indices.data()), sizeof(uint32_t) * indices.size());
+  if (!in || std::any_of(indices.begin(), indices.end(), [&header](uint32_t i) { return i >= header.vertexes; }))
+  {
+    *this = CompactMesh();
+    return false;
+  }
+  return true;
+}
+
+/*!
+\brief Convert back to a double precision mesh, with shared vertex and normal indexes.
+*/
+Mesh CompactMesh::ToMesh() const
+{
+  std::vector<Vector> v(Vertexes());
+  std::vector<Vector> n(Vertexes());
+  for (int i = 0; i < Vertexes(); i++)
+  {
+    v[i] = Vertex(i);
+    n[i] = Normal(i);
+  }
+  std::vector<size_t> va(indices.begin(), indices.end());
+  std::vector<size_t> na = va;
+  return Mesh(std::move(v), std::move(n), std::move(va), std::move(na));
+}
+
+/*!
+\brief Convert back to a double precision colored mesh.
+
+Vertexes are white if the mesh has no colors.
+*/
+MeshColor CompactMesh::ToMeshColor() const
+{
+  Mesh mesh = ToMesh();
+  if (!HasColors())
+    return MeshColor(std::move(mesh));
+
+  std::vector<Color> cols(Vertexes());
+  for (int i = 0; i < Vertexes(); i++)
+    cols[i] = GetColor(i);
+  std::vector<size_t> ca = mesh.VertexIndexes();
+  return MeshColor(std::move(mesh), std::move(cols), std::move(ca));
+}
+
+/*!
+\brief Compute the average cache miss ratio, i.e. the number of transformed vertices per triangle.
+
+The post-transform cache is simulated as a FIFO. The ratio is between 0.5 for an ideal ordering
+of a large regular mesh and 3 if there is no reuse at all.
+\param cache Cache size.
+*/
+double CompactMesh::ACMR(int cache) const
+{
+  if (indices.empty())
+    return 0.0;
+
+  // A vertex is in the cache if it has been inserted less than cache misses ago
+  std::vector<int> stamp(Vertexes(), INT_MIN / 2);
+  int misses = 0;
+  for (uint32_t v : indices)
+  {
+    if (misses - stamp[v] >= cache)
+    {
+      stamp[v] = misses;
+      misses++;
+    }
+  }
+  return double(misses) / Triangles();
+}
+
+/*!
+\brief Average cache miss ratio of the triangle order before the last call to Optimize(), to measure its gain.
+
+Returns the current ratio if the mesh has not been optimized.
+*/
+double CompactMesh::InputACMR() const
+{
+  return inputACMR < 0.0 ? ACMR() : inputACMR;
+}
+
+/*!
+\brief Reorder the triangles for the post-transform vertex cache.
+
+This is the algorithm by Tom Forsyth: triangles are added greedily according to a score
+that favors vertices recently used in a simulated LRU cache and vertices with few remaining triangles.
+\param cache Cache size.
+*/
+void CompactMesh::OptimizeVertexCache(int cache)
+{
+  const int nv = Vertexes();
+  const int nt = Triangles();
+  if (nt == 0)
+    return;
+
+  // Vertex to triangle adjacency, the first remaining[v] entries are the triangles not yet added
+  std::vector<int> offsets(nv + 1, 0);
+  for (uint32_t v : indices)
+    offsets[v + 1]++;
+  for (int i = 0; i < nv; i++)
+    offsets[i + 1] += offsets[i];
+  std::vector<int> adjacency(indices.size());
+  std::vector<int> remaining(nv, 0);
+  for (int t = 0; t < nt; t++)
+  {
+    for (int k = 0; k < 3; k++)
+    {
+      int v = indices[3 * t + k];
+      adjacency[offsets[v] + remaining[v]++] = t;
+    }
+  }
+
+  const auto score = [cache](int position, int count)
+  {
+    if (count == 0)
+      return -1.0;
+    double s = 0.0;
+    if (position >= 0)
+    {
+      s = (position < 3) ? 0.75 : pow(1.0 - double(position - 3) / double(cache - 3), 1.5);
+    }
+    return s + 2.0 / sqrt(double(count));
+  };
+
+  std::vector<int> position(nv, -1);
+  std::vector<double> vs(nv);
+  for (int v = 0; v < nv; v++)
+    vs[v] = score(-1, remaining[v]);
+
+  std::vector<double> ts(nt);
+  std::vector<bool> added(nt, false);
+  int best = 0;
+  for (int t = 0; t < nt; t++)
+  {
+    ts[t] = vs[indices[3 * t]] + vs[indices[3 * t + 1]] + vs[indices[3 * t + 2]];
+    if (ts[t] > ts[best])
+      best = t;
+  }
+
+  std::vector<uint32_t> order;
+  order.reserve(indices.size());
+  std::vector<int> lru, next;
+  lru.reserve(cache + 3);
+  next.reserve(cache + 3);
+  int cursor = 0;
+
+  for (int n = 0; n < nt; n++)
+  {
+    // Restart from the first triangle not added yet if the cache gave no candidate
+    if (best < 0)
+    {
+      while (added[cursor])
+        cursor++;
+      best = cursor;
+    }
+
+    added[best] = true;
+    const uint32_t* tv = &indices[3 * best];
+    order.insert(order.end(), tv, tv + 3);
+
+    // Remove the triangle from the adjacency of its vertices
+    for (int k = 0; k < 3; k++)
+    {
+      int v = tv[k];
+      int* a = &adjacency[offsets[v]];
+      int j = 0;
+      while (a[j] != best)
+        j++;
+      std::swap(a[j], a[--remaining[v]]);
+    }
+
+    // Update the cache, evicted vertices are kept at the end to update their scores
+    next.assign(tv, tv + 3);
+    for (int v : lru)
+    {
+      if (v != int(tv[0]) && v != int(tv[1]) && v != int(tv[2]))
+        next.push_back(v);
+    }
+    lru.swap(next);
+
+    for (int i = 0; i < int(lru.size()); i++)
+    {
+      int v = lru[i];
+      position[v] = (i < cache) ? i : -1;
+      vs[v] = score(position[v], remaining[v]);
+    }
+
+    // Update the scores of the triangles of the vertices in the cache and pick the best one
+    best = -1;
+    double bs = -1.0;
+    for (int v : lru)
+    {
+      for (int j = 0; j < remaining[v]; j++)
+      {
+        int t = adjacency[offsets[v] + j];
+        ts[t] = vs[indices[3 * t]] + vs[indices[3 * t + 1]] + vs[indices[3 * t + 2]];
+        if (ts[t] > bs)
+        {
+          bs = ts[t];
+          best = t;
+        }
+      }
+    }
+    if (int(lru.size()) > cache)
+      lru.resize(cache);
+  }
+  indices.swap(order);
+}
+
+/*!
+\brief Reorder clusters of triangles to reduce overdraw, keeping the vertex cache efficiency.
+
+The triangle order is split into clusters where the simulated cache is flushed, i.e. where a triangle has
+three cache misses, so that reordering clusters does not increase ACMR. Clusters facing outwards from
+the center of the mesh are drawn first, as they are likely to occlude the others.
+\param cache Cache size, should be the one used for OptimizeVertexCache().
+*/
+void CompactMesh::OptimizeOverdraw(int cache)
+{
+  const int nt = Triangles();
+  if (nt == 0)
+    return;
+
+  // Cluster boundaries
+  std::vector<int> start;
+  std::vector<int> stamp(Vertexes(), INT_MIN / 2);
+  int misses = 0;
+  for (int t = 0; t < nt; t++)
+  {
+    int m = 0;
+    for (int k = 0; k < 3; k++)
+    {
+      uint32_t v = indices[3 * t + k];
+      if (misses - stamp[v] >= cache)
+      {
+        stamp[v] = misses;
+        misses++;
+        m++;
+      }
+    }
+    if (t == 0 || m == 3)
+      start.push_back(t);
+  }
+  start.push_back(nt);
+  const int nc = int(start.size()) - 1;
+
+  // Area weighted centers and normals of clusters
+  std::vector<Vector> cc(nc, Vector::Null), cn(nc, Vector::Null);
+  Vector center = Vector::Null;
+  double area = 0.0;
+  for (int c = 0; c < nc; c++)
+  {
+    double ca = 0.0;
+    for (int t = start[c]; t < start[c + 1]; t++)
+    {
+      Vector a = Vertex(indices[3 * t]), b = Vertex(indices[3 * t + 1]), d = Vertex(indices[3 * t + 2]);
+      Vector n = 0.5 * ((b - a) / (d - a));
+      double ta = Norm(n);
+      cc[c] += ta * (a + b + d) / 3.0;
+      cn[c] += n;
+      ca += ta;
+    }
+    center += cc[c];
+    area += ca;
+    if (ca > 0.0)
+      cc[c] /= ca;
+  }
+  if (area > 0.0)
+    center /= area;
+
+  std::vector<double> key(nc);
+  std::vector<int> order(nc);
+  for (int c = 0; c < nc; c++)
+  {
+    double l = Norm(cn[c]);
+    key[c] = (l > 0.0) ? ((cc[c] - center) * cn[c]) / l : 0.0;
+    order[c] = c;
+  }
+  std::stable_sort(order.begin(), order.end(), [&key](int a, int b) { return key[a] > key[b]; });
+
+  std::vector<uint32_t> sorted;
+  sorted.reserve(indices.size());
+  for (int c : order)
+  {
+    sorted.insert(sorted.end(), indices.begin() + 3 * start[c], indices.begin() + 3 * start[c + 1]);
+  }
+  indices.swap(sorted);
+}
+
+/*!
+\brief Reorder the vertices in the order they are first used by the triangles.
+
+This improves the locality of the vertex fetches. Unused vertices are moved to the end.
+*/
+void CompactMesh::OptimizeVertexFetch()
+{
+  const int nv = Vertexes();
+  std::vector<uint32_t> remap(nv, UINT32_MAX);
+  uint32_t next = 0;
+  for (uint32_t& v : indices)
+  {
+    if (remap[v] == UINT32_MAX)
+      remap[v] = next++;
+    v = remap[v];
+  }
+  for (int v = 0; v < nv; v++)
+  {
+    if (remap[v] == UINT32_MAX)
+      remap[v] = next++;
+  }
+
+  const auto permute = [&remap, nv](std::vector<float>& a)
+  {
+    if (a.empty())
+      return;
+    std::vector<float> b(a.size());
+    for (int v = 0; v < nv; v++)
+    {
+      std::copy(&a[3 * v], &a[3 * v] + 3, &b[3 * remap[v]]);
+    }
+    a.swap(b);
+  };
+  permute(positions);
+  permute(normals);
+  permute(colors);
+}
+
+/*!
+\brief Optimize the mesh for rendering: vertex cache, overdraw and vertex fetch.
+
+The average cache miss ratio of the input triangle order is kept, see InputACMR().
+\return The mesh.
+*/
+CompactMesh& CompactMesh::Optimize()
+{
+  inputACMR = ACMR();
+  OptimizeVertexCache();
+  OptimizeOverdraw();
+  OptimizeVertexFetch();
+  return *this;
+}
+
+/*!
+\brief Simplify the mesh by vertex clustering.
+
+Vertices are merged in the cells of a regular grid: the vertex of a cell is the average of its vertices,
+its normal (and color) the normalized sum of their normals (the average of their colors), or the normal of
+one of them if the normals cancel out. Triangles with two corners in the same cell are removed. The deviation
+from the original mesh is bounded by the diagonal of a cell.
+\param cell Size of the cells.
+*/
+CompactMesh CompactMesh::Simplify(double cell) const
+{
+  CompactMesh mesh;
+  if (Triangles() == 0 || cell <= 0.0)
+    return *this;
+
+  const Box box = GetBox();
+  const Vector a = box[0];
+  const Vector d = box.Diagonal();
+  const int nx = int(d[0] / cell) + 1;
+  const int ny = int(d[1] / cell) + 1;
+  const int nz = int(d[2] / cell) + 1;
+
+  // Cluster of every vertex
+  std::unordered_map<long long, uint32_t> clusters;
+  std::vector<uint32_t> remap(Vertexes());
+  std::vector<int> count;
+  std::vector<int> first;
+  for (int i = 0; i < Vertexes(); i++)
+  {
+    Vector p = (Vertex(i) - a) / cell;
+    long long x = std::min(int(p[0]), nx - 1), y = std::min(int(p[1]), ny - 1), z = std::min(int(p[2]), nz - 1);
+    long long key = (z * ny + y) * nx + x;
+    auto it = clusters.find(key);
+    if (it == clusters.end())
+    {
+      it = clusters.emplace(key, uint32_t(count.size())).first;
+      count.push_back(0);
+      first.push_back(i);
+    }
+    remap[i] = it->second;
+    count[it->second]++;
+  }
+
+  // Average attributes
+  const int nc = int(count.size());
+  mesh.positions.assign(3 * nc, 0.0f);
+  mesh.normals.assign(3 * nc, 0.0f);
+  if (HasColors())
+    mesh.colors.assign(3 * nc, 0.0f);
+  for (int i = 0; i < Vertexes(); i++)
+  {
+    const uint32_t c = remap[i];
+    for (int k = 0; k < 3; k++)
+    {
+      mesh.positions[3 * c + k] += positions[3 * i + k] / count[c];
+      mesh.normals[3 * c + k] += normals[3 * i + k];
+      if (HasColors())
+        mesh.colors[3 * c + k] += colors[3 * i + k] / count[c];
+    }
+  }
+  for (int c = 0; c < nc; c++)
+  {
+    Vector n = mesh.Normal(c);
+    if (SquaredNorm(n) < 1e-12)
+      n = Normal(first[c]);
+    n = Normalized(n);
+    mesh.normals[3 * c + 0] = float(n[0]);
+    mesh.normals[3 * c + 1] = float(n[1]);
+    mesh.normals[3 * c + 2] = float(n[2]);
+  }
+
+  // Keep non degenerate triangles
+  mesh.indices.reserve(indices.size());
+  for (int t = 0; t < Triangles(); t++)
+  {
+    uint32_t i = remap[indices[3 * t]], j = remap[indices[3 * t + 1]], k = remap[indices[3 * t + 2]];
+    if (i != j && j != k && k != i)
+      mesh.indices.insert(mesh.indices.end(), { i, j, k });
+  }
+  return mesh;
+}
+
+/*!
+\brief Compute a chain of coarser levels of detail by vertex clustering, optimized for rendering.
+
+The size of the cells doubles from one level to the next, starting from 1/256 of the largest side of the
+box of the mesh, and levels that do not reduce the triangle count enough are skipped.
+\param levels Maximum number of levels.
+\return Levels with their geometric error, i.e. the diagonal of their cells, sorted by increasing error.
+\sa Simplify()
+*/
+std::vector<std::pair<CompactMesh, double>> CompactMesh::LevelsOfDetail(int levels) const
+{
+  std::vector<std::pair<CompactMesh, double>> lods;
+  const Vector d = GetBox().Diagonal();
+  double cell = std::max(d[0], std::max(d[1], d[2])) / 512.0;
+  int triangles = Triangles();
+  for (int i = 0; i < levels && triangles > 64; i++)
+  {
+    cell *= 2.0;
+    CompactMesh coarse = Simplify(cell);
+    if (coarse.Triangles() > 0.7 * triangles)
+      continue;
+    triangles = coarse.Triangles();
+    // Deviation bounded by the diagonal of a cell
+    lods.push_back(std::make_pair(std::move(coarse.Optimize()), std::sqrt(3.0) * cell));
+  }
+  return lods;
+}
@@ -0,0 +1,324 @@
+#include "examples.h"
+#include "spline.h"
+#include "tp_math.h"
+
+#include <map>
+
+/*!
+\brief Bezier surfaces.
+*/
+static bool Bezier(std::vector<CompactMesh>& meshes, const ExampleSettings& settings, const std::function<bool(double)>& progress)
+{
+  const uint n = settings.resolution > 0 ? uint(settings.resolution) : 100;
+
+  // Bezier 1
+  {
+    BezierSurface b(3,3, std::vector{
+      Vector{0,0,0}, Vector{0,0.5,0.5}, Vector{0,1,-0.5},
+      Vector{1,0,0}, Vector{1,0.5,-0.5}, Vector{0,1,0},
+      Vector{2,0,0.5}, Vector{2,0.5,0}, Vector{2,1,0}
+    });
+
+    meshes.push_back(CompactMesh(mesh_bezier_surface(b, n, n)));
+  }
+  if (progress && !progress(1.0 / 3.0))
+    return false;
+
+  // Bezier 2
+  {
+    BezierSurface b(4,4, std::vector{
+      Vector{-5,-5,2}, Vector{-5,-2,-5}, Vector{-5,2,-5}, Vector{-5,5,2},
+      Vector{-2,-10,5}, Vector{-2,-2,2}, Vector{-2,2,2}, Vector{-2,10,2},
+      Vector{2,-10,5}, Vector{2,-2,2}, Vector{2,2,2}, Vector{2,-5,2},
+      Vector{5,-5,2}, Vector{5,-2,5}, Vector{5,2,5}, Vector{5,5,2},
+    });
+
+    meshes.push_back(CompactMesh(mesh_bezier_surface(b, n, n)));
+  }
+  if (progress && !progress(2.0 / 3.0))
+    return false;
+
+  // Bezier 3
+  {
+    BezierSurface b(4,4, std::vector{
+      Vector{-10,-10,5}, Vector{-10,-5,2}, Vector{-10,5,-2}, Vector{-10,10,-2},
+      Vector{-5,-10,2}, Vector{-5,-5,-10}, Vector{-5,5,-10}, Vector{-5,10,-2},
+      Vector{5,-10,-2}, Vector{5,-5,-10}, Vector{5,5,-10}, Vector{5,10,2},
+      Vector{10,-10,-2}, Vector{10,-5,-2}, Vector{10,5,2}, Vector{10,10,5},
+    });
+
+    meshes.push_back(CompactMesh(mesh_bezier_surface(b, n, n)));
+  }
+  return !progress || progress(1.0);
+}
+
+/*!
+\brief Bezier surface with a peak, tessellated adaptively.
+*/
+static bool BezierAdaptive(std::vector<CompactMesh>& meshes, const ExampleSettings&, const std::function<bool(double)>& progress)
+{
+  // a, b 2d vectors
+  const auto make_default = [](size_t sx, size_t sy, Vector a, Vector b) {
+    auto bezier = BezierSurface(sx,sy, std::vector<Vector>(sx*sy));
+    Vector delta = b - a;
+    delta[0] /= sx;
+    delta[1] /= sy;
+    for (int x = 0; x < int(sx); x++){
+      for (int y = 0; y < int(sy); y++){
+        bezier.control(x, y) = a + Vector{ x * delta[0], y * delta[1], 0 };
+      }
+    }
+    return bezier;
+  };
+
+  int s = 20;
+  auto b = make_default(s, s, Vector{-5, -5, 0}, Vector{5, 5, 0});
+  b.control(s/2, s/2) = Vector{0,0,100};
+
+  meshes.push_back(CompactMesh(mesh_bezier_surface_adaptive(b, 0.01, 20000)));
+  return !progress || progress(1.0);
+}
+
+/*!
+\brief Vase made of a rational B-spline surface: its sections are exact circles, its profile a cubic B-spline.
+*/
+static bool Nurbs(std::vector<CompactMesh>& meshes, const ExampleSettings& settings, const std::function<bool(double)>& progress)
+{
+  // Full circle as a quadratic rational B-spline with 9 control points on a square
+  const double w = std::sqrt(0.5);
+  const Vector circle[9] = { Vector{1,0,0}, Vector{1,1,0}, Vector{0,1,0}, Vector{-1,1,0}, Vector{-1,0,0}, Vector{-1,-1,0}, Vector{0,-1,0}, Vector{1,-1,0}, Vector{1,0,0} };
+  const double weight[9] = { 1, w, 1, w, 1, w, 1, w, 1 };
+  const KnotVector ku(2, std::vector<double>{ 0, 0, 0, 0.25, 0.25, 0.5, 0.5, 0.75, 0.75, 1, 1, 1 });
+
+  // Radius and height of the sections along the profile
+  const double radius[6] = { 2, 5, 6, 3, 2, 3.5 };
+  const double height[6] = { 0, 1, 5, 9, 11, 12 };
+
+  std::vector<Vector> controls;
+  std::vector<double> weights;
+  for (int y = 0; y < 6; y++){
+    for (int x = 0; x < 9; x++){
+      controls.push_back(Vector{ radius[y] * circle[x][0], radius[y] * circle[x][1], height[y] });
+      weights.push_back(weight[x]);
+    }
+  }
+  NURBSSurface vase(9, 6, controls, weights, ku, KnotVector(6, 3));
+
+  const uint n = settings.resolution > 0 ? uint(settings.resolution) : 100;
+  meshes.push_back(CompactMesh(mesh_surface(vase, n, n)));
+  return !progress || progress(1.0);
+}
+
+/*!
+\brief Revolution surfaces around Bezier curves.
+*/
+static bool Revolution(std::vector<CompactMesh>& meshes, const ExampleSettings& settings, const std::function<bool(double)>& progress)
+{
+  // Revolution 1
+  {
+    BezierCurve curve(std::vector{
+      Vector(0,0,0), Vector(10,-1,0), Vector(10,20,0), Vector(-10,10,-10), Vector(0, 0,-10),
+    });
+
+    ExtrusionSurface ext(&curve, [&](double rad){
+      double hdiv =  M_PI / 10;
+      double v = std::fmod(rad, 2*hdiv);
+      return 0.25 + sin(v/2*M_PI);
+    });
+
+    const uint n = settings.resolution > 0 ? uint(settings.resolution) : 200;
+    meshes.push_back(CompactMesh(mesh_extrusion_surface(ext, n, n)));
+  }
+  if (progress && !progress(0.5))
+    return false;
+
+  // Revolution 2
+  {
+    BezierCurve curve(std::vector{
+      Vector(0,0,10), Vector(0,2,5), Vector(0,5,0), Vector(0,5,-5), Vector(0, 5, -10)
+    });
+
+    ExtrusionSurface ext(&curve, [&](double rad){
+      return 1;
+    });
+
+    const uint n = settings.resolution > 0 ? uint(settings.resolution) : 50;
+    meshes.push_back(CompactMesh(mesh_extrusion_surface(ext, n, n)));
+  }
+  return !progress || progress(1.0);
+}
+
+/*!
+\brief Polygonize an implicit surface with the settings of an example.
+\param implicit The implicit surface.
+\param n, box, epsilon Default polygonization parameters of the example.
+*/
+static bool Polygonize(Implicit* implicit, int n, const Box& box, double epsilon, std::vector<CompactMesh>& meshes, const ExampleSettings& settings, const std::function<bool(double)>& progress)
+{
+  ImplicitTree::Tree tree(implicit);
+  tree.SetCache(settings.cache);
+
+  Mesh m;
+  if (!tree.Polygonize(settings.resolution > 0 ? settings.resolution : n, m, box, settings.epsilon > 0.0 ? settings.epsilon : epsilon, progress))
+    return false;
+  meshes.push_back(CompactMesh(m));
+  return true;
+}
+
+/*!
+\brief Box minus a torus.
+*/
+static bool ImplicitA(std::vector<CompactMesh>& meshes, const ExampleSettings& settings, const std::function<bool(double)>& progress)
+{
+  auto b = ImplicitTree::InigoBox(Vector{5,0,0}, Vector{8,8,8});
+  auto tore = ImplicitTree::InigoTore(Vector::Null, Vector{10, 3, 0});
+  auto i = ImplicitTree::Diff(b, tore);
+  return Polygonize(&i, 400, Box(20), 0.001, meshes, settings, progress);
+}
+
+/*!
+\brief Table with a bowl, see ImplicitTable.
+*/
+static bool ImplicitB(std::vector<CompactMesh>& meshes, const ExampleSettings& settings, const std::function<bool(double)>& progress)
+{
+  ImplicitTable table;
+  return Polygonize(&table.implicit2, 500, Box(30), 0.001, meshes, settings, progress);
+}
+
+/*!
+\brief Chain of blended boxes and spheres.
+*/
+static bool ImplicitC(std::vector<CompactMesh>& meshes, const ExampleSettings& settings, const std::function<bool(double)>& progress)
+{
+  auto a = ImplicitTree::InigoBox(Vector::Null, Vector(5));
+  auto b = ImplicitTree::InigoBox(Vector{10,10,10}, Vector(5));
+  auto c = ImplicitTree::Sphere(Vector(18), 5);
+  auto dd = ImplicitTree::Sphere(Vector(24), 5);
+
+  auto aa = ImplicitTree::Blend(a, b, 30);
+  auto bb = ImplicitTree::Blend(aa, c, 100);
+  auto p = ImplicitTree::Blend(bb, dd, 50);
+
+  return Polygonize(&p, 500, Box(100), 0.001, meshes, settings, progress);
+}
+
+/*!
+\brief Replicated torus, 15 cells along every axis so that the instances fit in the domain.
+*/
+static bool ImplicitD(std::vector<CompactMesh>& meshes, const ExampleSettings& settings, const std::function<bool(double)>& progress)
+{
+  auto torus = ImplicitTree::InigoTore(Vector{0,0,0}, Vector{10,5,0});
+  auto repl = ImplicitTree::Replicate(&torus, Vector{20,20,20}, 7, 7, 7);
+  return Polygonize(&repl, 400, Box(300), 0.001, meshes, settings, progress);
+}
+
+/*!
+\brief Replicated torus of ImplicitD, as the mesh of a single torus and the offsets of its instances.
+
+The torus is polygonized with the cells of the polygonization of the whole domain.
+*/
+static bool ImplicitDInstanced(CompactMesh& mesh, std::vector<Vector>& offsets, const ExampleSettings& settings, const std::function<bool(double)>& progress)
+{
+  auto torus = ImplicitTree::InigoTore(Vector{0,0,0}, Vector{10,5,0});
+  auto repl = ImplicitTree::Replicate(&torus, Vector{20,20,20}, 7, 7, 7);
+  const Box domain(300);
+  if (!repl.Instances(domain, 0.0, offsets))
+    return false;
+
+  const int n = settings.resolution > 0 ? settings.resolution : 400;
+  const double cell = domain.Diagonal()[0] / (n - 1);
+  const Box box = repl.CellBox(0.0);
+  const Vector d = box.Diagonal();
+  const double r = 0.5 * std::max(d[0], std::max(d[1], d[2])) + 2.0 * cell;
+
+  ImplicitTree::Tree tree(&torus);
+  tree.SetCache(settings.cache);
+  Mesh m;
+  if (!tree.Polygonize(int(std::ceil(2.0 * r / cell)) + 1, m, Box(box.Center(), r), settings.epsilon > 0.0 ? settings.epsilon : 0.001, progress))
+    return false;
+  mesh = CompactMesh(m);
+  return true;
+}
+
+typedef bool (*ExampleFunction)(std::vector<CompactMesh>&, const ExampleSettings&, const std::function<bool(double)>&);
+
+//! Examples, by name.
+static const std::map<std::string, ExampleFunction> examples = {
+  { "bezier", Bezier },
+  { "bezier-adaptive", BezierAdaptive },
+  { "revolution", Revolution },
+  { "implicit-a", ImplicitA },
+  { "implicit-b", ImplicitB },
+  { "implicit-c", ImplicitC },
+  { "implicit-d", ImplicitD },
+  { "nurbs", Nurbs },
+};
+
+typedef bool (*InstancedFunction)(CompactMesh&, std::vector<Vector>&, const ExampleSettings&, const std::function<bool(double)>&);
+
+//! Examples made of instances of a single mesh, by name.
+static const std::map<std::string, InstancedFunction> instanced = {
+  { "implicit-d", ImplicitDInstanced },
+};
+
+/*!
+\brief Names of the examples, in alphabetical order.
+*/
+const std::vector<std::string>& Examples::Names()
+{
+  static const std::vector<std::string> names = []()
+  {
+    std::vector<std::string> n;
+    for (const auto& example : examples)
+      n.push_back(example.first);
+    return n;
+  }();
+  return names;
+}
+
+/*!
+\brief Generate the meshes of an example.
+
+The progress callback is called with the fraction of the work done so far, and the generation
+stops as soon as it returns false.
+\param name Name of the example, see Names().
+\param meshes Generated meshes are appended to this set.
+\param settings Settings.
+\param progress Progress callback, may be empty.
+\return False if the example does not exist or if the generation was cancelled.
+*/
+bool Examples::Generate(const std::string& name, std::vector<CompactMesh>& meshes, const ExampleSettings& settings, const std::function<bool(double)>& progress)
+{
+  const auto example = examples.find(name);
+  if (example == examples.end())
+    return false;
+  return example->second(meshes, settings, progress);
+}
+
+/*!
+\brief Check if an example is made of instances of a single mesh.
+\param name Name of the example.
+*/
+bool Examples::Instanced(const std::string& name)
+{
+  return instanced.find(name) != instanced.end();
+}
+
+/*!
+\brief Generate an example made of instances of a single mesh, see Instanced().
+
+The mesh is generated once, and should be drawn translated by every offset.
+\param name Name of the example.
+\param mesh Generated mesh.
+\param offsets Offsets of the instances.
+\param settings Settings.
+\param progress Progress callback, may be empty.
+\return False if the example is not instanced or if the generation was cancelled.
+*/
+bool Examples::Generate(const std::string& name, CompactMesh& mesh, std::vector<Vector>& offsets, const ExampleSettings& settings, const std::function<bool(double)>& progress)
+{
+  const auto example = instanced.find(name);
+  if (example == instanced.end())
+    return false;
+  return example->second(mesh, offsets, settings, progress);
+}
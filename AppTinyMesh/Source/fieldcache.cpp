@@ -0,0 +1,295 @@
+#include "fieldcache.h"
+
+#include <cfloat>
+
+/*!
+\class FieldGrid fieldcache.h
+
+\brief Grid of field samples stored as compressed bricks.
+
+The grid is built layer by layer, in the order in which AnalyticScalarField::Polygonize()
+samples the field. Samples are rounded to floats keeping their sign.
+
+Bricks are compressed as soon as the next layer is known: a brick whose samples and
+neighboring samples all have the same sign is not crossed by the surface, and its samples are
+only ever used for their sign, so that it is collapsed into a single value. Only the bricks
+near the surface keep their samples.
+*/
+
+/*!
+\brief Create an empty grid.
+\param x, y, z Number of samples along every axis.
+*/
+FieldGrid::FieldGrid(int x, int y, int z) : nx(x), ny(y), nz(z)
+{
+  bx = (nx + Size - 1) / Size;
+  by = (ny + Size - 1) / Size;
+  bz = (nz + Size - 1) / Size;
+  bricks.resize(bx * by * bz);
+  slab.resize(size_t(nx) * ny * Size);
+}
+
+/*!
+\brief Round a sample to a float, keeping its sign.
+\param v Value.
+*/
+float FieldGrid::Round(double v)
+{
+  float f = float(v);
+  return (v < 0.0 && !(f < 0.0f)) ? -FLT_MIN : f;
+}
+
+/*!
+\brief Add the next layer of samples.
+\param values Samples of the layer, the sample (i, j) being stored at index i * ny + j.
+*/
+void FieldGrid::AddLayer(const double* values)
+{
+  const size_t n = size_t(nx) * ny;
+  std::vector<float> layer(n);
+  for (size_t i = 0; i < n; i++)
+    layer[i] = Round(values[i]);
+
+  // The previous slab is complete
+  const int z = layers % Size;
+  if (z == 0 && layers > 0)
+  {
+    Compress(layers / Size - 1, layer.data());
+    below.assign(slab.end() - n, slab.end());
+  }
+
+  std::copy(layer.begin(), layer.end(), slab.begin() + z * n);
+  layers++;
+}
+
+/*!
+\brief Compress the last slab of bricks, the grid is complete.
+*/
+void FieldGrid::Finish()
+{
+  if (layers > 0)
+    Compress((layers - 1) / Size, nullptr);
+  std::vector<float>().swap(slab);
+  std::vector<float>().swap(below);
+}
+
+/*!
+\brief Compress a slab of bricks.
+\param s Slab.
+\param above Layer above the slab, null for the last slab.
+*/
+void FieldGrid::Compress(int s, const float* above)
+{
+  const int z0 = s * Size;
+  const int sz = std::min(Size, nz - z0);
+
+  // Sample of the slab, or of the layers below and above it
+  const auto Raw = [&](int i, int j, int k)
+  {
+    if (k < 0)
+      return below[size_t(i) * ny + j];
+    if (k == sz)
+      return above[size_t(i) * ny + j];
+    return slab[(size_t(k) * nx + i) * ny + j];
+  };
+
+  const int ka = (s > 0) ? -1 : 0;
+  const int kb = (above != nullptr) ? sz : sz - 1;
+  for (int bj = 0; bj < by; bj++)
+  {
+    for (int bi = 0; bi < bx; bi++)
+    {
+      Brick& brick = bricks[(s * by + bj) * bx + bi];
+      const int i0 = bi * Size, sx = std::min(Size, nx - i0);
+      const int j0 = bj * Size, sy = std::min(Size, ny - j0);
+
+      // Check the sign of the brick and of its neighbors
+      const bool negative = Raw(i0, j0, 0) < 0.0f;
+      bool uniform = true;
+      for (int k = ka; k <= kb && uniform; k++)
+      {
+        for (int i = std::max(i0 - 1, 0); i <= std::min(i0 + sx, nx - 1) && uniform; i++)
+        {
+          for (int j = std::max(j0 - 1, 0); j <= std::min(j0 + sy, ny - 1); j++)
+          {
+            if ((Raw(i, j, k) < 0.0f) != negative)
+            {
+              uniform = false;
+              break;
+            }
+          }
+        }
+      }
+
+      if (uniform)
+      {
+        brick.value = Raw(i0, j0, 0);
+        continue;
+      }
+
+      brick.samples.resize(size_t(sx) * sy * sz);
+      for (int k = 0; k < sz; k++)
+      {
+        for (int j = 0; j < sy; j++)
+        {
+          for (int i = 0; i < sx; i++)
+          {
+            brick.samples[(size_t(k) * sy + j) * sx + i] = Raw(i0 + i, j0 + j, k);
+          }
+        }
+      }
+    }
+  }
+}
+
+/*!
+\brief Memory used by the grid, in bytes.
+*/
+size_t FieldGrid::Memory() const
+{
+  size_t memory = sizeof(FieldGrid) + sizeof(Brick) * bricks.size();
+  for (const Brick& brick : bricks)
+    memory += sizeof(float) * brick.samples.capacity();
+  return memory;
+}
+
+/*!
+\brief Number of collapsed bricks.
+*/
+int FieldGrid::Collapsed() const
+{
+  int n = 0;
+  for (const Brick& brick : bricks)
+  {
+    if (brick.samples.empty())
+      n++;
+  }
+  return n;
+}
+
+/*!
+\class FieldCache fieldcache.h
+
+\brief Cache of grids of field samples, shared by the polygonizations.
+
+Fields identified by the same structural hash, see Implicit::Hash(), polygonized over
+the same domain at the same resolution share their samples: changing the precision of
+the vertices, or extracting the surface again, does not evaluate the field on the grid.
+*/
+
+/*!
+\brief Create an empty cache.
+\param budget Maximum memory used by the grids, in bytes.
+*/
+FieldCache::FieldCache(size_t budget) : budget(budget)
+{
+}
+
+/*!
+\brief Search a grid, which becomes the most recently used one.
+\param hash Hash of the field.
+\param box Domain.
+\param n Resolution.
+\return The grid, null if not found.
+*/
+std::shared_ptr<const FieldGrid> FieldCache::Find(uint64_t hash, const Box& box, int n)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  for (std::list<Entry>::iterator i = entries.begin(); i != entries.end(); i++)
+  {
+    if (i->hash == hash && i->n == n && i->box == box)
+    {
+      entries.splice(entries.begin(), entries, i);
+      hits++;
+      return entries.front().grid;
+    }
+  }
+  misses++;
+  return nullptr;
+}
+
+/*!
+\brief Insert a grid, evicting the least recently used grids if needed.
+\param hash Hash of the field.
+\param box Domain.
+\param n Resolution.
+\param grid The grid.
+*/
+void FieldCache::Insert(uint64_t hash, const Box& box, int n, const std::shared_ptr<const FieldGrid>& grid)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  for (std::list<Entry>::iterator i = entries.begin(); i != entries.end(); i++)
+  {
+    if (i->hash == hash && i->n == n && i->box == box)
+    {
+      memory -= i->grid->Memory();
+      entries.erase(i);
+      break;
+    }
+  }
+  entries.push_front(Entry{ hash, box, n, grid });
+  memory += grid->Memory();
+  Evict();
+}
+
+/*!
+\brief Set the maximum memory used by the grids.
+\param bytes Budget.
+*/
+void FieldCache::SetBudget(size_t bytes)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  budget = bytes;
+  Evict();
+}
+
+/*!
+\brief Remove all the grids.
+*/
+void FieldCache::Clear()
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  entries.clear();
+  memory = 0;
+}
+
+/*!
+\brief Evict the least recently used grids until the memory fits the budget.
+
+Grids still used by a polygonization are released when it completes.
+*/
+void FieldCache::Evict()
+{
+  while (memory > budget && !entries.empty())
+  {
+    memory -= entries.back().grid->Memory();
+    entries.pop_back();
+  }
+}
+
+/*!
+\brief Memory used by the grids, in bytes.
+*/
+size_t FieldCache::Memory()
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  return memory;
+}
+
+/*!
+\brief Number of successful searches.
+*/
+int FieldCache::Hits()
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  return hits;
+}
+
+/*!
+\brief Number of failed searches.
+*/
+int FieldCache::Misses()
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  return misses;
+}
@@ -0,0 +1,467 @@
+#include "fieldprofiler.h"
+#include "implicits.h"
+
+#include <algorithm>
+#include <fstream>
+#include <map>
+
+/*!
+\class FieldProfiler fieldprofiler.h
+
+\brief Profiler of the evaluations of implicit trees.
+
+Nodes evaluate their children through ::Evaluate(), which records every evaluation in the
+call path of the node: the number of calls and the inclusive time, i.e. including the time
+spent in the children. Call paths are recorded per phase, given by the innermost Scope.
+AnalyticScalarField sets the phases of the polygonization, so that the cost of a node is
+broken down into grid sampling, dichotomy and gradient.
+
+Nodes are identified by their address and their serial number, see Serial(), so that the nodes of
+a tree are not merged with the nodes of a deleted tree that lived at the same addresses.
+
+Every thread records into its own buffers, merged by the exports, which should be called
+when no tree is being evaluated.
+\code
+FieldProfiler::Reset();
+tree.Polygonize(200, mesh, Box(20.0));
+FieldProfiler::Report(std::cout);
+FieldProfiler::SaveChromeTrace("profile.json"); // chrome://tracing or https://ui.perfetto.dev
+FieldProfiler::SaveFolded("profile.folded");    // flamegraph.pl profile.folded > profile.svg
+\endcode
+
+Profiling costs two clock reads per evaluated node, so the profiler is only compiled in with
+the TINYMESH_PROFILE definition (CMake option of the same name).
+*/
+
+#ifdef TINYMESH_PROFILE
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <tuple>
+#include <typeinfo>
+#include <unordered_map>
+#include <vector>
+
+#ifdef __GNUG__
+#include <cxxabi.h>
+#include <cstdlib>
+#endif
+
+namespace
+{
+  //! Node of a call path.
+  struct Frame
+  {
+    const Implicit* node;   //!< Node, only used as an identifier since the node may be deleted.
+    uint64_t serial;        //!< Serial number of the node.
+    const char* type;       //!< Mangled name of the type of the node.
+    int parent;             //!< Parent frame, -1 - phase for the roots.
+    uint64_t calls = 0;     //!< Number of calls.
+    uint64_t time = 0;      //!< Inclusive time, in nanoseconds.
+    uint64_t children = 0;  //!< Time spent in the children, in nanoseconds.
+  };
+
+  //! Key of a frame: parent frame, node and serial number of the node.
+  typedef std::tuple<int, const Implicit*, uint64_t> FrameKey;
+
+  //! Hash of the key of a frame.
+  struct FrameHash
+  {
+    size_t operator()(const FrameKey& k) const
+    {
+      return std::hash<const void*>()(std::get<1>(k)) ^ (size_t(std::get<0>(k)) * 0x9e3779b97f4a7c15ull) ^ size_t(std::get<2>(k) * 0xff51afd7ed558ccdull);
+    }
+  };
+
+  //! Call paths recorded by a thread.
+  struct Frames
+  {
+    std::vector<Frame> frames;                           //!< Frames.
+    std::unordered_map<FrameKey, int, FrameHash> index;  //!< Frames by parent, node and serial number.
+
+    //! Find or create the frame of a node called from a parent frame, the type is only read for new frames.
+    template <typename Type>
+    int Find(int parent, const Implicit* node, uint64_t serial, const Type& type)
+    {
+      const FrameKey key(parent, node, serial);
+      const auto i = index.find(key);
+      if (i != index.end())
+        return i->second;
+      frames.push_back(Frame{ node, serial, type(), parent });
+      index[key] = int(frames.size()) - 1;
+      return int(frames.size()) - 1;
+    }
+  };
+
+  //! Buffers of all the threads, kept after the threads exit.
+  std::mutex mutex;
+  std::vector<std::shared_ptr<Frames>> threads;
+
+  thread_local std::shared_ptr<Frames> local;
+  thread_local int phase = FieldProfiler::Other;
+  thread_local int current = -1;
+
+  //! Buffers of the calling thread.
+  Frames& Local()
+  {
+    if (!local)
+    {
+      local = std::make_shared<Frames>();
+      std::lock_guard<std::mutex> lock(mutex);
+      threads.push_back(local);
+    }
+    return *local;
+  }
+
+  //! Merge the buffers of all the threads.
+  Frames Merge()
+  {
+    Frames merged;
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const std::shared_ptr<Frames>& t : threads)
+    {
+      // Frames are created after their parent, so that parents are merged first
+      std::vector<int> map(t->frames.size());
+      for (int i = 0; i < int(t->frames.size()); i++)
+      {
+        const Frame& f = t->frames[i];
+        const int parent = (f.parent < 0) ? f.parent : map[f.parent];
+        const int j = merged.Find(parent, f.node, f.serial, [&f]() { return f.type; });
+        map[i] = j;
+        merged.frames[j].calls += f.calls;
+        merged.frames[j].time += f.time;
+        merged.frames[j].children += f.children;
+      }
+    }
+    return merged;
+  }
+}
+
+static const char* PhaseNames[FieldProfiler::Phases] = { "Sampling", "Dichotomy", "Gradient", "Other" };
+
+/*!
+\brief Readable name of a type.
+\param mangled Mangled name.
+*/
+static std::string TypeName(const char* mangled)
+{
+  std::string name = mangled;
+#ifdef __GNUG__
+  int status = 0;
+  char* demangled = abi::__cxa_demangle(mangled, nullptr, nullptr, &status);
+  if (status == 0)
+    name = demangled;
+  free(demangled);
+#endif
+  for (const std::string prefix : { "ImplicitTree::", "struct ", "class " })
+  {
+    for (size_t i = name.find(prefix); i != std::string::npos; i = name.find(prefix))
+      name.erase(i, prefix.size());
+  }
+  return name;
+}
+
+/*!
+\brief Readable names of the nodes, the type followed by the index of the node in order of first evaluation.
+\param frames Frames.
+\return Names, by node and serial number.
+*/
+static std::map<std::pair<const Implicit*, uint64_t>, std::string> NodeNames(const Frames& frames)
+{
+  std::map<std::pair<const Implicit*, uint64_t>, std::string> names;
+  std::map<std::string, int> count;
+  for (const Frame& f : frames.frames)
+  {
+    const std::pair<const Implicit*, uint64_t> node(f.node, f.serial);
+    if (names.find(node) != names.end())
+      continue;
+    const std::string type = TypeName(f.type);
+    names[node] = type + "#" + std::to_string(count[type]++);
+  }
+  return names;
+}
+
+/*!
+\brief Serial number of a new node.
+
+Nodes get a new number when they are created, and keep it for their lifetime.
+*/
+uint64_t FieldProfiler::Serial()
+{
+  static std::atomic<uint64_t> serial(0);
+  return serial++;
+}
+
+/*!
+\brief Enter a phase.
+\param p Phase.
+*/
+FieldProfiler::Scope::Scope(Phase p) : previous(phase)
+{
+  phase = p;
+}
+
+/*!
+\brief Restore the phase of the enclosing scope.
+*/
+FieldProfiler::Scope::~Scope()
+{
+  phase = previous;
+}
+
+/*!
+\brief Evaluate a node, recording the evaluation.
+\param node The node.
+\param p Point.
+*/
+double FieldProfiler::Evaluate(const Implicit* node, const Vector& p)
+{
+  typedef std::chrono::steady_clock Clock;
+
+  Frames& t = Local();
+  const int parent = current;
+  const int f = t.Find(parent < 0 ? -1 - phase : parent, node, node->serial, [node]() { return typeid(*node).name(); });
+
+  current = f;
+  const Clock::time_point start = Clock::now();
+  const double v = node->Value(p);
+  const uint64_t time = uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count());
+  current = parent;
+
+  t.frames[f].calls++;
+  t.frames[f].time += time;
+  if (parent >= 0)
+    t.frames[parent].children += time;
+  return v;
+}
+
+/*!
+\brief Clear the recorded evaluations.
+
+Should not be called while trees are being evaluated.
+*/
+void FieldProfiler::Reset()
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  for (const std::shared_ptr<Frames>& t : threads)
+  {
+    t->frames.clear();
+    t->index.clear();
+  }
+}
+
+/*!
+\brief Print the number of calls and the time per node type, and per node, for every phase.
+
+Self time excludes the time spent in the children of the nodes.
+\param out Stream.
+*/
+void FieldProfiler::Report(std::ostream& out)
+{
+  const Frames frames = Merge();
+  const std::map<std::pair<const Implicit*, uint64_t>, std::string> names = NodeNames(frames);
+
+  struct Stats
+  {
+    uint64_t calls[Phases] = {};
+    uint64_t self[Phases] = {};
+  };
+  std::map<std::string, Stats> types, nodes;
+  uint64_t total = 0;
+  for (int i = 0; i < int(frames.frames.size()); i++)
+  {
+    const Frame& f = frames.frames[i];
+    int root = i;
+    while (frames.frames[root].parent >= 0)
+      root = frames.frames[root].parent;
+    const int ph = -1 - frames.frames[root].parent;
+
+    for (Stats* s : { &types[TypeName(f.type)], &nodes[names.at(std::make_pair(f.node, f.serial))] })
+    {
+      s->calls[ph] += f.calls;
+      s->self[ph] += f.time - std::min(f.time, f.children);
+    }
+    total += f.time - std::min(f.time, f.children);
+  }
+
+  const auto Print = [&](const char* title, const std::map<std::string, Stats>& stats)
+  {
+    char line[256];
+    snprintf(line, sizeof(line), "%-20s", title);
+    out << line;
+    for (int ph = 0; ph < Phases; ph++)
+    {
+      snprintf(line, sizeof(line), " %12s %10s", PhaseNames[ph], "self ms");
+      out << line;
+    }
+    out << "  share\n";
+
+    // Most expensive first
+    std::vector<std::pair<uint64_t, std::string>> order;
+    for (const auto& s : stats)
+    {
+      uint64_t self = 0;
+      for (int ph = 0; ph < Phases; ph++)
+        self += s.second.self[ph];
+      order.push_back(std::make_pair(self, s.first));
+    }
+    std::sort(order.rbegin(), order.rend());
+    for (const auto& o : order)
+    {
+      const Stats& s = stats.at(o.second);
+      snprintf(line, sizeof(line), "%-20s", o.second.c_str());
+      out << line;
+      for (int ph = 0; ph < Phases; ph++)
+      {
+        snprintf(line, sizeof(line), " %12llu %10.2f", (unsigned long long)s.calls[ph], 1e-6 * s.self[ph]);
+        out << line;
+      }
+      snprintf(line, sizeof(line), "  %5.1f%%\n", total == 0 ? 0.0 : 100.0 * o.first / total);
+      out << line;
+    }
+  };
+  Print("Type", types);
+  out << "\n";
+  Print("Node", nodes);
+}
+
+/*!
+\brief Export the call paths in the Chrome trace event format.
+
+Every call path is a complete event lasting its inclusive time, nested in the event of its
+parent, with one track per phase: the trace reads as a flame chart of the aggregated time.
+\param file File name.
+*/
+bool FieldProfiler::SaveChromeTrace(const std::string& file)
+{
+  const Frames frames = Merge();
+  const std::map<std::pair<const Implicit*, uint64_t>, std::string> names = NodeNames(frames);
+
+  std::vector<std::vector<int>> children(frames.frames.size());
+  std::vector<int> roots[Phases];
+  for (int i = 0; i < int(frames.frames.size()); i++)
+  {
+    const int parent = frames.frames[i].parent;
+    if (parent >= 0)
+      children[parent].push_back(i);
+    else
+      roots[-1 - parent].push_back(i);
+  }
+
+  std::ofstream out(file);
+  if (!out)
+    return false;
+  out << std::fixed;
+  out.precision(3);
+  out << "{\"traceEvents\":[\n";
+  bool first = true;
+  for (int ph = 0; ph < Phases; ph++)
+  {
+    out << (first ? "" : ",\n") << "{\"ph\":\"M\",\"pid\":1,\"tid\":" << ph << ",\"name\":\"thread_name\",\"args\":{\"name\":\"" << PhaseNames[ph] << "\"}}";
+    first = false;
+
+    // Depth first layout, children start with their parent and follow each other
+    std::vector<std::pair<int, double>> stack;
+    double start = 0.0;
+    for (int r : roots[ph])
+    {
+      stack.push_back(std::make_pair(r, start));
+      start += 1e-3 * frames.frames[r].time;
+    }
+    while (!stack.empty())
+    {
+      const int i = stack.back().first;
+      const double ts = stack.back().second;
+      stack.pop_back();
+
+      const Frame& f = frames.frames[i];
+      out << ",\n{\"ph\":\"X\",\"pid\":1,\"tid\":" << ph << ",\"name\":\"" << names.at(std::make_pair(f.node, f.serial)) << "\",\"cat\":\"" << PhaseNames[ph]
+        << "\",\"ts\":" << ts << ",\"dur\":" << 1e-3 * f.time
+        << ",\"args\":{\"calls\":" << f.calls << ",\"self_us\":" << 1e-3 * (f.time - std::min(f.time, f.children)) << "}}";
+
+      double child = ts;
+      for (int c : children[i])
+      {
+        stack.push_back(std::make_pair(c, child));
+        child += 1e-3 * frames.frames[c].time;
+      }
+    }
+  }
+  out << "\n]}\n";
+  return bool(out);
+}
+
+/*!
+\brief Export the self time of the call paths in the folded stack format of flame graph tools.
+
+Every line is the phase followed by the nodes of a call path, separated by semicolons, and the
+self time in microseconds.
+\param file File name.
+*/
+bool FieldProfiler::SaveFolded(const std::string& file)
+{
+  const Frames frames = Merge();
+  const std::map<std::pair<const Implicit*, uint64_t>, std::string> names = NodeNames(frames);
+
+  std::ofstream out(file);
+  if (!out)
+    return false;
+  std::vector<std::string> paths(frames.frames.size());
+  for (int i = 0; i < int(frames.frames.size()); i++)
+  {
+    const Frame& f = frames.frames[i];
+    paths[i] = ((f.parent < 0) ? std::string(PhaseNames[-1 - f.parent]) : paths[f.parent]) + ";" + names.at(std::make_pair(f.node, f.serial));
+    const uint64_t self = (f.time - std::min(f.time, f.children)) / 1000;
+    if (self > 0)
+      out << paths[i] << " " << self << "\n";
+  }
+  return bool(out);
+}
+
+#else
+
+/*!
+\brief Evaluate a node, the profiler is compiled out.
+\param node The node.
+\param p Point.
+*/
+double FieldProfiler::Evaluate(const Implicit* node, const Vector& p)
+{
+  return node->Value(p);
+}
+
+/*!
+\brief Clear the recorded evaluations, the profiler is compiled out.
+*/
+void FieldProfiler::Reset()
+{
+}
+
+/*!
+\brief Print a notice, the profiler is compiled out.
+\param out Stream.
+*/
+void FieldProfiler::Report(std::ostream& out)
+{
+  out << "Profiler compiled out, configure with -DTINYMESH_PROFILE=ON\n";
+}
+
+/*!
+\brief Export the call paths, the profiler is compiled out.
+*/
+bool FieldProfiler::SaveChromeTrace(const std::string&)
+{
+  return false;
+}
+
+/*!
+\brief Export the call paths, the profiler is compiled out.
+*/
+bool FieldProfiler::SaveFolded(const std::string&)
+{
+  return false;
+}
+
+#endif
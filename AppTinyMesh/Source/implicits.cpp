@@ -1,7 +1,38 @@
 #include "implicits.h"
+#include "fieldcache.h"
 
 const double AnalyticScalarField::Epsilon = 1e-6;
 
+/*!
+\brief Compute a box containing the points where the field is lower than a given level.
+
+The level is 0 for the surface and the inside of the object. The default implementation does
+not bound the field, whatever the level.
+*/
+Box Implicit::GetBox(double) const
+{
+  return Box::Infinity;
+}
+
+/*!
+\brief Compute the region where a node of the tree may change the surface of this node.
+
+Outside of the region, any change of the node leaves the set of points where the field of
+this node is lower than the level unchanged. Nodes forward the query to their children,
+raising the level where the children blend, and transform the box back into their frame.
+\param node The node.
+\param level Level, 0 for the surface.
+\param box Returned region.
+\return False if the node is not in the tree.
+*/
+bool Implicit::Influence(const Implicit* node, double level, Box& box) const
+{
+  if (node != this)
+    return false;
+  box = GetBox(level);
+  return true;
+}
+
 /*!
 \brief Constructor.
 */
@@ -28,6 +59,31 @@ double AnalyticScalarField::Value(const Vector& p) const
 */
 void AnalyticScalarField::Polygonize(int n, Mesh& g, const Box& box, const double& epsilon) const
 {
+  Polygonize(n, g, box, epsilon, nullptr);
+}
+
+/*!
+\brief Compute the polygonal mesh approximating the implicit surface, reporting the progress.
+
+The progress callback is called after every layer of cells with the fraction of the layers
+processed so far. The polygonization stops as soon as the callback returns false, in which case
+the geometry is left unchanged; this is how a polygonization running in a background thread
+is cancelled.
+
+If a cache is set and the field can be hashed, the samples of the grid are searched in the cache
+and recorded into it on a miss, so that polygonizing the same field again over the same domain
+does not evaluate the field on the grid.
+\param box %Box defining the region that will be polygonized.
+\param n Discretization parameter.
+\param g Returned geometry.
+\param epsilon Epsilon value for computing vertices on straddling edges.
+\param progress Progress callback, may be empty.
+\return False if the polygonization was cancelled.
+*/
+bool AnalyticScalarField::Polygonize(int n, Mesh& g, const Box& box, const double& epsilon, const std::function<bool(double)>& progress) const
+{
+  FieldProfiler::Scope scope(FieldProfiler::Sampling);
+
   std::vector<Vector> vertex;
   std::vector<Vector> normal;
 
@@ -72,6 +128,21 @@ void AnalyticScalarField::Polygonize(int n, Mesh& g, const Box& box, const doubl
   // Diagonal of a cell
   Vector d = clipped.Diagonal() / (n - 1);
 
+  // Samples of the cache, or grid recording the samples for the cache
+  const uint64_t hash = (cache != nullptr) ? Hash() : 0;
+  std::shared_ptr<const FieldGrid> grid = (hash != 0) ? cache->Find(hash, box, n) : nullptr;
+  std::shared_ptr<FieldGrid> record = (hash != 0 && grid == nullptr) ? std::make_shared<FieldGrid>(nx, ny, nz + 1) : nullptr;
+
+  // Recorded samples are rounded so that the mesh does not depend on whether the samples were cached
+  const auto Sample = [&](int i, int j, int k, const Vector& p)
+  {
+    if (grid != nullptr)
+      return double((*grid)(i, j, k));
+    if (record != nullptr)
+      return double(FieldGrid::Round(Value(p)));
+    return Value(p);
+  };
+
   double za = 0.0;
 
   // Compute field inside lower Oxy plane
@@ -80,9 +151,11 @@ void AnalyticScalarField::Polygonize(int n, Mesh& g, const Box& box, const doubl
     for (int j = nay; j < nby; j++)
     {
       u[i * ny + j] = clipped[0] + Vector(i * d[0], j * d[1], za);
-      a[i * ny + j] = Value(u[i * ny + j]);
+      a[i * ny + j] = Sample(i, j, 0, u[i * ny + j]);
     }
   }
+  if (record != nullptr)
+    record->AddLayer(a);
 
   // Compute straddling edges inside lower Oxy plane
   for (int i = nax; i < nbx - 1; i++)
@@ -116,6 +189,8 @@ void AnalyticScalarField::Polygonize(int n, Mesh& g, const Box& box, const doubl
   // Array for edge vertices
   int e[12];
 
+  bool cancelled = false;
+
   // For all layers
   for (int k = naz; k < nbz; k++)
   {
@@ -125,9 +200,11 @@ void AnalyticScalarField::Polygonize(int n, Mesh& g, const Box& box, const doubl
       for (int j = nay; j < nby; j++)
       {
         v[i * ny + j] = clipped[0] + Vector(i * d[0], j * d[1], zb);
-        b[i * ny + j] = Value(v[i * ny + j]);
+        b[i * ny + j] = Sample(i, j, k + 1, v[i * ny + j]);
       }
     }
+    if (record != nullptr)
+      record->AddLayer(b);
 
     // Compute straddling edges inside lower Oxy plane
     for (int i = nax; i < nbx - 1; i++)
@@ -223,6 +300,12 @@ void AnalyticScalarField::Polygonize(int n, Mesh& g, const Box& box, const doubl
     std::swap(eax, ebx);
     std::swap(eay, eby);
     std::swap(u, v);
+
+    if (progress && !progress(double(k + 1) / nbz))
+    {
+      cancelled = true;
+      break;
+    }
   }
 
   delete[]a;
@@ -236,9 +319,19 @@ void AnalyticScalarField::Polygonize(int n, Mesh& g, const Box& box, const doubl
   delete[]eby;
   delete[]ez;
 
+  if (cancelled)
+    return false;
+
+  if (record != nullptr)
+  {
+    record->Finish();
+    cache->Insert(hash, box, n, record);
+  }
+
   std::vector<size_t> normals = triangle;
 
-  g = Mesh(vertex, normal, triangle, normals);
+  g = Mesh(std::move(vertex), std::move(normal), std::move(triangle), std::move(normals));
+  return true;
 }
 
 /*!
@@ -252,6 +345,8 @@ void AnalyticScalarField::Polygonize(int n, Mesh& g, const Box& box, const doubl
 */
 Vector AnalyticScalarField::Dichotomy(Vector a, Vector b, double va, double vb, double length, const double& epsilon) const
 {
+  FieldProfiler::Scope scope(FieldProfiler::Dichotomy);
+
   int ia = va > 0.0 ? 1 : -1;
 
   // Get an accurate first guess
@@ -283,6 +378,8 @@ Vector AnalyticScalarField::Dichotomy(Vector a, Vector b, double va, double vb,
 */
 Vector AnalyticScalarField::Gradient(const Vector& p) const
 {
+  FieldProfiler::Scope scope(FieldProfiler::Gradient);
+
   double x = Value(Vector(p[0] + Epsilon, p[1], p[2])) - Value(Vector(p[0] - Epsilon, p[1], p[2]));
   double y = Value(Vector(p[0], p[1] + Epsilon, p[2])) - Value(Vector(p[0], p[1] - Epsilon, p[2]));
   double z = Value(Vector(p[0], p[1], p[2] + Epsilon)) - Value(Vector(p[0], p[1], p[2] - Epsilon));
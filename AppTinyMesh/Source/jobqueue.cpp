@@ -0,0 +1,160 @@
+#include "jobqueue.h"
+
+/*!
+\class JobQueue jobqueue.h
+
+\brief Queue of jobs run by worker threads.
+
+The queue is used to generate meshes without blocking the user interface. Jobs are
+plain functions taking a Job handle; they should poll Job::Cancelled(), or report their
+progress with Job::Progress() which returns false once they have been superseded, and
+return early when cancelled.
+
+Jobs never touch OpenGL or widgets: results are handed back to the user interface thread
+by the job itself, for instance with a queued Qt invocation.
+*/
+
+/*!
+\brief Create a job handle.
+\param queue Queue running the job.
+\param generation Generation of the job.
+\param progress Progress callback.
+*/
+JobQueue::Job::Job(const JobQueue* queue, unsigned int generation, const std::function<void(double)>& progress) : queue(queue), generation(generation), progress(progress)
+{
+}
+
+/*!
+\brief Check if the job has been superseded by a newer submission or cancelled.
+*/
+bool JobQueue::Job::Cancelled() const
+{
+  return generation != queue->Generation();
+}
+
+/*!
+\brief Report the progress of the job.
+\param t Fraction of the work done, in [0,1].
+\return False if the job has been cancelled and should stop.
+*/
+bool JobQueue::Job::Progress(double t) const
+{
+  if (Cancelled())
+    return false;
+  if (progress)
+    progress(t);
+  return true;
+}
+
+/*!
+\brief Start the worker threads.
+\param n Number of workers.
+*/
+JobQueue::JobQueue(int n) : generation(0)
+{
+  for (int i = 0; i < n; i++)
+    workers.emplace_back(&JobQueue::Run, this);
+}
+
+/*!
+\brief Cancel all the jobs and join the workers.
+*/
+JobQueue::~JobQueue()
+{
+  Cancel();
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stop = true;
+  }
+  wake.notify_all();
+  for (std::thread& worker : workers)
+    worker.join();
+}
+
+/*!
+\brief Submit a job that supersedes all the previous ones, which are cancelled.
+\param task Job.
+\param progress Progress callback, called from the worker thread.
+\return Generation of the job.
+*/
+unsigned int JobQueue::Submit(const Task& task, const std::function<void(double)>& progress)
+{
+  Cancel();
+  return Push(task, progress);
+}
+
+/*!
+\brief Add a job to the current generation, without cancelling the previous ones.
+\param task Job.
+\param progress Progress callback, called from the worker thread.
+\return Generation of the job.
+*/
+unsigned int JobQueue::Push(const Task& task, const std::function<void(double)>& progress)
+{
+  unsigned int g;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    g = generation.load();
+    pending.push_back(Entry{ task, progress, g });
+  }
+  wake.notify_one();
+  return g;
+}
+
+/*!
+\brief Cancel the pending and running jobs.
+
+Pending jobs are dropped, running jobs are notified through their handle and finish asynchronously.
+*/
+void JobQueue::Cancel()
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  generation++;
+  pending.clear();
+  idle.notify_all();
+}
+
+/*!
+\brief Wait until all the jobs are completed.
+*/
+void JobQueue::Wait()
+{
+  std::unique_lock<std::mutex> lock(mutex);
+  idle.wait(lock, [this]() { return pending.empty() && running == 0; });
+}
+
+/*!
+\brief Check if some jobs are pending or running.
+*/
+bool JobQueue::Busy()
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  return !pending.empty() || running > 0;
+}
+
+/*!
+\brief Loop of the worker threads.
+*/
+void JobQueue::Run()
+{
+  std::unique_lock<std::mutex> lock(mutex);
+  while (true)
+  {
+    wake.wait(lock, [this]() { return stop || !pending.empty(); });
+    if (stop)
+      return;
+
+    Entry entry = std::move(pending.front());
+    pending.pop_front();
+    running++;
+
+    lock.unlock();
+    Job job(this, entry.generation, entry.progress);
+    if (!job.Cancelled())
+      entry.task(job);
+    lock.lock();
+
+    running--;
+    idle.notify_all();
+  }
+}
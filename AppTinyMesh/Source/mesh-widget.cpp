@@ -18,200 +18,224 @@
 MeshWidget::MeshGL::MeshGL()
 {
     enabled = true;
+    compact = false;
     useWireframe = false;
     shading = MeshShading::Triangles;
     material = MeshMaterial::Normal;
 
-    vao = 0;
-    fullBuffer = 0;
-    indexBuffer = 0;
+    pool = nullptr;
     triangleCount = 0;
+    acmr = 0.0;
+    acmrInput = 0.0;
+    error = 0.0;
+    level = 0;
+    instanceDirty = false;
+    instanceBuffer = 0;
+    instanceTexture = 0;
     SetFrame(Vector::Null);
 }
 
 /*!
 \brief Constructor from a Mesh and a frame scaled.
+
+The mesh is converted into a CompactMesh optimized for rendering, and drawn indexed.
 */
-MeshWidget::MeshGL::MeshGL(const Mesh& mesh, const Vector& position) : MeshGL()
+MeshWidget::MeshGL::MeshGL(MeshPool& pool, const Mesh& mesh, const Vector& position, bool compact) : MeshGL(pool, CompactMesh(mesh).Optimize(), position, compact)
 {
-    SetFrame(position);
-    bbox = mesh.GetBox();
-
-    // Compute plain arrays of sorted vertices & normals
-    std::vector<size_t> vertexIndexes = mesh.VertexIndexes();
-    std::vector<size_t> normalIndexes = mesh.NormalIndexes();
-    assert(vertexIndexes.size() == normalIndexes.size());
-
-    int nbVertex = int(vertexIndexes.size());
-    int singleBufferSize = nbVertex * 3;
-    float* vertices = new float[singleBufferSize];
-    float* normals = new float[singleBufferSize];
-    for (int i = 0; i < nbVertex; i++)
-    {
-        int indexVertex = vertexIndexes[i];
-        int indexNormal = normalIndexes[i];
-
-        Vector vertex = mesh.Vertex(indexVertex);
-        vertices[i * 3 + 0] = float(vertex[0]);
-        vertices[i * 3 + 1] = float(vertex[1]);
-        vertices[i * 3 + 2] = float(vertex[2]);
-
-        Vector normal = mesh.Normal(indexNormal);
-        normals[i * 3 + 0] = float(normal[0]);
-        normals[i * 3 + 1] = float(normal[1]);
-        normals[i * 3 + 2] = float(normal[2]);
-    }
-    // Indices are now sorted
-    unsigned int* indices = new unsigned int[nbVertex];
-    for (unsigned int i = 0; i < nbVertex; i++)
-        indices[i] = i;
-    triangleCount = nbVertex;
-
-    // Generate vao & buffers
-    if (vao == 0)
-        glGenVertexArrays(1, &vao);
-    if (fullBuffer == 0)
-        glGenBuffers(1, &fullBuffer);
-    if (indexBuffer == 0)
-        glGenBuffers(1, &indexBuffer);
-
-
-    glBindVertexArray(vao);
-    size_t fullSize = sizeof(float) * singleBufferSize
-            + sizeof(float) * singleBufferSize;
-    glBindBuffer(GL_ARRAY_BUFFER, fullBuffer);
-    glBufferData(GL_ARRAY_BUFFER, fullSize, nullptr, GL_STATIC_DRAW);
-
-    // Vertices(0)
-    size_t size = 0;
-    size_t offset = 0;
-    size = sizeof(float) * singleBufferSize;
-    glBufferSubData(GL_ARRAY_BUFFER, offset, size, vertices);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (const void*)offset);
-    glEnableVertexAttribArray(0);
-
-    // Normals(1)
-    offset = offset + size;
-    size = sizeof(float) * singleBufferSize;
-    glBufferSubData(GL_ARRAY_BUFFER, offset, size, normals);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, (const void*)offset);
-    glEnableVertexAttribArray(1);
-
-    // Triangles
-    glGenBuffers(1, &indexBuffer);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int) * nbVertex, indices, GL_STATIC_DRAW);
-
-    // Free data
-    delete[] vertices;
-    delete[] normals;
-    delete[] indices;
 }
 
 /*!
 \brief Constructor from a MeshColor and a frame scaled.
+\sa MeshGL(MeshPool&, const Mesh&, const Vector&, bool)
+*/
+MeshWidget::MeshGL::MeshGL(MeshPool& pool, const MeshColor& mesh, const Vector& fr, bool compact) : MeshGL(pool, CompactMesh(mesh).Optimize(), fr, compact)
+{
+}
+
+/*!
+\brief Constructor from a CompactMesh and a frame scaled.
+
+The arrays of the compact mesh are uploaded as they are, without any conversion, or packed in
+the compact vertex format, into the buffers of the pool, and the mesh is drawn indexed.
 */
-MeshWidget::MeshGL::MeshGL(const MeshColor& mesh, const Vector& fr) : MeshGL()
+MeshWidget::MeshGL::MeshGL(MeshPool& pool, const CompactMesh& mesh, const Vector& fr, bool compact) : MeshGL()
 {
+    this->compact = compact;
     SetFrame(fr);
+    Allocate(pool, mesh);
+    Upload(mesh, 0, Bytes(mesh), false);
+}
+
+/*!
+\brief Compute the sizes of the positions, normals and colors of a mesh in the vertex buffer.
+
+The compact format stores 16 bits quantized positions, octahedral normals on 2 x 16 bits and RGBA8
+colors, that is 14 bytes per vertex instead of 36.
+\param mesh The mesh.
+\param compact Compact vertex format flag.
+\param sizes Sizes in bytes.
+*/
+static void VertexSections(const CompactMesh& mesh, bool compact, size_t sizes[3])
+{
+    const size_t n = size_t(mesh.Vertexes());
+    sizes[0] = compact ? 6 * n : sizeof(float) * 3 * n;
+    sizes[1] = compact ? 4 * n : sizeof(float) * 3 * n;
+    sizes[2] = mesh.HasColors() ? (compact ? 4 * n : sizeof(float) * 3 * n) : 0;
+}
+
+/*!
+\brief Allocate the vertices and the indexes of a compact mesh in the pool, without uploading the data.
+\param pool The pool.
+\param mesh The mesh.
+\sa Upload()
+*/
+void MeshWidget::MeshGL::Allocate(MeshPool& pool, const CompactMesh& mesh)
+{
     bbox = mesh.GetBox();
+    triangleCount = mesh.Indexes();
+    acmr = mesh.ACMR();
+    acmrInput = mesh.InputACMR();
+
+    this->pool = &pool;
+    range = pool.Allocate(compact, mesh.HasColors(), mesh.Vertexes(), mesh.Indexes());
+}
+
+/*!
+\brief Number of bytes uploaded for a compact mesh.
+\param mesh The mesh.
+*/
+size_t MeshWidget::MeshGL::Bytes(const CompactMesh& mesh) const
+{
+    size_t sizes[3];
+    VertexSections(mesh, compact, sizes);
+    return sizes[0] + sizes[1] + sizes[2] + sizeof(uint32_t) * mesh.Indexes();
+}
 
-    // Compute plain arrays of sorted vertices & normals
-    std::vector<size_t> vertexIndexes = mesh.VertexIndexes();
-    std::vector<size_t> normalIndexes = mesh.NormalIndexes();
-    std::vector<size_t> colorIndexes = mesh.ColorIndexes();
-    assert(vertexIndexes.size() == normalIndexes.size());
-
-    int nbVertex = int(vertexIndexes.size());
-    int singleBufferSize = nbVertex * 3;
-    float* vertices = new float[singleBufferSize];
-    float* normals = new float[singleBufferSize];
-    float* colors = new float[singleBufferSize];
-    for (int i = 0; i < nbVertex; i++)
-    {
-        int indexVertex = vertexIndexes[i];
-        int indexNormal = normalIndexes[i];
-        int indexColor = colorIndexes[i];
-
-        Vector vertex = mesh.Vertex(indexVertex);
-        vertices[i * 3 + 0] = float(vertex[0]);
-        vertices[i * 3 + 1] = float(vertex[1]);
-        vertices[i * 3 + 2] = float(vertex[2]);
-
-        Vector normal = mesh.Normal(indexNormal);
-        normals[i * 3 + 0] = float(normal[0]);
-        normals[i * 3 + 1] = float(normal[1]);
-        normals[i * 3 + 2] = float(normal[2]);
-
-        Color color = mesh.GetColor(indexColor);
-        colors[i * 3 + 0] = float(color[0]);
-        colors[i * 3 + 1] = float(color[1]);
-        colors[i * 3 + 2] = float(color[2]);
-    }
-    // Indices are now sorted
-    int* indices = new int[nbVertex];
-    for (int i = 0; i < nbVertex; i++)
-        indices[i] = i;
-    triangleCount = nbVertex;
-
-    // Generate vao & buffers
-    if (vao == 0)
-        glGenVertexArrays(1, &vao);
-    if (fullBuffer == 0)
-        glGenBuffers(1, &fullBuffer);
-    if (indexBuffer == 0)
-        glGenBuffers(1, &indexBuffer);
-
-    glBindVertexArray(vao);
-    size_t fullSize =
-            sizeof(float) * singleBufferSize	// Vertices
-            + sizeof(float) * singleBufferSize	// Normals
-            + sizeof(float) * singleBufferSize;	// Colors
-    glBindBuffer(GL_ARRAY_BUFFER, fullBuffer);
-    glBufferData(GL_ARRAY_BUFFER, fullSize, nullptr, GL_STATIC_DRAW);
-
-    // Vertices(0)
-    size_t size = 0;
-    size_t offset = 0;
-    size = sizeof(float) * singleBufferSize;
-    glBufferSubData(GL_ARRAY_BUFFER, offset, size, vertices);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (const void*)offset);
-    glEnableVertexAttribArray(0);
-
-    // Normals(1)
-    offset = offset + size;
-    size = sizeof(float) * singleBufferSize;
-    glBufferSubData(GL_ARRAY_BUFFER, offset, size, normals);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, (const void*)offset);
-    glEnableVertexAttribArray(1);
-
-    // Colors(2)
-    offset = offset + size;
-    size = sizeof(float) * singleBufferSize;
-    glBufferSubData(GL_ARRAY_BUFFER, offset, size, colors);
-    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 0, (const void*)offset);
-    glEnableVertexAttribArray(2);
-
-    // Triangles
-    glGenBuffers(1, &indexBuffer);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(size_t) * nbVertex, indices, GL_STATIC_DRAW);
-
-    // Free data
-    delete[] vertices;
-    delete[] normals;
-    delete[] colors;
-    delete[] indices;
-}
-
-/*!
-\brief Delete all opengl buffers.
+/*!
+\brief Upload a range of the data of a compact mesh into the ranges allocated by Allocate().
+
+The data is seen as the positions, normals, colors and indexes laid end to end, so that a large
+mesh can be uploaded in several pieces over several frames. Vertices in the compact format are
+packed piece by piece, so that the conversion is spread over the frames too.
+\param mesh The mesh.
+\param first First byte.
+\param count Maximum number of bytes.
+\param stream Streaming flag, the data goes through the staging ring of the pool, see MeshPool::Write().
+\return Number of bytes uploaded.
+*/
+size_t MeshWidget::MeshGL::Upload(const CompactMesh& mesh, size_t first, size_t count, bool stream)
+{
+    size_t sizes[3];
+    VertexSections(mesh, compact, sizes);
+    const MeshPool::Page* page = range.page;
+    struct Segment
+    {
+        GLuint buffer;
+        size_t offset;
+        const void* data;   // Data, null if packed on the fly
+        size_t size;
+        size_t stride;      // Size of a packed vertex
+    };
+    const Segment segments[4] = {
+        { page->vertexBuffer, page->Offset(0) + range.vertex * page->Stride(0), compact ? nullptr : mesh.Positions(), sizes[0], 6 },
+        { page->vertexBuffer, page->Offset(1) + range.vertex * page->Stride(1), compact ? nullptr : mesh.Normals(), sizes[1], 4 },
+        { page->vertexBuffer, page->Offset(2) + range.vertex * page->Stride(2), compact ? nullptr : mesh.Colors(), sizes[2], 4 },
+        { page->indexBuffer, sizeof(uint32_t) * range.index, mesh.Indices(), sizeof(uint32_t) * mesh.Indexes(), 0 },
+    };
+
+    size_t uploaded = 0;
+    size_t start = 0;
+    std::vector<unsigned char> packed;
+    for (int s = 0; s < 4; s++)
+    {
+        const Segment& segment = segments[s];
+        const size_t a = std::max(first, start);
+        const size_t b = std::min(first + count, start + segment.size);
+        if (a < b)
+        {
+            const char* data = nullptr;
+            if (segment.data != nullptr)
+                data = (const char*)segment.data + (a - start);
+            else
+            {
+                // Pack the vertices covering the range
+                const int v0 = int((a - start) / segment.stride);
+                const int v1 = std::min(int((b - start + segment.stride - 1) / segment.stride), mesh.Vertexes());
+                packed.assign((v1 - v0) * segment.stride, 0);
+                if (s == 0)
+                    mesh.PackPositions(bbox, v0, v1 - v0, (uint16_t*)packed.data());
+                else if (s == 1)
+                    mesh.PackNormals(v0, v1 - v0, (int16_t*)packed.data());
+                else
+                    mesh.PackColors(v0, v1 - v0, packed.data());
+                data = (const char*)packed.data() + (a - start - v0 * segment.stride);
+            }
+            const size_t n = pool->Write(segment.buffer, segment.offset + (a - start), data, b - a, stream);
+            uploaded += n;
+            if (n < b - a)
+                break;
+        }
+        start += segment.size;
+    }
+    return uploaded;
+}
+
+/*!
+\brief Release the ranges of the mesh in the pool and delete the opengl buffers of the instances.
 */
 void MeshWidget::MeshGL::Delete()
 {
-    glDeleteVertexArrays(1, &vao);
-    glDeleteBuffers(1, &fullBuffer);
-    glDeleteBuffers(1, &indexBuffer);
+    if (pool != nullptr)
+        pool->Free(range);
+    glDeleteBuffers(1, &instanceBuffer);
+    glDeleteTextures(1, &instanceTexture);
+    for (MeshGL& lod : lods)
+        lod.Delete();
+    lods.clear();
+}
+
+/*!
+\brief Add a coarser level of detail.
+\param mesh The coarser mesh.
+\param e Geometric error of the coarser mesh, in the units of the mesh.
+*/
+void MeshWidget::MeshGL::AddLevel(const CompactMesh& mesh, double e)
+{
+    MeshGL lod(*pool, mesh, Vector::Null, compact);
+    lod.error = e;
+    std::vector<MeshGL>::iterator i = lods.begin();
+    while (i != lods.end() && i->error < e)
+        i++;
+    lods.insert(i, lod);
+}
+
+/*!
+\brief Return the level of detail to be drawn.
+*/
+const MeshWidget::MeshGL& MeshWidget::MeshGL::Level() const
+{
+    return (level == 0) ? *this : lods[level - 1];
+}
+
+/*!
+\brief Select the coarsest level of detail the error of which projects within a tolerance.
+
+Coarser levels are selected with a stricter tolerance than finer ones, so that
+a mesh near the threshold does not switch back and forth between two levels.
+\param pixels Number of pixels covered by a unit length at the distance of the mesh.
+\param tolerance Maximum projected error, in pixels.
+*/
+void MeshWidget::MeshGL::SelectLevel(double pixels, double tolerance)
+{
+    const double hysteresis = 0.75;
+    const int levels = int(lods.size());
+    if (level > levels)
+        level = levels;
+
+    while (level > 0 && lods[level - 1].error * pixels > tolerance)
+        level--;
+    while (level < levels && lods[level].error * pixels <= tolerance * hysteresis)
+        level++;
 }
 
 /*!
@@ -240,8 +264,124 @@ void MeshWidget::MeshGL::SetFrame(const Vector& fr)
 
     // Scale
     TRSMatrix[15] = 1.0;
+
+    instanceDirty = true;
+}
+
+
+/*!
+\brief Compute the box of the mesh transformed by its frame, including all its instances if any.
+*/
+Box MeshWidget::MeshGL::WorldBox() const
+{
+    return Transformed(instances.empty() ? bbox : Box(bbox[0] + instanceBox[0], bbox[1] + instanceBox[1]));
+}
+
+/*!
+\brief Compute the box of the world box of one instance of the mesh.
+\param i Instance.
+*/
+Box MeshWidget::MeshGL::InstanceBox(int i) const
+{
+    const Vector offset(instances[4 * i], instances[4 * i + 1], instances[4 * i + 2]);
+    return Transformed(Box(bbox[0] + offset, bbox[1] + offset));
+}
+
+/*!
+\brief Compute the bounding box of a box transformed by the frame of the mesh.
+\param box The box.
+*/
+Box MeshWidget::MeshGL::Transformed(const Box& box) const
+{
+    // Transform the center and the half diagonal by the absolute value of the matrix
+    Vector c = box.Center();
+    Vector e = 0.5 * box.Diagonal();
+    Vector wc, we;
+    for (int r = 0; r < 3; r++)
+    {
+        wc[r] = TRSMatrix[12 + r];
+        we[r] = 0.0;
+        for (int k = 0; k < 3; k++)
+        {
+            wc[r] += TRSMatrix[4 * k + r] * c[k];
+            we[r] += fabs(TRSMatrix[4 * k + r]) * e[k];
+        }
+    }
+    return Box(wc - we, wc + we);
+}
+
+/*!
+\brief Draw the mesh as a set of translated instances.
+
+Instances share the buffers of the mesh and of its levels of detail, and are drawn with a single
+instanced draw call. Their offsets are stored in a buffer texture read by the vertex shader.
+The OpenGL context must be current.
+\param offsets Offsets of the instances in the frame of the mesh, the mesh is not instanced if empty.
+*/
+void MeshWidget::MeshGL::SetInstances(const std::vector<Vector>& offsets)
+{
+    instances.clear();
+    for (const Vector& offset : offsets)
+        instances.insert(instances.end(), { GLfloat(offset[0]), GLfloat(offset[1]), GLfloat(offset[2]), 0.0f });
+    instanceBox = offsets.empty() ? Box::Null : Box(offsets);
+    if (instanceBuffer == 0)
+    {
+        glGenBuffers(1, &instanceBuffer);
+        glGenTextures(1, &instanceTexture);
+        glBindBuffer(GL_TEXTURE_BUFFER, instanceBuffer);
+        glBufferData(GL_TEXTURE_BUFFER, 0, nullptr, GL_STREAM_DRAW);
+        glBindTexture(GL_TEXTURE_BUFFER, instanceTexture);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, instanceBuffer);
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    }
+    visible.clear();
+    instanceDirty = true;
 }
 
+/*!
+\brief Select the instances to be drawn, and upload their offsets if they changed.
+
+Instances are culled against the frustum with a hierarchy of their world boxes, which is rebuilt
+when the instances or the frame of the mesh change.
+\param frustum The frustum, null to draw all the instances.
+*/
+void MeshWidget::MeshGL::CullInstances(const Frustum* frustum)
+{
+    const int n = int(instances.size() / 4);
+    const bool dirty = instanceDirty;
+    if (instanceDirty)
+    {
+        std::vector<Box> boxes(n);
+        for (int i = 0; i < n; i++)
+            boxes[i] = InstanceBox(i);
+        instanceTree = BoxTree(boxes);
+        instanceDirty = false;
+    }
+
+    std::vector<int> drawn;
+    if (frustum)
+    {
+        instanceTree.Cull(*frustum, drawn);
+        std::sort(drawn.begin(), drawn.end());
+    }
+    else
+    {
+        drawn.resize(n);
+        for (int i = 0; i < n; i++)
+            drawn[i] = i;
+    }
+    if (!dirty && drawn == visible)
+        return;
+    visible.swap(drawn);
+
+    std::vector<GLfloat> data(4 * visible.size());
+    for (int i = 0; i < int(visible.size()); i++)
+        std::copy(instances.begin() + 4 * visible[i], instances.begin() + 4 * visible[i] + 4, data.begin() + 4 * i);
+    glBindBuffer(GL_TEXTURE_BUFFER, instanceBuffer);
+    glBufferData(GL_TEXTURE_BUFFER, sizeof(GLfloat) * data.size(), data.data(), GL_STREAM_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
 
 /*!
 \brief Default constructor.
@@ -258,8 +398,14 @@ MeshWidget::~MeshWidget()
     // Destroy all meshes
     ClearAll();
 
-    // Release shader
-    release_program(mainShaderProgram);
+    // Release buffers and shaders
+    pool.Release();
+    glDeleteBuffers(1, &objectBuffer);
+    glDeleteBuffers(1, &commandBuffer);
+    mainShader.Release();
+    batchShader.Release();
+    skyboxShader.Release();
+    glDeleteBuffers(1, &frameBuffer);
 }
 
 /*!
@@ -306,15 +452,45 @@ void MeshWidget::initializeGL()
     // Shader/Camera/Profiler
     QString fullPath = shaderPath + usedMeshShader;
     QByteArray ba = fullPath.toLocal8Bit();
-    mainShaderProgram = read_program(ba.data());
+    mainShader.Load(ba.data());
+    mainShader.UniformBlock("Frame", 0);
+    uTRSMatrix = mainShader.Uniform("TRSMatrix");
+    uUseWireframe = mainShader.Uniform("useWireframe");
+    uMaterial = mainShader.Uniform("material");
+    uShading = mainShader.Uniform("shading");
+    uUseInstances = mainShader.Uniform("useInstances");
+    uCompactVertices = mainShader.Uniform("compactVertices");
+    uPositionOrigin = mainShader.Uniform("positionOrigin");
+    uPositionScale = mainShader.Uniform("positionScale");
+
+    // Same shader reading the per object data from a storage buffer, for indirect multi-draws
+    if (GLEW_VERSION_4_3)
+    {
+        batching = batchShader.Load(ba.data(), "#version 430\n#define BATCHED\n");
+        batchShader.UniformBlock("Frame", 0);
+        glGenBuffers(1, &objectBuffer);
+        glGenBuffers(1, &commandBuffer);
+    }
     camera = Camera(Vector(-10.0), Vector(0.0));
     SetNearAndFarPlane(1.0, 5000.0);
     profiler.Init();
+    pool.Init(uploadBudget);
+
+    // Per frame uniforms
+    glGenBuffers(1, &frameBuffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, frameBuffer);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameUniforms), nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    glBindBufferBase(GL_UNIFORM_BUFFER, 0, frameBuffer);
 
     // Sky
     fullPath = shaderPath + usedSkyShader;
     ba = fullPath.toLocal8Bit();
-    skyboxShader = read_program(ba.data());
+    skyboxShader.Load(ba.data());
+    uCamPos = skyboxShader.Uniform("CamPos");
+    uCamLookAt = skyboxShader.Uniform("CamLookAt");
+    uCamUp = skyboxShader.Uniform("CamUp");
+    uResolution = skyboxShader.Uniform("iResolution");
     glGenVertexArrays(1, &skyboxVAO);
 }
 
@@ -348,6 +524,10 @@ void MeshWidget::paintGL()
     glLoadIdentity();
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+    // Upload part of the queued meshes
+    pool.BeginFrame();
+    UploadPending();
+
     // Move camera
     if (MoveAt)
     {
@@ -363,59 +543,298 @@ void MeshWidget::paintGL()
     gluLookAt(camera.Eye()[0], camera.Eye()[1], camera.Eye()[2], camera.At()[0], camera.At()[1], camera.At()[2], camera.Up()[0], camera.Up()[1], camera.Up()[2]);
 
     // Sky
+    profiler.BeginFrame();
+    profiler.Begin(RenderingProfiler::Skybox);
     glEnable(GL_DEPTH_TEST);
     glDepthFunc(GL_LEQUAL);
-    glUseProgram(skyboxShader);
+    skyboxShader.Use();
     glBindVertexArray(skyboxVAO);
-    glUniform3f(glGetUniformLocation(skyboxShader, "CamPos"), camera.Eye()[0], camera.Eye()[1], camera.Eye()[2]);
-    glUniform3f(glGetUniformLocation(skyboxShader, "CamAt"), camera.At()[0], camera.At()[1], camera.At()[2]);
-    glUniform3f(glGetUniformLocation(skyboxShader, "CamUp"), camera.Up()[0], camera.Up()[1], camera.Up()[2]);
-    glUniform2f(glGetUniformLocation(skyboxShader, "iResolution"), width(), height());
+    glUniform3f(skyboxShader.Location(uCamPos), camera.Eye()[0], camera.Eye()[1], camera.Eye()[2]);
+    glUniform3f(skyboxShader.Location(uCamLookAt), camera.At()[0], camera.At()[1], camera.At()[2]);
+    glUniform3f(skyboxShader.Location(uCamUp), camera.Up()[0], camera.Up()[1], camera.Up()[2]);
+    glUniform2f(skyboxShader.Location(uResolution), width(), height());
     glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    profiler.End(RenderingProfiler::Skybox);
 
     // Draw meshes
-    profiler.BeginGPU();
-    GLfloat ModelViewMatrix[16];
-    GLfloat ProjectionMatrix[16];
-    glGetFloatv(GL_MODELVIEW_MATRIX, ModelViewMatrix);
-    glGetFloatv(GL_PROJECTION_MATRIX, ProjectionMatrix);
-    glUseProgram(mainShaderProgram);
-
-    // Shared uniforms
-    glUniformMatrix4fv(glGetUniformLocation(mainShaderProgram, "ModelViewMatrix"), 1, 0, ModelViewMatrix);
-    glUniformMatrix4fv(glGetUniformLocation(mainShaderProgram, "ProjectionMatrix"), 1, 0, ProjectionMatrix);
-    Vector view = Normalized(camera.View());
-    glUniform3f(glGetUniformLocation(mainShaderProgram, "viewDir"), view[0], view[1], view[2]);
+    profiler.Begin(RenderingProfiler::Meshes);
 
-    for (MeshIterator i = objects.begin(); i != objects.end(); i++)
+    // Shared uniforms, uploaded once per frame
+    FrameUniforms frame;
+    glGetFloatv(GL_MODELVIEW_MATRIX, frame.ModelViewMatrix);
+    glGetFloatv(GL_PROJECTION_MATRIX, frame.ProjectionMatrix);
+    Vector view = Normalized(camera.View());
+    frame.viewDir[0] = float(view[0]);
+    frame.viewDir[1] = float(view[1]);
+    frame.viewDir[2] = float(view[2]);
+    frame.WIN_SCALE[0] = width() / 2.0f;
+    frame.WIN_SCALE[1] = height() / 2.0f;
+    glBindBuffer(GL_UNIFORM_BUFFER, frameBuffer);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameUniforms), &frame);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+    // Frustum culling
+    GLfloat clip[16];
+    for (int c = 0; c < 4; c++)
     {
-        if (!i.value()->enabled)
-            continue;
+        for (int r = 0; r < 4; r++)
+        {
+            clip[4 * c + r] = 0.0f;
+            for (int k = 0; k < 4; k++)
+                clip[4 * c + r] += frame.ProjectionMatrix[4 * k + r] * frame.ModelViewMatrix[4 * c + k];
+        }
+    }
+    const Frustum frustum(clip);
+    CullObjects(frustum);
+    SelectLevels();
+    for (MeshGL* object : drawList)
+    {
+        if (!object->instances.empty())
+            object->CullInstances(useCulling ? &frustum : nullptr);
+    }
 
+    // Objects that are not instanced are drawn in batches, the others one by one
+    drawCalls = 0;
+    singles.clear();
+    batched.clear();
+    for (MeshGL* object : drawList)
+    {
+        if (batching && useBatching && object->instances.empty())
+            batched.push_back(object);
+        else
+            singles.push_back(object);
+    }
+    DrawBatches();
+
+    mainShader.Use();
+    const GLint locTRSMatrix = mainShader.Location(uTRSMatrix);
+    const GLint locUseWireframe = mainShader.Location(uUseWireframe);
+    const GLint locMaterial = mainShader.Location(uMaterial);
+    const GLint locShading = mainShader.Location(uShading);
+    const GLint locUseInstances = mainShader.Location(uUseInstances);
+    const GLint locCompactVertices = mainShader.Location(uCompactVertices);
+    const GLint locPositionOrigin = mainShader.Location(uPositionOrigin);
+    const GLint locPositionScale = mainShader.Location(uPositionScale);
+    for (MeshGL* object : singles)
+    {
         // Uniforms
-        glUniform2f(glGetUniformLocation(mainShaderProgram, "WIN_SCALE"), width() / 2.0f, height() / 2.0f);
-        glUniformMatrix4fv(glGetUniformLocation(mainShaderProgram, "TRSMatrix"), 1, GL_FALSE, &i.value()->TRSMatrix[0]);
-        glUniform1i(glGetUniformLocation(mainShaderProgram, "useWireframe"), i.value()->useWireframe ? 1 : 0);
-        glUniform1i(glGetUniformLocation(mainShaderProgram, "material"), (int)i.value()->material);
-        glUniform1i(glGetUniformLocation(mainShaderProgram, "shading"), (int)i.value()->shading);
-
-        // Draw
-        glBindVertexArray(i.value()->vao);
-        glDrawElements(GL_TRIANGLES, (GLsizei)i.value()->triangleCount, GL_UNSIGNED_INT, nullptr);
+        glUniformMatrix4fv(locTRSMatrix, 1, GL_FALSE, &object->TRSMatrix[0]);
+        glUniform1i(locUseWireframe, object->useWireframe ? 1 : 0);
+        glUniform1i(locMaterial, (int)object->material);
+        glUniform1i(locShading, (int)object->shading);
+        glUniform1i(locUseInstances, object->instances.empty() ? 0 : 1);
+
+        // Positions of the compact format are quantized in the box of the level
+        const MeshGL& lod = object->Level();
+        const Vector origin = lod.compact ? lod.bbox[0] : Vector::Null;
+        const Vector scale = lod.compact ? lod.bbox.Diagonal() : Vector(1.0);
+        glUniform1i(locCompactVertices, lod.compact ? 1 : 0);
+        glUniform3f(locPositionOrigin, origin[0], origin[1], origin[2]);
+        glUniform3f(locPositionScale, scale[0], scale[1], scale[2]);
+
+        // Draw from the page of the level
+        glBindVertexArray(lod.range.page->vao);
+        const void* indexes = (const void*)(sizeof(uint32_t) * lod.range.index);
+        if (object->instances.empty())
+            glDrawElementsBaseVertex(GL_TRIANGLES, (GLsizei)lod.triangleCount, GL_UNSIGNED_INT, indexes, (GLint)lod.range.vertex);
+        else if (!object->visible.empty())
+        {
+            glBindTexture(GL_TEXTURE_BUFFER, object->instanceTexture);
+            glDrawElementsInstancedBaseVertex(GL_TRIANGLES, (GLsizei)lod.triangleCount, GL_UNSIGNED_INT, indexes, (GLsizei)object->visible.size(), (GLint)lod.range.vertex);
+        }
+        drawCalls++;
     }
-    profiler.EndGPU();
+    glBindVertexArray(0);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    profiler.End(RenderingProfiler::Meshes);
 
     // CPU Profiling
     if (profiler.enabled)
     {
         profiler.Update();
+        profiler.Begin(RenderingProfiler::Overlay);
         RenderStats();
+        profiler.End(RenderingProfiler::Overlay);
     }
+    profiler.EndFrame();
+    pool.EndFrame();
 
     // Schedule next draw
     update();
 }
 
+/*!
+\brief Compute the list of enabled objects that intersect the frustum.
+
+Small scenes are culled object by object, larger ones with a hierarchy of the world boxes of the objects,
+which is rebuilt when objects are added, deleted or moved.
+\param frustum The frustum.
+*/
+void MeshWidget::CullObjects(const Frustum& frustum)
+{
+    drawList.clear();
+    culledCount = 0;
+
+    if (!useCulling || objects.size() < TreeThreshold)
+    {
+        for (MeshIterator i = objects.begin(); i != objects.end(); i++)
+        {
+            if (!i.value()->enabled)
+                continue;
+            if (!useCulling || frustum.Intersect(i.value()->WorldBox()))
+                drawList.push_back(i.value());
+            else
+                culledCount++;
+        }
+        return;
+    }
+
+    if (treeDirty)
+    {
+        treeObjects.clear();
+        std::vector<Box> boxes;
+        for (MeshIterator i = objects.begin(); i != objects.end(); i++)
+        {
+            treeObjects.push_back(i.value());
+            boxes.push_back(i.value()->WorldBox());
+        }
+        objectTree = BoxTree(boxes);
+        treeDirty = false;
+    }
+
+    std::vector<int> visible;
+    objectTree.Cull(frustum, visible);
+    int enabled = 0;
+    for (MeshGL* object : treeObjects)
+        enabled += object->enabled ? 1 : 0;
+    for (int i : visible)
+    {
+        if (treeObjects[i]->enabled)
+            drawList.push_back(treeObjects[i]);
+    }
+    culledCount = enabled - int(drawList.size());
+}
+
+/*!
+\brief Select the level of detail of the objects to be drawn from their distance to the camera.
+*/
+void MeshWidget::SelectLevels()
+{
+    // Pixels per unit length at unit distance in perspective, or at any distance in orthographic projection
+    const double scale = perspectiveProjection
+        ? height() / (2.0 * tan(camera.GetAngleOfViewV(width(), height()) / 2.0))
+        : height() / (2.0 * cameraOrthoSize);
+
+    for (MeshGL* object : drawList)
+    {
+        if (object->lods.empty())
+            continue;
+
+        double pixels = scale;
+        if (perspectiveProjection)
+        {
+            // Distance from the eye to the box of the object
+            const Box box = object->WorldBox();
+            Vector d = Vector::Max(Vector::Max(box[0] - camera.Eye(), camera.Eye() - box[1]), Vector::Null);
+            pixels = scale / std::max(Norm(d), camera.GetNear());
+        }
+        object->SelectLevel(pixels, lodTolerance);
+    }
+}
+
+/*!
+\brief Draw the batched objects with one indirect multi-draw per page of the pool.
+
+Objects of a page share their vertex array, and everything else, that is the transform, the
+material, the shading, the wireframe flag and the quantization box of the positions, is read by
+the shader from a storage buffer, indexed by the base instance of the draw command.
+*/
+void MeshWidget::DrawBatches()
+{
+    if (batched.empty())
+        return;
+
+    // Objects sorted by page, so that the commands of a page are contiguous
+    std::stable_sort(batched.begin(), batched.end(), [](const MeshGL* a, const MeshGL* b)
+    {
+        return std::less<const MeshPool::Page*>()(a->Level().range.page, b->Level().range.page);
+    });
+
+    const size_t n = batched.size();
+    objectData.resize(n);
+    commands.resize(n);
+    for (size_t i = 0; i < n; i++)
+    {
+        const MeshGL* object = batched[i];
+        const MeshGL& lod = object->Level();
+        ObjectData& data = objectData[i];
+        std::copy(object->TRSMatrix, object->TRSMatrix + 16, data.TRSMatrix);
+
+        // Positions of the compact format are quantized in the box of the level
+        const Vector origin = lod.compact ? lod.bbox[0] : Vector::Null;
+        const Vector scale = lod.compact ? lod.bbox.Diagonal() : Vector(1.0);
+        for (int k = 0; k < 3; k++)
+        {
+            data.positionOrigin[k] = GLfloat(origin[k]);
+            data.positionScale[k] = GLfloat(scale[k]);
+        }
+        data.positionOrigin[3] = data.positionScale[3] = 0.0f;
+        data.state[0] = (int)object->material;
+        data.state[1] = (int)object->shading;
+        data.state[2] = object->useWireframe ? 1 : 0;
+        data.state[3] = lod.compact ? 1 : 0;
+
+        DrawCommand& command = commands[i];
+        command.count = GLuint(lod.triangleCount);
+        command.instanceCount = 1;
+        command.firstIndex = GLuint(lod.range.index);
+        command.baseVertex = GLint(lod.range.vertex);
+        command.baseInstance = GLuint(i);
+    }
+    pool.ReserveDraws(n);
+
+    // Buffers are orphaned, so that the frames in flight are not waited for
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, objectBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(ObjectData) * n, objectData.data(), GL_STREAM_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, objectBuffer);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+    glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(DrawCommand) * n, commands.data(), GL_STREAM_DRAW);
+
+    batchShader.Use();
+    for (size_t first = 0; first < n;)
+    {
+        const MeshPool::Page* page = batched[first]->Level().range.page;
+        size_t last = first + 1;
+        while (last < n && batched[last]->Level().range.page == page)
+            last++;
+
+        glBindVertexArray(page->vao);
+        glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (const void*)(sizeof(DrawCommand) * first), GLsizei(last - first), 0);
+        drawCalls++;
+        first = last;
+    }
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
+
+/*!
+\brief Enable or disable the batching of the objects that are not instanced, if supported.
+\param use Flag.
+*/
+void MeshWidget::UseBatching(bool use)
+{
+    useBatching = use;
+}
+
+/*!
+\brief Enable or disable frustum culling.
+\param culling Flag.
+*/
+void MeshWidget::UseCulling(bool culling)
+{
+    useCulling = culling;
+}
+
 /*!
 \brief Add a new mesh in the scene.
 \param mesh new mesh
@@ -424,7 +843,9 @@ void MeshWidget::paintGL()
 void MeshWidget::AddMesh(const QString& name, const Mesh& mesh, const Vector& frame)
 {
     makeCurrent();
-    objects.insert(name, new MeshGL(mesh, frame));
+    DeleteMesh(name);
+    objects.insert(name, new MeshGL(pool, mesh, frame, compactVertices));
+    treeDirty = true;
 }
 
 /*!
@@ -435,20 +856,296 @@ void MeshWidget::AddMesh(const QString& name, const Mesh& mesh, const Vector& fr
 void MeshWidget::AddMesh(const QString& name, const MeshColor& mesh, const Vector& frame)
 {
     makeCurrent();
-    objects.insert(name, new MeshGL(mesh, frame));
+    DeleteMesh(name);
+    objects.insert(name, new MeshGL(pool, mesh, frame, compactVertices));
+    treeDirty = true;
+}
+
+/*!
+\brief Add a new compact mesh in the scene.
+\param mesh new compact mesh
+\param frame mesh frame, identity by default.
+*/
+void MeshWidget::AddMesh(const QString& name, const CompactMesh& mesh, const Vector& frame)
+{
+    makeCurrent();
+    DeleteMesh(name);
+    objects.insert(name, new MeshGL(pool, mesh, frame, compactVertices));
+    treeDirty = true;
+}
+
+/*!
+\brief Add a new compact mesh in the scene with a chain of levels of detail.
+
+Levels are computed by vertex clustering, see CompactMesh::LevelsOfDetail(), and are drawn depending
+on their projected error. Meshes generated in worker threads should rather compute their levels there,
+and queue them with QueueMesh() or QueueScene().
+\param mesh new compact mesh
+\param levels maximum number of coarser levels
+\param frame mesh frame, identity by default.
+\sa SetLevelOfDetailTolerance()
+*/
+void MeshWidget::AddMesh(const QString& name, const CompactMesh& mesh, int levels, const Vector& frame)
+{
+    AddMesh(name, mesh, frame);
+    for (const std::pair<CompactMesh, double>& level : mesh.LevelsOfDetail(levels))
+        AddLevel(name, level.first, level.second);
+}
+
+/*!
+\brief Add a coarser level of detail to a mesh, for instance a polygonization at a coarser resolution.
+\param name mesh name
+\param mesh coarser mesh
+\param error geometric error of the coarser mesh, e.g., the size of its polygonization cells.
+*/
+void MeshWidget::AddLevel(const QString& name, const CompactMesh& mesh, double error)
+{
+    makeCurrent();
+    if (objects.contains(name))
+        objects[name]->AddLevel(mesh, error);
+}
+
+/*!
+\brief Draw a mesh, queued or not, as a set of translated instances.
+
+Repeated geometry, such as the cells of a replicated implicit surface, is uploaded once and drawn
+with a single instanced draw call, and the instances outside of the frustum are culled.
+\param name mesh name
+\param offsets offsets of the instances in the frame of the mesh, the mesh is drawn once if empty.
+\sa Examples::Instanced()
+*/
+void MeshWidget::SetInstances(const QString& name, const std::vector<Vector>& offsets)
+{
+    makeCurrent();
+    if (objects.contains(name))
+    {
+        objects[name]->SetInstances(offsets);
+        treeDirty = true;
+    }
+    for (PendingMesh& entry : pending)
+    {
+        if (entry.name == name)
+            entry.object->SetInstances(offsets);
+    }
+    for (std::pair<QString, MeshGL*>& entry : staged)
+    {
+        if (entry.first == name)
+            entry.second->SetInstances(offsets);
+    }
+}
+
+/*!
+\brief Queue a compact mesh to be uploaded over the next frames.
+
+Large meshes are uploaded in pieces so that no frame stalls on the transfer: at most
+uploadBudget bytes are streamed per frame through the staging ring of the pool, into
+ranges recycled from the meshes deleted or replaced before. The mesh replaces the mesh with the same
+name, if any, once it is completely uploaded, and _signalMeshUploaded() is emitted.
+\param name mesh name
+\param mesh new compact mesh, moved into the queue.
+\param frame mesh frame, identity by default.
+\sa SetUploadBudget()
+*/
+void MeshWidget::QueueMesh(const QString& name, CompactMesh&& mesh, const Vector& frame)
+{
+    QueueMesh(name, std::move(mesh), std::vector<std::pair<CompactMesh, double>>(), frame);
+}
+
+/*!
+\brief Queue a compact mesh and its coarser levels of detail to be uploaded over the next frames.
+
+The levels are streamed after the mesh, and the mesh is added to the scene with all its levels.
+\param name mesh name
+\param mesh new compact mesh, moved into the queue.
+\param levels coarser levels of detail and their geometric errors, moved into the queue, see CompactMesh::LevelsOfDetail().
+\param frame mesh frame, identity by default.
+\sa SetLevelOfDetailTolerance()
+*/
+void MeshWidget::QueueMesh(const QString& name, CompactMesh&& mesh, std::vector<std::pair<CompactMesh, double>>&& levels, const Vector& frame)
+{
+    DeletePending(name);
+
+    PendingMesh entry;
+    entry.name = name;
+    entry.mesh = std::move(mesh);
+    entry.levels = std::move(levels);
+    std::stable_sort(entry.levels.begin(), entry.levels.end(), [](const std::pair<CompactMesh, double>& a, const std::pair<CompactMesh, double>& b) { return a.second < b.second; });
+    entry.object = new MeshGL();
+    entry.object->compact = compactVertices;
+    entry.object->SetFrame(frame);
+    pending.push_back(std::move(entry));
+}
+
+/*!
+\brief Queue a set of compact meshes replacing all the meshes of the scene at once.
+
+The meshes are uploaded over the next frames like QueueMesh(), but kept aside once uploaded:
+the previous meshes are displayed until the last mesh of the set is uploaded, and are then
+replaced all together. Meshes queued before, including another scene, are cancelled.
+\param meshes names, meshes and levels of detail, moved into the queue.
+*/
+void MeshWidget::QueueScene(std::vector<SceneMesh>&& meshes)
+{
+    makeCurrent();
+    for (PendingMesh& entry : pending)
+    {
+        entry.object->Delete();
+        delete entry.object;
+    }
+    pending.clear();
+    for (std::pair<QString, MeshGL*>& entry : staged)
+    {
+        entry.second->Delete();
+        delete entry.second;
+    }
+    staged.clear();
+
+    if (meshes.empty())
+    {
+        ClearAll();
+        return;
+    }
+    for (SceneMesh& mesh : meshes)
+    {
+        QueueMesh(mesh.name, std::move(mesh.mesh), std::move(mesh.levels));
+        pending.back().scene = true;
+    }
+}
+
+/*!
+\brief Set the maximum number of bytes of queued meshes uploaded per frame.
+\param bytes Budget.
+*/
+void MeshWidget::SetUploadBudget(size_t bytes)
+{
+    makeCurrent();
+    uploadBudget = std::max(bytes, size_t(1));
+    pool.SetStagingSize(uploadBudget);
+}
+
+/*!
+\brief Store the vertices of the meshes added next in the compact format.
+
+Positions are quantized on 16 bits in the box of the mesh, normals are octahedral-encoded on
+2 x 16 bits and colors are stored as RGBA8, which divides the memory of the vertices by 2.5,
+and they are decoded in the vertex shader.
+\param use Flag.
+\sa CompactMesh::PackPositions(), CompactMesh::PackNormals()
+*/
+void MeshWidget::UseCompactVertices(bool use)
+{
+    compactVertices = use;
+}
+
+/*!
+\brief Upload the queued meshes within the budget of a frame.
+
+Meshes are uploaded followed by their levels of detail, and completed meshes are added to the scene.
+*/
+void MeshWidget::UploadPending()
+{
+    while (!pending.empty() && pool.Available() > 0)
+    {
+        PendingMesh& entry = pending.front();
+        MeshGL* object = entry.object;
+        MeshGL* target = (entry.level == 0) ? object : &object->lods[entry.level - 1];
+        const CompactMesh& mesh = (entry.level == 0) ? entry.mesh : entry.levels[entry.level - 1].first;
+        if (target->range.page == nullptr)
+            target->Allocate(pool, mesh);
+
+        entry.uploaded += target->Upload(mesh, entry.uploaded, pool.Available(), true);
+        if (entry.uploaded < target->Bytes(mesh))
+            break;
+
+        // Next level of detail, sorted by increasing error
+        if (entry.level < int(entry.levels.size()))
+        {
+            MeshGL lod;
+            lod.compact = object->compact;
+            lod.error = entry.levels[entry.level].second;
+            object->lods.push_back(lod);
+            entry.level++;
+            entry.uploaded = 0;
+            continue;
+        }
+
+        const QString name = entry.name;
+        const bool scene = entry.scene;
+        pending.pop_front();
+        if (scene)
+        {
+            // Meshes of a scene are kept aside until the last one is uploaded, then replace all the meshes
+            staged.push_back(std::make_pair(name, object));
+            if (!pending.empty() && pending.front().scene)
+                continue;
+            for (MeshIterator i = objects.begin(); i != objects.end(); i++)
+            {
+                i.value()->Delete();
+                delete i.value();
+            }
+            objects.clear();
+            for (const std::pair<QString, MeshGL*>& mesh : staged)
+                objects.insert(mesh.first, mesh.second);
+            treeDirty = true;
+            for (const std::pair<QString, MeshGL*>& mesh : staged)
+                emit _signalMeshUploaded(mesh.first);
+            staged.clear();
+            continue;
+        }
+        if (objects.contains(name))
+        {
+            objects[name]->Delete();
+            delete objects[name];
+        }
+        objects.insert(name, object);
+        treeDirty = true;
+        emit _signalMeshUploaded(name);
+    }
+}
+
+/*!
+\brief Remove a mesh from the upload queue.
+\param name mesh name
+*/
+void MeshWidget::DeletePending(const QString& name)
+{
+    for (std::deque<PendingMesh>::iterator i = pending.begin(); i != pending.end();)
+    {
+        if (i->name == name)
+        {
+            makeCurrent();
+            i->object->Delete();
+            delete i->object;
+            i = pending.erase(i);
+        }
+        else
+            i++;
+    }
+}
+
+/*!
+\brief Set the maximum projected error of the levels of detail.
+\param pixels tolerance in pixels.
+*/
+void MeshWidget::SetLevelOfDetailTolerance(double pixels)
+{
+    lodTolerance = pixels;
 }
 
 /*!
-\brief Delete a mesh in the scene from its name.
+\brief Delete a mesh in the scene from its name, and cancel its queued upload if any.
 \param name mesh name
 */
 void MeshWidget::DeleteMesh(const QString& name)
 {
     makeCurrent();
+    DeletePending(name);
     if (objects.contains(name))
     {
         objects[name]->Delete();
+        delete objects[name];
         objects.remove(name);
+        treeDirty = true;
     }
 }
 
@@ -461,7 +1158,10 @@ void MeshWidget::UpdateMesh(const QString& name, const Vector& frame)
 {
     makeCurrent();
     if (objects.contains(name))
+    {
         objects[name]->SetFrame(frame);
+        treeDirty = true;
+    }
 }
 
 /*!
@@ -485,7 +1185,7 @@ void MeshWidget::DisableMesh(const QString& name)
 }
 
 /*!
-\brief Destroys all mesh objects in the scene.
+\brief Destroys all mesh objects in the scene, including the queued ones.
 */
 void MeshWidget::ClearAll()
 {
@@ -496,6 +1196,19 @@ void MeshWidget::ClearAll()
         delete i.value();
     }
     objects.clear();
+    for (PendingMesh& entry : pending)
+    {
+        entry.object->Delete();
+        delete entry.object;
+    }
+    pending.clear();
+    for (std::pair<QString, MeshGL*>& entry : staged)
+    {
+        entry.second->Delete();
+        delete entry.second;
+    }
+    staged.clear();
+    treeDirty = true;
 }
 
 /*!
@@ -623,6 +1336,17 @@ void MeshWidget::SetShadingGlobal(MeshShading shading)
         i.value()->shading = shading;
 }
 
+/*!
+\brief Compile and link the shaders again from their source files, uniform locations are updated.
+*/
+void MeshWidget::ReloadShaders()
+{
+    makeCurrent();
+    mainShader.Reload();
+    if (batching)
+        batchShader.Reload();
+    skyboxShader.Reload();
+}
 
 /*!
 \brief Capture the rendering viewport and save it to disk.
@@ -682,8 +1406,23 @@ void MeshWidget::RenderStats()
 
     const int bX = 10;
     const int bY = 10;
-    const int sizeX = 200;
-    const int sizeY = 65;
+    const int sizeX = 260;
+    const int sizeY = 215;
+
+    // Triangles drawn and their average cache miss ratio, before and after optimization
+    long long triangles = 0;
+    double misses = 0.0, missesInput = 0.0;
+    int instances = 0, instancesDrawn = 0;
+    for (MeshGL* object : drawList)
+    {
+        const MeshGL& lod = object->Level();
+        const int copies = object->instances.empty() ? 1 : int(object->visible.size());
+        triangles += (long long)(lod.triangleCount / 3) * copies;
+        misses += lod.acmr * (lod.triangleCount / 3) * copies;
+        missesInput += lod.acmrInput * (lod.triangleCount / 3) * copies;
+        instances += int(object->instances.size() / 4);
+        instancesDrawn += object->instances.empty() ? 0 : copies;
+    }
 
     // Background
     painter.setPen(penLineGrey);
@@ -698,8 +1437,24 @@ void MeshWidget::RenderStats()
     painter.drawText(10 + 5, bY + 10 + 5, "Statistics");
     painter.setFont(f2);
     painter.drawText(10 + 5, bY + 10 + 20, "CPU FPS:\t" + QString::number(profiler.framePerSecond));
-    painter.drawText(10 + 5, bY + 10 + 35, "CPU Frame:\t" + QString::number(profiler.msPerFrame) + "ms");
-    painter.drawText(10 + 5, bY + 10 + 50, "GPU:\t" + QString::number(profiler.elapsedTimeGPU / 1000000.0) + "ms");
+
+    // Rolling averages and 95th percentiles, in ms
+    const auto timing = [](const RollingStatistics& s)
+    {
+        return QString::number(s.Mean(), 'f', 3) + " / " + QString::number(s.Percentile(95.0), 'f', 3) + "ms";
+    };
+    painter.drawText(10 + 5, bY + 10 + 35, "CPU Frame:\t" + timing(profiler.cpuFrame));
+    painter.drawText(10 + 5, bY + 10 + 50, "GPU:\t" + timing(profiler.gpuFrame));
+    painter.drawText(10 + 5, bY + 10 + 65, "  Sky:\t" + timing(profiler.gpu[RenderingProfiler::Skybox]));
+    painter.drawText(10 + 5, bY + 10 + 80, "  Meshes:\t" + timing(profiler.gpu[RenderingProfiler::Meshes]));
+    painter.drawText(10 + 5, bY + 10 + 95, "  Overlay:\t" + timing(profiler.gpu[RenderingProfiler::Overlay]));
+    painter.drawText(10 + 5, bY + 10 + 110, "Triangles:\t" + QString::number(triangles));
+    painter.drawText(10 + 5, bY + 10 + 125, "ACMR:\t" + QString::number(triangles > 0 ? missesInput / triangles : 0.0, 'f', 3) + " -> " + QString::number(triangles > 0 ? misses / triangles : 0.0, 'f', 3));
+    painter.drawText(10 + 5, bY + 10 + 140, "Dropped queries:\t" + QString::number(profiler.dropped));
+    painter.drawText(10 + 5, bY + 10 + 155, "Drawn / culled:\t" + QString::number(int(drawList.size())) + " / " + QString::number(culledCount));
+    painter.drawText(10 + 5, bY + 10 + 170, "Instances drawn:\t" + QString::number(instancesDrawn) + " / " + QString::number(instances));
+    painter.drawText(10 + 5, bY + 10 + 185, "Pool:\t" + QString::number(int(pool.Used() >> 20)) + " / " + QString::number(int(pool.Memory() >> 20)) + "MB, " + QString::number(pool.Stalls()) + " stalls");
+    painter.drawText(10 + 5, bY + 10 + 200, "Draw calls:\t" + QString::number(drawCalls) + (batching && useBatching ? " (batched)" : ""));
 
     painter.end();
 
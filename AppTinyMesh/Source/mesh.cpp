@@ -1,5 +1,9 @@
 #include "mesh.h"
 
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
 /*!
 \class Mesh mesh.h
 
@@ -39,6 +43,17 @@ Mesh::Mesh(const std::vector<Vector>& vertices, const std::vector<Vector>& norma
 {
 }
 
+/*!
+\brief Create the mesh by moving the arrays into it, without any copy.
+
+\param vertices Array of vertices.
+\param normals Array of normals.
+\param va, na Array of vertex and normal indexes.
+*/
+Mesh::Mesh(std::vector<Vector>&& vertices, std::vector<Vector>&& normals, std::vector<size_t>&& va, std::vector<size_t>&& na) :vertices(std::move(vertices)), normals(std::move(normals)), varray(std::move(va)), narray(std::move(na))
+{
+}
+
 /*!
 \brief Reserve memory for arrays.
 \param nv,nn,nvi,nvn Number of vertices, normals, vertex indexes and vertex normals.
@@ -58,33 +73,101 @@ Mesh::~Mesh()
 {
 }
 
+/*!
+\brief Compute the vertex to corner adjacency of the mesh in compressed row storage.
+
+The corners of vertex i are corners[offsets[i]] to corners[offsets[i + 1] - 1], in increasing order. Corner c
+is the c-th entry of the vertex index array, it belongs to triangle c / 3.
+\param offsets Offsets, size is the number of vertices plus one.
+\param corners Corners, size is the number of vertex indexes.
+*/
+void Mesh::VertexCorners(std::vector<int>& offsets, std::vector<int>& corners) const
+{
+  const int nv = Vertexes();
+  const int nc = int(varray.size());
+
+  // Count corners per vertex
+  offsets.assign(nv + 1, 0);
+  for (int c = 0; c < nc; c++)
+  {
+    offsets[varray[c] + 1]++;
+  }
+  for (int i = 0; i < nv; i++)
+  {
+    offsets[i + 1] += offsets[i];
+  }
+
+  // Fill, corners are visited in increasing order
+  corners.resize(nc);
+  std::vector<int> next(offsets.begin(), offsets.end() - 1);
+  for (int c = 0; c < nc; c++)
+  {
+    corners[next[varray[c]]++] = c;
+  }
+}
+
 /*!
 \brief Smooth the normals of the mesh.
 
-This function weights the normals of the faces by their corresponding area.
-\sa Triangle::AreaNormal()
+Normals are computed in two parallel passes: face normals and corner weights are computed per triangle,
+then every vertex gathers the contributions of its corners through the vertex to corner adjacency.
+There is no concurrent accumulation and the corners of a vertex are always summed in the same order,
+so that the result does not depend on the number of threads.
+
+\param weighting Area weighting uses the area normals of the faces, angle weighting uses the unit normals
+weighted by the angle of the face at the vertex.
+\sa Triangle::AreaNormal(), VertexCorners()
 */
-void Mesh::SmoothNormals()
+void Mesh::SmoothNormals(NormalWeighting weighting)
 {
-  // Initialize
-  normals.resize(vertices.size(), Vector::Null);
+  const int nt = Triangles();
+  const int nv = Vertexes();
+  const bool angle = (weighting == NormalWeighting::Angle);
 
-  narray = varray;
+  // Face normals, and corner angles if needed
+  std::vector<Vector> fn(nt);
+  std::vector<double> angles(angle ? 3 * nt : 0);
 
-  // Accumulate normals
-  for (int i = 0; i < varray.size(); i += 3)
+#pragma omp parallel for schedule(static)
+  for (int t = 0; t < nt; t++)
   {
-    Vector tn = Triangle(vertices[varray.at(i)], vertices[varray.at(i + 1)], vertices[varray.at(i + 2)]).AreaNormal();
-    normals[narray[i + 0]] += tn;
-    normals[narray[i + 1]] += tn;
-    normals[narray[i + 2]] += tn;
+    const Vector& a = vertices[varray[3 * t + 0]];
+    const Vector& b = vertices[varray[3 * t + 1]];
+    const Vector& c = vertices[varray[3 * t + 2]];
+    const Vector ab = b - a;
+    const Vector bc = c - b;
+    const Vector ca = a - c;
+    Vector n = 0.5 * (ab / (c - a));
+    if (angle)
+    {
+      const double l = Norm(n);
+      n = (l > 0.0) ? n / l : Vector::Null;
+      angles[3 * t + 0] = atan2(Norm(ab / ca), -(ab * ca));
+      angles[3 * t + 1] = atan2(Norm(bc / ab), -(bc * ab));
+      angles[3 * t + 2] = atan2(Norm(ca / bc), -(ca * bc));
+    }
+    fn[t] = n;
   }
 
-  // Normalize
-  for (int i = 0; i < normals.size(); i++)
+  std::vector<int> offsets, corners;
+  VertexCorners(offsets, corners);
+
+  // Gather
+  normals.resize(nv);
+#pragma omp parallel for schedule(static)
+  for (int i = 0; i < nv; i++)
   {
-    Normalize(normals[i]);
+    Vector n = Vector::Null;
+    for (int k = offsets[i]; k < offsets[i + 1]; k++)
+    {
+      const int c = corners[k];
+      n += angle ? angles[c] * fn[c / 3] : fn[c / 3];
+    }
+    const double l = Norm(n);
+    normals[i] = (l > 0.0) ? n / l : Vector::Null;
   }
+
+  narray = varray;
 }
 
 /*!
@@ -227,82 +310,131 @@ void Mesh::Scale(double s)
 
 
 
-#include <QtCore/QFile>
-#include <QtCore/QTextStream>
-#include <QtCore/QRegularExpression>
-#include <QtCore/qstring.h>
+/*!
+\brief Parse an index of an .obj file, one based, or negative and relative to the last element.
+\param s Index.
+\param n Number of elements defined so far.
+\param index Returned zero based index.
+\return False if the index is malformed or does not reference an element defined so far.
+*/
+static bool ObjIndex(const std::string& s, size_t n, size_t& index)
+{
+  char* end = nullptr;
+  const long i = std::strtol(s.c_str(), &end, 10);
+  if (end == s.c_str() || *end != '\0' || i == 0)
+    return false;
+  const long long k = (i > 0) ? (long long)i - 1 : (long long)n + i;
+  if (k < 0 || k >= (long long)n)
+    return false;
+  index = size_t(k);
+  return true;
+}
 
 /*!
 \brief Import a mesh from an .obj file.
+
+Faces may reference normals or not, polygons are split into triangle fans.
+Smooth normals are computed for the whole mesh if some faces have none.
 \param filename File name.
+\return False if the file could not be read, or if a face is malformed or references undefined
+vertices or normals, in which case the mesh is left empty.
 */
-void Mesh::Load(const QString& filename)
+bool Mesh::Load(const std::string& filename)
 {
   vertices.clear();
   normals.clear();
   varray.clear();
   narray.clear();
 
-  QFile data(filename);
-
-  if (!data.open(QFile::ReadOnly))
-    return;
-  QTextStream in(&data);
+  std::ifstream in(filename);
+  if (!in)
+    return false;
 
-  // Set of regular expressions : Vertex, Normal, Triangle
-  QRegularExpression rexv("v\\s*([-|+|\\s]\\d*\\.\\d+)\\s*([-|+|\\s]\\d*\\.\\d+)\\s*([-|+|\\s]\\d*\\.\\d+)");
-  QRegularExpression rexn("vn\\s*([-|+|\\s]\\d*\\.\\d+)\\s*([-|+|\\s]\\d*\\.\\d+)\\s*([-|+|\\s]\\d*\\.\\d+)");
-  QRegularExpression rext("f\\s*(\\d*)/\\d*/(\\d*)\\s*(\\d*)/\\d*/(\\d*)\\s*(\\d*)/\\d*/(\\d*)");
-  while (!in.atEnd())
+  std::string line, tag, corner;
+  std::vector<size_t> fv, fn;
+  bool missing = false;
+  while (std::getline(in, line))
   {
-    QString line = in.readLine();
-    QRegularExpressionMatch match = rexv.match(line);
-    QRegularExpressionMatch matchN = rexn.match(line);
-    QRegularExpressionMatch matchT = rext.match(line);
-    if (match.hasMatch())//rexv.indexIn(line, 0) > -1)
+    std::istringstream words(line);
+    if (!(words >> tag))
+      continue;
+    if (tag == "v")
     {
-      Vector q = Vector(match.captured(1).toDouble(), match.captured(2).toDouble(), match.captured(3).toDouble()); vertices.push_back(q);
+      double x = 0.0, y = 0.0, z = 0.0;
+      words >> x >> y >> z;
+      vertices.push_back(Vector(x, y, z));
     }
-    else if (matchN.hasMatch())//rexn.indexIn(line, 0) > -1)
+    else if (tag == "vn")
     {
-      Vector q = Vector(matchN.captured(1).toDouble(), matchN.captured(2).toDouble(), matchN.captured(3).toDouble());  normals.push_back(q);
+      double x = 0.0, y = 0.0, z = 0.0;
+      words >> x >> y >> z;
+      normals.push_back(Vector(x, y, z));
     }
-    else if (matchT.hasMatch())//rext.indexIn(line, 0) > -1)
+    else if (tag == "f")
     {
-      varray.push_back(matchT.captured(1).toInt() - 1);
-      varray.push_back(matchT.captured(3).toInt() - 1);
-      varray.push_back(matchT.captured(5).toInt() - 1);
-      narray.push_back(matchT.captured(2).toInt() - 1);
-      narray.push_back(matchT.captured(4).toInt() - 1);
-      narray.push_back(matchT.captured(6).toInt() - 1);
+      // Corners are v, v/t, v//n or v/t/n, with one based or negative relative indexes
+      fv.clear();
+      fn.clear();
+      while (words >> corner)
+      {
+        const size_t a = corner.find('/');
+        const size_t b = (a == std::string::npos) ? a : corner.find('/', a + 1);
+        size_t v = 0, n = 0;
+        bool valid = ObjIndex(corner.substr(0, a), vertices.size(), v);
+        if (b == std::string::npos || b + 1 == corner.size())
+          missing = true;
+        else
+          valid = valid && ObjIndex(corner.substr(b + 1), normals.size(), n);
+        if (!valid)
+        {
+          vertices.clear();
+          normals.clear();
+          varray.clear();
+          narray.clear();
+          return false;
+        }
+        fv.push_back(v);
+        fn.push_back(n);
+      }
+      for (size_t k = 2; k < fv.size(); k++)
+      {
+        varray.push_back(fv[0]);
+        varray.push_back(fv[k - 1]);
+        varray.push_back(fv[k]);
+        narray.push_back(fn[0]);
+        narray.push_back(fn[k - 1]);
+        narray.push_back(fn[k]);
+      }
     }
   }
-  data.close();
+
+  if (missing || normals.empty())
+    SmoothNormals();
+  return true;
 }
 
 /*!
 \brief Save the mesh in .obj format, with vertices and normals.
 \param url Filename.
 \param meshName %Mesh name in .obj file.
+\return False if the file could not be written.
 */
-void Mesh::SaveObj(const QString& url, const QString& meshName) const
+bool Mesh::SaveObj(const std::string& url, const std::string& meshName) const
 {
-  QFile data(url);
-  if (!data.open(QFile::WriteOnly))
-    return;
-  QTextStream out(&data);
-  out << "g " << meshName << Qt::endl;
-  for (int i = 0; i < vertices.size(); i++)
-    out << "v " << vertices.at(i)[0] << " " << vertices.at(i)[1] << " " << vertices.at(i)[2] << QString('\n');
-  for (int i = 0; i < normals.size(); i++)
-    out << "vn " << normals.at(i)[0] << " " << normals.at(i)[1] << " " << normals.at(i)[2] << QString('\n');
-  for (int i = 0; i < varray.size(); i += 3)
+  std::ofstream out(url);
+  if (!out)
+    return false;
+  out << "g " << meshName << '\n';
+  for (int i = 0; i < int(vertices.size()); i++)
+    out << "v " << vertices.at(i)[0] << " " << vertices.at(i)[1] << " " << vertices.at(i)[2] << '\n';
+  for (int i = 0; i < int(normals.size()); i++)
+    out << "vn " << normals.at(i)[0] << " " << normals.at(i)[1] << " " << normals.at(i)[2] << '\n';
+  for (int i = 0; i < int(varray.size()); i += 3)
   {
     out << "f " << varray.at(i) + 1 << "//" << narray.at(i) + 1 << " "
       << varray.at(i + 1) + 1 << "//" << narray.at(i + 1) + 1 << " "
       << varray.at(i + 2) + 1 << "//" << narray.at(i + 2) + 1 << " "
       << "\n";
   }
-  out.flush();
-  data.close();
+  return bool(out);
 }
@@ -27,6 +27,26 @@ MeshColor::MeshColor(const Mesh& m) : Mesh(m)
 	carray = varray;
 }
 
+/*!
+\brief Constructor from a Mesh moved into the colored mesh, with white colors.
+\param m the base mesh
+*/
+MeshColor::MeshColor(Mesh&& m) : Mesh(std::move(m))
+{
+	colors.resize(vertices.size(), Color(1.0, 1.0, 1.0));
+	carray = varray;
+}
+
+/*!
+\brief Constructor moving a Mesh, a color array and indices into the colored mesh.
+\param m Base mesh.
+\param cols Color array.
+\param carr Color indexes, should be the same size as Mesh::varray and Mesh::narray.
+*/
+MeshColor::MeshColor(Mesh&& m, std::vector<Color>&& cols, std::vector<size_t>&& carr) : Mesh(std::move(m)), colors(std::move(cols)), carray(std::move(carr))
+{
+}
+
 /*!
 \brief Empty.
 */
@@ -0,0 +1,478 @@
+#include "meshpool.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <numeric>
+
+/*!
+\class RangeAllocator meshpool.h
+
+\brief Allocator of ranges in an interval of integers, used to sub-allocate the vertices and indexes of the pooled buffers.
+
+Free ranges are kept sorted by their start, allocation takes the first range large enough,
+and released ranges are merged with their free neighbors so that the pages do not fragment
+when meshes are repeatedly replaced.
+*/
+
+/*!
+\brief Create an allocator.
+\param n Size of the interval.
+*/
+RangeAllocator::RangeAllocator(size_t n) : capacity(n)
+{
+  if (n > 0)
+    free[0] = n;
+}
+
+/*!
+\brief Allocate a range.
+\param n Size of the range.
+\param start Returned start of the range.
+\return False if no free range is large enough.
+*/
+bool RangeAllocator::Allocate(size_t n, size_t& start)
+{
+  for (std::map<size_t, size_t>::iterator i = free.begin(); i != free.end(); i++)
+  {
+    if (i->second < n)
+      continue;
+    start = i->first;
+    const size_t rest = i->second - n;
+    free.erase(i);
+    if (rest > 0)
+      free[start + n] = rest;
+    used += n;
+    return true;
+  }
+  return false;
+}
+
+/*!
+\brief Release a range, merging it with the adjacent free ranges.
+\param start Start of the range.
+\param n Size of the range.
+*/
+void RangeAllocator::Release(size_t start, size_t n)
+{
+  used -= n;
+  std::map<size_t, size_t>::iterator next = free.lower_bound(start);
+  if (next != free.begin())
+  {
+    std::map<size_t, size_t>::iterator previous = std::prev(next);
+    if (previous->first + previous->second == start)
+    {
+      start = previous->first;
+      n += previous->second;
+      free.erase(previous);
+    }
+  }
+  if (next != free.end() && start + n == next->first)
+  {
+    n += next->second;
+    free.erase(next);
+  }
+  free[start] = n;
+}
+
+/*!
+\class MeshPool meshpool.h
+
+\brief Large pooled buffers shared by the meshes, with a persistently mapped staging ring to stream the updates.
+
+Meshes do not own buffers: their vertices and indexes are sub-allocated in pages, that is
+large vertex and index buffers of a given vertex format, and drawn with a base vertex.
+Replacing a mesh releases its ranges, which are recycled by the next meshes, so that editing
+a scene never creates nor reallocates buffers.
+
+Updates are written into a staging buffer mapped once and for all, split into Regions regions
+used in turn by the successive frames, and copied on the GPU into the pages. A fence is inserted
+after the copies of a frame, and a region is written again only once its fence is signaled,
+which does not stall as long as the GPU is less than Regions frames late.
+
+Without persistent mapping (before OpenGL 4.4), updates fall back to glBufferSubData().
+
+The vertex arrays of the pages also have a per instance attribute, the draw index, so that the
+draws of an indirect multi-draw find their data with their base instance, see ReserveDraws().
+*/
+
+/*!
+\brief Check the capabilities of the context and create the staging ring.
+
+Requires a current OpenGL context.
+\param size Size of a region of the staging ring, that is the maximum number of bytes streamed per frame.
+*/
+void MeshPool::Init(size_t size)
+{
+  initialized = true;
+  persistent = GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage;
+  SetStagingSize(size);
+}
+
+/*!
+\brief Release all the buffers. The allocations of the meshes become invalid.
+*/
+void MeshPool::Release()
+{
+  SetStagingSize(0);
+  for (std::unique_ptr<Page>& page : pages)
+  {
+    glDeleteVertexArrays(1, &page->vao);
+    glDeleteBuffers(1, &page->vertexBuffer);
+    glDeleteBuffers(1, &page->indexBuffer);
+  }
+  pages.clear();
+  glDeleteBuffers(1, &drawBuffer);
+  drawBuffer = 0;
+  draws = 0;
+  initialized = false;
+}
+
+/*!
+\brief Set the size of a region of the staging ring, waiting for the pending copies if the ring is reallocated.
+\param size Size of a region, the ring is released if null.
+*/
+void MeshPool::SetStagingSize(size_t size)
+{
+  region = size;
+  cursor = 0;
+  if (!initialized)
+    return;
+
+  // Wait for the copies out of the previous ring
+  for (GLsync& fence : fences)
+  {
+    if (fence != nullptr)
+    {
+      glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, GLuint64(1000000000));
+      glDeleteSync(fence);
+      fence = nullptr;
+    }
+  }
+  if (staging != 0)
+  {
+    glBindBuffer(GL_COPY_READ_BUFFER, staging);
+    glUnmapBuffer(GL_COPY_READ_BUFFER);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glDeleteBuffers(1, &staging);
+    staging = 0;
+    mapped = nullptr;
+  }
+  if (!persistent || size == 0)
+    return;
+
+  const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+  glGenBuffers(1, &staging);
+  glBindBuffer(GL_COPY_READ_BUFFER, staging);
+  glBufferStorage(GL_COPY_READ_BUFFER, Regions * region, nullptr, flags);
+  mapped = (unsigned char*)glMapBufferRange(GL_COPY_READ_BUFFER, 0, Regions * region, flags);
+  glBindBuffer(GL_COPY_READ_BUFFER, 0);
+  if (mapped == nullptr)
+  {
+    glDeleteBuffers(1, &staging);
+    staging = 0;
+  }
+}
+
+/*!
+\brief Size in bytes of an attribute of a vertex.
+\param a Attribute, 0 for the positions, 1 for the normals and 2 for the colors.
+*/
+size_t MeshPool::Page::Stride(int a) const
+{
+  if (a == 0)
+    return compact ? 6 : 12;
+  if (a == 1)
+    return compact ? 4 : 12;
+  return colors ? (compact ? 4 : 12) : 0;
+}
+
+/*!
+\brief Offset of the section of an attribute in the vertex buffer.
+\param a Attribute.
+*/
+size_t MeshPool::Page::Offset(int a) const
+{
+  size_t offset = 0;
+  for (int i = 0; i < a; i++)
+    offset += capacity * Stride(i);
+  return offset;
+}
+
+/*!
+\brief Create the storage of a buffer bound to a target.
+\param target Target.
+\param size Size in bytes.
+\param persistent Immutable storage flag.
+*/
+static void Storage(GLenum target, size_t size, bool persistent)
+{
+  if (persistent)
+    glBufferStorage(target, size, nullptr, GL_DYNAMIC_STORAGE_BIT);
+  else
+    glBufferData(target, size, nullptr, GL_STATIC_DRAW);
+}
+
+/*!
+\brief Create a page and its vertex array.
+\param compact Compact vertex format flag.
+\param colors Color attribute flag.
+\param vertices Number of vertices.
+\param indexes Number of indexes.
+*/
+MeshPool::Page* MeshPool::CreatePage(bool compact, bool colors, size_t vertices, size_t indexes)
+{
+  Page* page = new Page;
+  page->compact = compact;
+  page->colors = colors;
+  page->capacity = (vertices + 3) / 4 * 4;
+  page->vertices = RangeAllocator(page->capacity);
+  page->indexes = RangeAllocator(indexes);
+  pages.emplace_back(page);
+
+  glGenVertexArrays(1, &page->vao);
+  glGenBuffers(1, &page->vertexBuffer);
+  glGenBuffers(1, &page->indexBuffer);
+
+  glBindVertexArray(page->vao);
+  glBindBuffer(GL_ARRAY_BUFFER, page->vertexBuffer);
+  Storage(GL_ARRAY_BUFFER, page->Offset(3), persistent);
+
+  // Vertices(0), quantized in the box of the mesh in the compact format
+  if (compact)
+    glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, 0, (const void*)page->Offset(0));
+  else
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (const void*)page->Offset(0));
+  glEnableVertexAttribArray(0);
+
+  // Normals(1), octahedral in the compact format
+  if (compact)
+    glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, 0, (const void*)page->Offset(1));
+  else
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, (const void*)page->Offset(1));
+  glEnableVertexAttribArray(1);
+
+  // Colors(2)
+  if (colors)
+  {
+    if (compact)
+      glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, 0, (const void*)page->Offset(2));
+    else
+      glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 0, (const void*)page->Offset(2));
+    glEnableVertexAttribArray(2);
+  }
+
+  // Triangles
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, page->indexBuffer);
+  Storage(GL_ELEMENT_ARRAY_BUFFER, sizeof(uint32_t) * indexes, persistent);
+  glBindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  if (drawBuffer != 0)
+    BindDraws(*page);
+  return page;
+}
+
+/*!
+\brief Bind the draw indexes to the vertex array of a page, as the attribute 3 advancing once per instance.
+\param page The page.
+*/
+void MeshPool::BindDraws(const Page& page) const
+{
+  glBindVertexArray(page.vao);
+  glBindBuffer(GL_ARRAY_BUFFER, drawBuffer);
+  glVertexAttribIPointer(3, 1, GL_UNSIGNED_INT, 0, nullptr);
+  glVertexAttribDivisor(3, 1);
+  glEnableVertexAttribArray(3);
+  glBindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+/*!
+\brief Make sure that there are at least a given number of draw indexes.
+
+The draw i of an indirect multi-draw uses i as its base instance, hence reads the draw index i,
+which selects its data in a storage buffer.
+\param n Number of draws.
+*/
+void MeshPool::ReserveDraws(size_t n)
+{
+  if (n <= draws)
+    return;
+  draws = std::max(n, 2 * draws);
+
+  std::vector<GLuint> indexes(draws);
+  std::iota(indexes.begin(), indexes.end(), GLuint(0));
+  const bool created = (drawBuffer == 0);
+  if (created)
+    glGenBuffers(1, &drawBuffer);
+  glBindBuffer(GL_ARRAY_BUFFER, drawBuffer);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(GLuint) * draws, indexes.data(), GL_STATIC_DRAW);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  if (created)
+  {
+    for (const std::unique_ptr<Page>& page : pages)
+      BindDraws(*page);
+  }
+}
+
+/*!
+\brief Allocate the vertices and indexes of a mesh, in a new page if no page of the format has enough room.
+
+Meshes larger than the default size of a page get a page of their own.
+\param compact Compact vertex format flag.
+\param colors Color attribute flag.
+\param vertices Number of vertices.
+\param indexes Number of indexes.
+*/
+MeshPool::Allocation MeshPool::Allocate(bool compact, bool colors, size_t vertices, size_t indexes)
+{
+  Allocation allocation;
+  allocation.vertices = vertices;
+  allocation.indexes = indexes;
+
+  // Empty meshes still reserve a vertex and an index, so that every allocation has a page
+  const size_t nv = std::max(vertices, size_t(1));
+  const size_t ni = std::max(indexes, size_t(1));
+  for (std::unique_ptr<Page>& page : pages)
+  {
+    if (page->compact != compact || page->colors != colors)
+      continue;
+    if (!page->vertices.Allocate(nv, allocation.vertex))
+      continue;
+    if (!page->indexes.Allocate(ni, allocation.index))
+    {
+      page->vertices.Release(allocation.vertex, nv);
+      continue;
+    }
+    allocation.page = page.get();
+    return allocation;
+  }
+
+  Page* page = CreatePage(compact, colors, std::max(nv, pageVertices), std::max(ni, pageIndexes));
+  page->vertices.Allocate(nv, allocation.vertex);
+  page->indexes.Allocate(ni, allocation.index);
+  allocation.page = page;
+  return allocation;
+}
+
+/*!
+\brief Release the vertices and indexes of a mesh.
+
+The ranges may be reused by the next uploads while the GPU still draws the previous frames:
+copies into the pages are ordered after these draws.
+\param allocation Allocation, reset.
+*/
+void MeshPool::Free(Allocation& allocation)
+{
+  if (allocation.page != nullptr)
+  {
+    allocation.page->vertices.Release(allocation.vertex, std::max(allocation.vertices, size_t(1)));
+    allocation.page->indexes.Release(allocation.index, std::max(allocation.indexes, size_t(1)));
+  }
+  allocation = Allocation();
+}
+
+/*!
+\brief Start a frame: wait until the region of the staging ring written in this frame is no longer read.
+
+The fence has been inserted Regions frames ago, so it is signaled unless the GPU is late, in which
+case the wait is counted as a stall.
+*/
+void MeshPool::BeginFrame()
+{
+  cursor = 0;
+  GLsync& fence = fences[frame % Regions];
+  if (fence == nullptr)
+    return;
+  if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+  {
+    stalls++;
+    glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, GLuint64(1000000000));
+  }
+  glDeleteSync(fence);
+  fence = nullptr;
+}
+
+/*!
+\brief End a frame: fence the copies out of the region of the staging ring written in this frame.
+*/
+void MeshPool::EndFrame()
+{
+  if (mapped != nullptr && cursor > 0)
+    fences[frame % Regions] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  frame++;
+}
+
+/*!
+\brief Number of bytes that can still be streamed in the current frame.
+*/
+size_t MeshPool::Available() const
+{
+  return region > cursor ? region - cursor : 0;
+}
+
+/*!
+\brief Write data into a buffer of a page.
+\param buffer Destination buffer.
+\param offset Offset in the destination buffer.
+\param data Data.
+\param size Size in bytes.
+\param stream Streaming flag: the data goes through the staging ring and counts in the bytes of the frame,
+otherwise it is uploaded directly, which is meant for the meshes added all at once.
+\return Number of bytes written, less than size if the region of the frame is full.
+*/
+size_t MeshPool::Write(GLuint buffer, size_t offset, const void* data, size_t size, bool stream)
+{
+  if (stream)
+  {
+    size = std::min(size, Available());
+    if (mapped != nullptr)
+    {
+      const size_t start = (frame % Regions) * region + cursor;
+      std::memcpy(mapped + start, data, size);
+      glBindBuffer(GL_COPY_READ_BUFFER, staging);
+      glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+      glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, start, offset, size);
+      glBindBuffer(GL_COPY_READ_BUFFER, 0);
+      glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+      cursor += size;
+      return size;
+    }
+    cursor += size;
+  }
+  glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+  glBufferSubData(GL_COPY_WRITE_BUFFER, offset, size, data);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+  return size;
+}
+
+/*!
+\brief Number of pages.
+*/
+int MeshPool::Pages() const
+{
+  return int(pages.size());
+}
+
+/*!
+\brief Memory used by the pages and the staging ring, in bytes.
+*/
+size_t MeshPool::Memory() const
+{
+  size_t memory = mapped != nullptr ? Regions * region : 0;
+  for (const std::unique_ptr<Page>& page : pages)
+    memory += page->Offset(3) + sizeof(uint32_t) * page->indexes.Capacity();
+  return memory;
+}
+
+/*!
+\brief Memory allocated to the meshes in the pages, in bytes.
+*/
+size_t MeshPool::Used() const
+{
+  size_t used = 0;
+  for (const std::unique_ptr<Page>& page : pages)
+    used += page->vertices.Used() * page->Offset(3) / page->capacity + sizeof(uint32_t) * page->indexes.Used();
+  return used;
+}
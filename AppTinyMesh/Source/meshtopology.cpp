@@ -0,0 +1,332 @@
+#include "meshtopology.h"
+
+#include <algorithm>
+#include <cstdint>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+/*!
+\class MeshTopology meshtopology.h
+
+\brief Half-edge adjacency built from a Mesh.
+
+The structure stores, per triangle, three vertex indexes and three opposite half-edges (24 bytes),
+per vertex one outgoing half-edge and the offset of its incident corners (8 bytes), and the incident
+corners of every vertex (12 bytes per triangle), that is 40 bytes per triangle for a closed mesh with
+twice as many triangles as vertices.
+
+Opposite half-edges are found by sorting the half-edges on their undirected edge key with a
+parallel least significant digit radix sort, so that the construction is linear in the number
+of triangles. Edges shared by more than two triangles, or by two triangles with inconsistent
+orientations, are non-manifold: their half-edges have no opposite.
+*/
+
+/*!
+\brief Stable parallel radix sort of 64 bits keys, the permutation is applied to an index array.
+\param keys Keys.
+\param index Index array.
+\param bits Number of significant bits of the keys.
+*/
+static void RadixSort(std::vector<uint64_t>& keys, std::vector<int>& index, int bits)
+{
+  const int digit = 11;
+  const int buckets = 1 << digit;
+  const int n = int(keys.size());
+
+  std::vector<uint64_t> kt(n);
+  std::vector<int> it(n);
+
+#ifdef _OPENMP
+  const int threads = (n < 65536) ? 1 : omp_get_max_threads();
+#else
+  const int threads = 1;
+#endif
+  std::vector<int> histogram(threads * buckets);
+  int team = 1;
+
+  for (int shift = 0; shift < bits; shift += digit)
+  {
+    std::fill(histogram.begin(), histogram.end(), 0);
+
+#pragma omp parallel num_threads(threads)
+    {
+      // The team may be smaller than requested (nested or dynamic teams, thread limits)
+#ifdef _OPENMP
+#pragma omp single
+      team = omp_get_num_threads();
+      const int t = omp_get_thread_num();
+#else
+      const int t = 0;
+#endif
+      const int a = int(int64_t(n) * t / team);
+      const int b = int(int64_t(n) * (t + 1) / team);
+      int* h = &histogram[t * buckets];
+
+      // Local histograms
+      for (int i = a; i < b; i++)
+      {
+        h[(keys[i] >> shift) & (buckets - 1)]++;
+      }
+
+#pragma omp barrier
+#pragma omp single
+      {
+        // Offsets in (digit, thread) order keep the sort stable
+        int sum = 0;
+        for (int d = 0; d < buckets; d++)
+        {
+          for (int k = 0; k < team; k++)
+          {
+            int c = histogram[k * buckets + d];
+            histogram[k * buckets + d] = sum;
+            sum += c;
+          }
+        }
+      }
+
+      // Scatter
+      for (int i = a; i < b; i++)
+      {
+        int j = h[(keys[i] >> shift) & (buckets - 1)]++;
+        kt[j] = keys[i];
+        it[j] = index[i];
+      }
+    }
+    keys.swap(kt);
+    index.swap(it);
+  }
+}
+
+/*!
+\brief Build the adjacency of a mesh.
+\param mesh The mesh.
+*/
+MeshTopology::MeshTopology(const Mesh& mesh)
+{
+  const int nv = mesh.Vertexes();
+  const int nh = int(mesh.VertexIndexes().size());
+
+  varray.assign(mesh.VertexIndexes().begin(), mesh.VertexIndexes().end());
+  mesh.VertexCorners(offsets, corners);
+
+  // Undirected edge keys
+  int vb = 1;
+  while ((int64_t(1) << vb) < nv)
+    vb++;
+
+  std::vector<uint64_t> keys(nh);
+  std::vector<int> index(nh);
+#pragma omp parallel for schedule(static)
+  for (int h = 0; h < nh; h++)
+  {
+    uint64_t a = uint64_t(varray[h]);
+    uint64_t b = uint64_t(varray[Next(h)]);
+    keys[h] = (std::min(a, b) << vb) | std::max(a, b);
+    index[h] = h;
+  }
+
+  RadixSort(keys, index, 2 * vb);
+
+  // Match runs of equal keys
+  opposite.assign(nh, -1);
+  edges = boundary = singular = 0;
+  for (int i = 0; i < nh;)
+  {
+    int j = i + 1;
+    while (j < nh && keys[j] == keys[i])
+      j++;
+
+    edges++;
+    if (j - i == 1)
+    {
+      boundary++;
+    }
+    else if (j - i == 2 && varray[index[i]] != varray[index[i + 1]])
+    {
+      opposite[index[i]] = index[i + 1];
+      opposite[index[i + 1]] = index[i];
+    }
+    else
+    {
+      singular++;
+    }
+    i = j;
+  }
+
+  // Outgoing half-edges, preferably on the boundary
+  outgoing.assign(nv, -1);
+#pragma omp parallel for schedule(static)
+  for (int v = 0; v < nv; v++)
+  {
+    for (int k = offsets[v]; k < offsets[v + 1]; k++)
+    {
+      int h = corners[k];
+      if (outgoing[v] == -1 || opposite[h] == -1)
+        outgoing[v] = h;
+      if (opposite[h] == -1)
+        break;
+    }
+  }
+}
+
+/*!
+\brief Empty.
+*/
+MeshTopology::~MeshTopology()
+{
+}
+
+/*!
+\brief Check if a vertex is on the boundary.
+\param v Vertex.
+*/
+bool MeshTopology::IsBoundaryVertex(int v) const
+{
+  for (int k = offsets[v]; k < offsets[v + 1]; k++)
+  {
+    int h = corners[k];
+    if (opposite[h] == -1 || opposite[Prev(h)] == -1)
+      return true;
+  }
+  return false;
+}
+
+/*!
+\brief Check if the neighborhood of a vertex is a single fan of triangles, i.e. a disk or a half-disk.
+
+Isolated vertices are manifold.
+\param v Vertex.
+*/
+bool MeshTopology::IsManifoldVertex(int v) const
+{
+  const int n = Valence(v);
+  if (n == 0)
+    return true;
+
+  // Walk around the vertex from the outgoing half-edge and check that all the triangles are reached
+  int h = outgoing[v];
+  int count = 0;
+  do
+  {
+    count++;
+    h = opposite[Prev(h)];
+  } while (h != -1 && h != outgoing[v] && count <= n);
+
+  return count == n;
+}
+
+/*!
+\brief Check if every vertex and every edge of the mesh is manifold.
+*/
+bool MeshTopology::IsManifold() const
+{
+  if (singular != 0)
+    return false;
+
+  const int nv = Vertexes();
+  bool manifold = true;
+#pragma omp parallel for schedule(static) reduction(&&:manifold)
+  for (int v = 0; v < nv; v++)
+  {
+    manifold = manifold && IsManifoldVertex(v);
+  }
+  return manifold;
+}
+
+/*!
+\brief Compute the vertices adjacent to a vertex.
+
+For manifold vertices the ring is ordered, starting from the boundary for boundary vertices.
+Otherwise the neighbors are sorted by index.
+\param v Vertex.
+*/
+std::vector<int> MeshTopology::OneRing(int v) const
+{
+  std::vector<int> ring;
+  if (Valence(v) == 0)
+    return ring;
+
+  if (IsManifoldVertex(v))
+  {
+    ring.reserve(Valence(v) + 1);
+    int h = outgoing[v];
+    do
+    {
+      ring.push_back(Target(h));
+      int p = Prev(h);
+      h = opposite[p];
+      if (h == -1)
+        ring.push_back(Origin(p));
+    } while (h != -1 && h != outgoing[v]);
+    return ring;
+  }
+
+  for (int k = offsets[v]; k < offsets[v + 1]; k++)
+  {
+    int h = corners[k];
+    ring.push_back(Target(h));
+    ring.push_back(Origin(Prev(h)));
+  }
+  std::sort(ring.begin(), ring.end());
+  ring.erase(std::unique(ring.begin(), ring.end()), ring.end());
+  return ring;
+}
+
+/*!
+\brief Compute the triangles incident to a vertex, in increasing order.
+\param v Vertex.
+*/
+std::vector<int> MeshTopology::Faces(int v) const
+{
+  std::vector<int> faces(Valence(v));
+  for (int k = offsets[v]; k < offsets[v + 1]; k++)
+  {
+    faces[k - offsets[v]] = Face(corners[k]);
+  }
+  return faces;
+}
+
+/*!
+\brief Compute the boundary loops of the mesh.
+
+Every loop is the list of boundary half-edges in order, the origins of which are the vertices of the loop.
+Loops through non-manifold vertices may be split.
+*/
+std::vector<std::vector<int>> MeshTopology::BoundaryLoops() const
+{
+  std::vector<std::vector<int>> loops;
+  std::vector<bool> visited(varray.size(), false);
+
+  for (int i = 0; i < HalfEdges(); i++)
+  {
+    if (opposite[i] != -1 || visited[i])
+      continue;
+
+    std::vector<int> loop;
+    int h = i;
+    while (h != -1 && !visited[h])
+    {
+      visited[h] = true;
+      loop.push_back(h);
+
+      // Rotate around the target until the next boundary half-edge
+      int g = Next(h);
+      int steps = Valence(Origin(g));
+      while (opposite[g] != -1 && steps-- > 0)
+        g = Next(opposite[g]);
+      h = (opposite[g] == -1) ? g : -1;
+    }
+    loops.push_back(loop);
+  }
+  return loops;
+}
+
+/*!
+\brief Memory used by the adjacency, in bytes.
+*/
+size_t MeshTopology::Memory() const
+{
+  return sizeof(int) * (varray.size() + opposite.size() + outgoing.size() + offsets.size() + corners.size());
+}
@@ -0,0 +1,108 @@
+#include "nodestore.h"
+
+#include <algorithm>
+
+/*!
+\class NodeStore nodestore.h
+
+\brief Store owning the nodes of implicit trees, allocated in a bump arena and shared as a DAG.
+
+Nodes live as long as the store, independently of the stack frame that built the tree, and
+identical subtrees are stored once through hash-consing, using the structural hash of the nodes.
+Nodes can be created from several threads; trees are evaluated without any lock, since nodes
+are immutable. Share the store with std::shared_ptr to keep trees alive in caches or jobs,
+see ImplicitTree::Tree.
+*/
+
+/*!
+\brief Create an empty store.
+\param block Size of the blocks of the arena, larger nodes get their own block.
+*/
+NodeStore::NodeStore(size_t block) : block(block)
+{
+}
+
+/*!
+\brief Allocate zeroed memory in the arena.
+
+Memory is zeroed so that the padding of identical nodes compares equal.
+\param size, alignment Size and alignment.
+*/
+unsigned char* NodeStore::Allocate(size_t size, size_t alignment)
+{
+  size_t offset = (used + alignment - 1) / alignment * alignment;
+  if (blocks.empty() || offset + size > block)
+  {
+    const size_t n = std::max(block, size);
+    blocks.emplace_back(new unsigned char[n]());
+    memory += n;
+    offset = 0;
+  }
+  used = offset + size;
+  return blocks.back().get() + offset;
+}
+
+/*!
+\brief Release the last allocation.
+\param p, size Memory returned by the last call to Allocate() and its size.
+*/
+void NodeStore::Release(unsigned char* p, size_t size)
+{
+  memset(p, 0, size);
+  used = size_t(p - blocks.back().get());
+}
+
+/*!
+\brief Find a node identical to a new node.
+\param h Structural hash of the node.
+\param node, size, type The new node, its size and type.
+\return The existing node, null if none.
+*/
+const Implicit* NodeStore::Find(uint64_t h, const Implicit* node, size_t size, const std::type_info& type) const
+{
+  const auto range = table.equal_range(h);
+  for (auto i = range.first; i != range.second; ++i)
+  {
+    const Entry& entry = i->second;
+    if (entry.size == size && *entry.type == type && memcmp(entry.node, node, size) == 0)
+      return entry.node;
+  }
+  return nullptr;
+}
+
+/*!
+\brief Register a node so that it can be shared.
+\param h Structural hash of the node.
+\param node, size, type The node, its size and type.
+*/
+void NodeStore::Insert(uint64_t h, const Implicit* node, size_t size, const std::type_info& type)
+{
+  table.emplace(h, Entry{ node, size, &type });
+}
+
+/*!
+\brief Number of distinct nodes.
+*/
+int NodeStore::Nodes() const
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  return nodes;
+}
+
+/*!
+\brief Number of creations that returned an existing node.
+*/
+int NodeStore::Shared() const
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  return shared;
+}
+
+/*!
+\brief Memory allocated by the arena, in bytes.
+*/
+size_t NodeStore::Memory() const
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  return memory;
+}
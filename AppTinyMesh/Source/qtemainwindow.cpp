@@ -1,11 +1,43 @@
 #include "color.h"
 #include "meshcolor.h"
 #include "qte.h"
-#include "implicits-tree.h"
+#include "examples.h"
+#include "brickpolygonizer.h"
 #include "ui_interface.h"
 #include <cmath>
+#include <memory>
 #include <tp_math.h>
 
+#include <QtWidgets/QStatusBar>
+
+/*!
+\brief Implicit tree of ImplicitExampleB, kept alive together with its polygonizer so that
+edits re-polygonize only the bricks they touch.
+
+The tree and the polygonizer are only accessed by the jobs of the worker thread.
+*/
+struct MainWindow::ImplicitScene
+{
+  ImplicitTable table;
+  BrickPolygonizer polygonizer{ &table.tree, 500, Box(30), 16, 0.001 };
+
+  bool displayed = false; //!< Flag set once the first meshes are displayed, accessed by the user interface only.
+
+  /*!
+  \brief Move the first capsule, invalidating the regions it influences before and after the move.
+  \param p New position.
+  */
+  void Move(const Vector& p)
+  {
+    Box region;
+    table.tree.Influence(&table.t0, 0.0, region);
+    polygonizer.Invalidate(region);
+    table.t0.SetPosition(p);
+    table.tree.Influence(&table.t0, 0.0, region);
+    polygonizer.Invalidate(region);
+  }
+};
+
 MainWindow::MainWindow() : QMainWindow(), uiw(new Ui::Assets)
 {
 	// Chargement de l'interface
@@ -22,10 +54,13 @@ MainWindow::MainWindow() : QMainWindow(), uiw(new Ui::Assets)
 	CreateActions();
 
 	meshWidget->SetCamera(Camera(Vector(10, 0, 0), Vector(0.0, 0.0, 0.0)));
+	meshWidget->UseCompactVertices(true);
 }
 
 MainWindow::~MainWindow()
 {
+	// Stop the generation before the viewer goes away
+	jobs.Cancel();
 	delete meshWidget;
 }
 
@@ -46,221 +81,225 @@ void MainWindow::CreateActions()
 	// Widget edition
 	connect(meshWidget, SIGNAL(_signalEditSceneLeft(const Ray&)), this, SLOT(editingSceneLeft(const Ray&)));
 	connect(meshWidget, SIGNAL(_signalEditSceneRight(const Ray&)), this, SLOT(editingSceneRight(const Ray&)));
+	connect(meshWidget, SIGNAL(_signalMeshUploaded(const QString&)), this, SLOT(UpdateMaterial()));
 }
 
-void MainWindow::editingSceneLeft(const Ray&)
+/*!
+\brief Move the first capsule of ImplicitExampleB under the cursor, at the same height.
+\param ray Ray through the pixel.
+*/
+void MainWindow::editingSceneLeft(const Ray& ray)
 {
+  if (!scene)
+    return;
+
+  const Vector o = ray.Origin();
+  const Vector u = ray.Direction();
+  if (fabs(u[2]) < 1e-6)
+    return;
+  const double t = (ImplicitTable::htheight - o[2]) / u[2];
+  if (t < 0.0)
+    return;
+
+  const Vector p = ray(t);
+  UpdateScene([p](ImplicitScene& s) { s.Move(p); });
 }
 
 void MainWindow::editingSceneRight(const Ray&)
 {
 }
 
-void MainWindow::BezierExample()
+/*!
+\brief Generate meshes in a worker thread and display them once they are ready.
+
+The generation supersedes the running one, if any, which is cancelled. Meshes are optimized for
+rendering and their levels of detail are computed in the worker thread, then handed to the viewer in the user interface thread, which uploads
+them over the next frames; the previous scene is displayed until all of them are uploaded, and is then replaced at once.
+\param build Function computing the meshes, returns false if it has been cancelled.
+*/
+void MainWindow::Generate(const std::function<bool(JobQueue::Job&, std::vector<CompactMesh>&)>& build)
 {
-  meshWidget->ClearAll();
+  statusBar()->showMessage("Generating...");
+  scene.reset();
 
-  // Bezier 1
+  jobs.Submit([this, build](JobQueue::Job& job)
   {
-    BezierSurface b(3,3, std::vector{
- 	  Vector{0,0,0}, Vector{0,0.5,0.5}, Vector{0,1,-0.5},
-      Vector{1,0,0}, Vector{1,0.5,-0.5}, Vector{0,1,0},
-      Vector{2,0,0.5}, Vector{2,0.5,0}, Vector{2,1,0}
-  	});
-
-   	meshWidget->AddMesh("1", mesh_bezier_surface(b, 100, 100));
-  }
+    std::vector<CompactMesh> meshes;
+    if (!build(job, meshes))
+      return;
+    std::shared_ptr<std::vector<MeshWidget::SceneMesh>> named = std::make_shared<std::vector<MeshWidget::SceneMesh>>(meshes.size());
+    for (int i = 0; i < int(meshes.size()); i++)
+    {
+      if (job.Cancelled())
+        return;
+      MeshWidget::SceneMesh& mesh = (*named)[i];
+      mesh.name = QString::number(i + 1);
+      mesh.mesh = std::move(meshes[i].Optimize());
+      mesh.levels = mesh.mesh.LevelsOfDetail(LevelsOfDetail);
+    }
 
-  // Bezier 2
-  {
-    BezierSurface b(4,4, std::vector{
-      Vector{-5,-5,2}, Vector{-5,-2,-5}, Vector{-5,2,-5}, Vector{-5,5,2},
-      Vector{-2,-10,5}, Vector{-2,-2,2}, Vector{-2,2,2}, Vector{-2,10,2},
-      Vector{2,-10,5}, Vector{2,-2,2}, Vector{2,2,2}, Vector{2,-5,2},
-      Vector{5,-5,2}, Vector{5,-2,5}, Vector{5,2,5}, Vector{5,5,2},
-   	});
-
-  	meshWidget->AddMesh("2", mesh_bezier_surface(b, 100, 100));
-  }
+    const unsigned int generation = job.Generation();
+    QMetaObject::invokeMethod(this, [this, generation, named]()
+    {
+      // Results superseded while waiting in the event queue are dropped
+      if (generation != jobs.Generation())
+        return;
+      meshWidget->QueueScene(std::move(*named));
+      statusBar()->clearMessage();
+    }, Qt::QueuedConnection);
+  }, Progress());
+}
 
-  // Bezier 3
-  {
-    BezierSurface b(4,4, std::vector{
-      Vector{-10,-10,5}, Vector{-10,-5,2}, Vector{-10,5,-2}, Vector{-10,10,-2},
-      Vector{-5,-10,2}, Vector{-5,-5,-10}, Vector{-5,5,-10}, Vector{-5,10,-2},
-      Vector{5,-10,-2}, Vector{5,-5,-10}, Vector{5,5,-10}, Vector{5,10,2},
-      Vector{10,-10,-2}, Vector{10,-5,-2}, Vector{10,5,2}, Vector{10,10,5},
-   	});
-
-   	meshWidget->AddMesh("3", mesh_bezier_surface(b, 100, 100));
-  }
+/*!
+\brief Generate an example made of instances of a single mesh in a worker thread, and display it instanced.
 
+Like Generate(), the previous scene is displayed until the mesh is uploaded.
+\param name Name of the example, see Examples::Instanced().
+\param settings Settings.
+*/
+void MainWindow::GenerateInstanced(const std::string& name, const ExampleSettings& settings)
+{
+  statusBar()->showMessage("Generating...");
+  scene.reset();
 
-	UpdateMaterial();
+  jobs.Submit([this, name, settings](JobQueue::Job& job)
+  {
+    std::shared_ptr<std::vector<MeshWidget::SceneMesh>> named = std::make_shared<std::vector<MeshWidget::SceneMesh>>(1);
+    MeshWidget::SceneMesh& mesh = named->front();
+    std::shared_ptr<std::vector<Vector>> offsets = std::make_shared<std::vector<Vector>>();
+    if (!Examples::Generate(name, mesh.mesh, *offsets, settings, [&job](double t) { return job.Progress(t); }))
+      return;
+    mesh.name = "1";
+    mesh.mesh.Optimize();
+    mesh.levels = mesh.mesh.LevelsOfDetail(LevelsOfDetail);
+
+    const unsigned int generation = job.Generation();
+    QMetaObject::invokeMethod(this, [this, generation, named, offsets]()
+    {
+      if (generation != jobs.Generation())
+        return;
+      meshWidget->QueueScene(std::move(*named));
+      meshWidget->SetInstances("1", *offsets);
+      statusBar()->clearMessage();
+    }, Qt::QueuedConnection);
+  }, Progress());
 }
 
-void MainWindow::BezierExample2()
+/*!
+\brief Create a progress callback for the jobs, showing the progress in the status bar.
+
+The callback is called from the worker thread and reports the progress by steps of one percent.
+*/
+std::function<void(double)> MainWindow::Progress()
 {
-  meshWidget->ClearAll();
-
-  // a, b 2d vectors
-  const auto make_default = [](size_t sx, size_t sy, Vector a, Vector b) {
-    auto bezier = BezierSurface(sx,sy, std::vector<Vector>(sx*sy));
-    Vector delta = b - a;
-    delta[0] /= sx;
-    delta[1] /= sy;
-    for (int x = 0; x < sx; x++){
-      for (int y = 0; y < sy; y++){
-        bezier.control(x, y) = a + Vector{ x * delta[0], y * delta[1], 0 }; 
-      }
-    }
-    return bezier;
+  int percent = -1;
+  return [this, percent](double t) mutable
+  {
+    if (int(100.0 * t) == percent)
+      return;
+    percent = int(100.0 * t);
+    QMetaObject::invokeMethod(this, [this, t]() { statusBar()->showMessage(QString("Generating... %1%").arg(int(100.0 * t))); }, Qt::QueuedConnection);
   };
+}
 
-  int s = 20;
-  auto b = make_default(s, s, Vector{-5, -5, 0}, Vector{5, 5, 0});
-  b.control(s/2, s/2) = Vector{0,0,100};
-
-  meshWidget->AddMesh("3", mesh_bezier_surface(b, 100, 100));
-  // meshWidget->AddMesh("4", mesh_bezier_surface(b, 100, 100));
-  // meshWidget->AddMesh("5", mesh_bezier_surface(b, 100, 100));
+/*!
+\brief Edit the implicit scene and re-polygonize the bricks touched by the edit in a worker thread.
 
-	UpdateMaterial();
+Only the meshes of the updated bricks are uploaded again. Bricks left invalidated by a cancelled
+update are polygonized by the next one, and the bricks updated before the cancellation are still displayed.
+\param edit Edit, applied in the worker thread.
+*/
+void MainWindow::UpdateScene(const std::function<void(ImplicitScene&)>& edit)
+{
+  std::shared_ptr<ImplicitScene> s = scene;
+  jobs.Submit([this, s, edit](JobQueue::Job& job)
+  {
+    edit(*s);
+
+    std::vector<int> updated;
+    bool done = s->polygonizer.Update(updated, [&job](double t) { return job.Progress(t); });
+
+    typedef std::vector<std::pair<int, CompactMesh>> Bricks;
+    std::shared_ptr<Bricks> bricks = std::make_shared<Bricks>();
+    for (int i : updated)
+      bricks->push_back(std::make_pair(i, CompactMesh(s->polygonizer.GetMesh(i)).Optimize()));
+
+    QMetaObject::invokeMethod(this, [this, s, bricks, done]()
+    {
+      // Meshes of a scene that has been replaced are dropped
+      if (scene != s)
+        return;
+      if (!s->displayed)
+      {
+        meshWidget->ClearAll();
+        s->displayed = true;
+      }
+      for (std::pair<int, CompactMesh>& brick : *bricks)
+      {
+        const QString name = QString("Brick %1").arg(brick.first);
+        if (brick.second.Triangles() == 0)
+          meshWidget->DeleteMesh(name);
+        else
+          meshWidget->QueueMesh(name, std::move(brick.second));
+      }
+      if (done)
+        statusBar()->clearMessage();
+    }, Qt::QueuedConnection);
+  }, Progress());
 }
 
-void MainWindow::RevolutionExample()
+void MainWindow::BezierExample()
 {
-	meshWidget->ClearAll();
-
-  // Revolution 1
+  Generate([](JobQueue::Job& job, std::vector<CompactMesh>& meshes)
   {
-   	BezierCurve curve(std::vector{
-		  Vector(0,0,0), Vector(10,-1,0), Vector(10,20,0), Vector(-10,10,-10), Vector(0, 0,-10),
-		});
-
-  	ExtrusionSurface ext(&curve, [&](double rad){
-  		double hdiv =  M_PI / 10;
-  		double v = std::fmod(rad, 2*hdiv);
-  	  return 0.25 + sin(v/2*M_PI);
-  	});
-
-   meshWidget->AddMesh("1", mesh_extrusion_surface(ext, 200, 200));
-  }
+    return Examples::Generate("bezier", meshes, ExampleSettings(), [&job](double t) { return job.Progress(t); });
+  });
+}
 
-  // Revolution 2
+void MainWindow::BezierExample2()
+{
+  Generate([](JobQueue::Job& job, std::vector<CompactMesh>& meshes)
   {
-   	BezierCurve curve(std::vector{
-		  Vector(0,0,10), Vector(0,2,5), Vector(0,5,0), Vector(0,5,-5), Vector(0, 5, -10)
-		});
-
-  	ExtrusionSurface ext(&curve, [&](double rad){
-      return 1;
-  	});
-
-   meshWidget->AddMesh("2", mesh_extrusion_surface(ext, 50, 50));
-  }
+    return Examples::Generate("bezier-adaptive", meshes, ExampleSettings(), [&job](double t) { return job.Progress(t); });
+  });
+}
 
-  // Revolution 3
+void MainWindow::RevolutionExample()
+{
+  Generate([](JobQueue::Job& job, std::vector<CompactMesh>& meshes)
   {
-  //  	BezierCurve curve(std::vector{
-		//   Vector(0,0,0), Vector(10,-1,0), Vector(10,20,0), Vector(-20,40,-40),
-		// });
-
-  // 	ExtrusionSurface ext(&curve, [&](double rad){
-  // 		double hdiv =  M_PI / 10;
-  // 		double v = std::fmod(rad, 2*hdiv);
-  // 	  // return v < hdiv
-  // 			// ? 0.25 + v/hdiv
-  // 			// : 0.25 + 2 - v/hdiv
-  // 			// ;
-
-  // 	  return 0.25 + sin(v/2*M_PI)
-  // 			;
-  // 	});
-
-  //  meshWidget->AddMesh("3", mesh_extrusion_surface(ext, 50, 50));
-  }
-
-	UpdateMaterial();
+    return Examples::Generate("revolution", meshes, ExampleSettings(), [&job](double t) { return job.Progress(t); });
+  });
 }
 
 void MainWindow::ImplicitExampleA() {
-  Mesh m;
-  auto b = ImplicitTree::InigoBox(Vector{5,0,0}, Vector{8,8,8});
-  auto tore = ImplicitTree::InigoTore(Vector::Null, Vector{10, 3, 0});
-  auto i = ImplicitTree::Diff(b, tore);
-  ImplicitTree::Tree(&i).Polygonize(400, m, Box(20), 0.001);
-  meshWidget->ClearAll();
-  meshWidget->AddMesh("1", m);
-  UpdateMaterial();
+  ExampleSettings settings;
+  settings.cache = &fieldCache;
+  Generate([settings](JobQueue::Job& job, std::vector<CompactMesh>& meshes) {
+    return Examples::Generate("implicit-a", meshes, settings, [&job](double t) { return job.Progress(t); });
+  });
 }
 
 void MainWindow::ImplicitExampleB() {
-  Mesh m;
-  double htsize = 0.25;
-  double htheight = 3;
-  double d = 5;
-
-  auto t0 = ImplicitTree::Capsule(Vector{-d, -d, htheight}, Vector::Z, htheight, htsize);
-  auto t1 = ImplicitTree::Capsule(Vector{d, -d, htheight}, Vector::Z, htheight, htsize);
-  auto t2 = ImplicitTree::Capsule(Vector{-d, d, htheight}, Vector::Z, htheight, htsize);
-  auto t3 = ImplicitTree::Capsule(Vector{d, d, htheight}, Vector::Z, htheight, htsize);
-
-  auto tt0 = ImplicitTree::Union(t0, t1);
-  auto tt1 = ImplicitTree::Union(t2, t3);
-  auto tunion = ImplicitTree::Union(tt0, tt1);
-
-  auto box = ImplicitTree::InigoBox(Vector{0,0, htheight}, Vector{5,5,0.1});
-  auto box2 = ImplicitTree::InigoBox(Vector{0,0, 2*htheight}, Vector{5,5,0.1});
-
-  auto bunion = ImplicitTree::Union(box, box2);
-  auto implicit = ImplicitTree::Blend(bunion, tunion, 10);
-
-  auto a = ImplicitTree::Sphere(Vector::Null, 3);
-  auto b = ImplicitTree::Sphere(Vector{0,0,0.25}, 3);
-  auto c = ImplicitTree::Sphere(Vector{-0.25,0.1,-1.2}, 1);
-  auto cc = ImplicitTree::Diff(a,b);
-  auto aze = ImplicitTree::Scale(&cc, Vector{1.1, 1.3, 0.7});
-  auto saladier = ImplicitTree::Union(c,aze);
-
-  auto st = ImplicitTree::Translate(&saladier, Vector{0,0,htheight*2 + 2});
-  auto implicit2 = ImplicitTree::Union(implicit, st);
-
-  ImplicitTree::Tree(&implicit2).Polygonize(500, m, Box(30), 0.001);
-  meshWidget->ClearAll();
-  meshWidget->AddMesh("1", m);
-  UpdateMaterial();
+  // The scene is polygonized by bricks and can be edited with Ctrl + left click
+  scene = std::make_shared<ImplicitScene>();
+  statusBar()->showMessage("Generating...");
+  UpdateScene([](ImplicitScene&) {});
 }
 
 void MainWindow::ImplicitExampleC() {
-  Mesh m;
-  double htsize = 0.25;
-  double htheight = 3;
-  double d = 5;
-
-  auto a = ImplicitTree::InigoBox(Vector::Null, Vector(5));
-  auto b = ImplicitTree::InigoBox(Vector{10,10,10}, Vector(5));
-  auto c = ImplicitTree::Sphere(Vector(18), 5);
-  auto dd = ImplicitTree::Sphere(Vector(24), 5);
-
-  auto aa = ImplicitTree::Blend(a, b, 30);
-  auto bb = ImplicitTree::Blend(aa, c, 100);
-  auto p = ImplicitTree::Blend(bb, dd, 50);
-
-  ImplicitTree::Tree(&p).Polygonize(500, m, Box(100), 0.001);
-  meshWidget->ClearAll();
-  meshWidget->AddMesh("1", m);
-  UpdateMaterial();
+  ExampleSettings settings;
+  settings.cache = &fieldCache;
+  Generate([settings](JobQueue::Job& job, std::vector<CompactMesh>& meshes) {
+    return Examples::Generate("implicit-c", meshes, settings, [&job](double t) { return job.Progress(t); });
+  });
 }
 
 void MainWindow::ImplicitExampleD() {
-    Mesh m;
-    auto torus = ImplicitTree::InigoTore(Vector{0,0,0}, Vector{10,5,0});
-    auto repl = ImplicitTree::Replicate(&torus, Vector{20,20,20});
-    ImplicitTree::Tree(&repl).Polygonize(400, m, Box(300), 0.001);
-    meshWidget->ClearAll();
-    meshWidget->AddMesh("1", m);
-    UpdateMaterial();
+  // A single torus is polygonized, and drawn instanced in every cell
+  ExampleSettings settings;
+  settings.cache = &fieldCache;
+  GenerateInstanced("implicit-d", settings);
 }
 
 void MainWindow::UpdateGeometry()
@@ -0,0 +1,634 @@
+#include "scene.h"
+#include "tp_math.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <sstream>
+
+/*!
+\class Scene scene.h
+
+\brief Scene loaded from a file: implicit trees, parametric surfaces and the meshes to generate.
+
+The text form has one record per line, a keyword followed by the name of the record, the names
+of the records it references, which must be defined before, and its parameters. Lines starting
+with a number continue the parameters of the previous surface or replication. Text after a #
+is a comment.
+\code
+# Primitives
+sphere      name  cx cy cz  radius
+box         name  cx cy cz  hx hy hz              # Signed distance to a box
+planes      name  cx cy cz  hx hy hz              # Maximum of the distances to the planes of the faces
+capsule     name  px py pz  dx dy dz  half-length radius
+torus       name  px py pz  major minor           # Around the y axis
+# Combinators and transforms
+union       name  a b
+intersection name a b
+diff        name  a b
+blend       name  a b  size
+translate   name  a  x y z
+scale       name  a  x y z
+replicate   name  a  hx hy hz  [nx ny nz]         # Half size of the cells, cells on either side of the origin
+# Parametric surfaces
+bezier      name  nu nv  x y z ...                # nu x nv control points, rows along u
+revolution  name  radius amplitude waves  x y z ...   # Control points of the axis
+# Meshes
+polygonize  node  n epsilon  x0 y0 z0  x1 y1 z1
+tessellate  surface  n
+\endcode
+The radius of revolution surfaces is radius + amplitude sin(pi/2 mod(a, 2 pi/waves)) at angle a,
+or constant if waves is 0.
+
+The binary form stores the same records, with references as indexes and parameters as doubles,
+so that it is read without any parsing. Records are converted into implicit nodes in a single
+allocation of a NodeStore, where identical subtrees are shared.
+*/
+
+//! Syntax of the records.
+struct RecordSyntax
+{
+  const char* keyword;  //!< Keyword.
+  bool named;           //!< Flag set if the record has a name.
+  int refs;             //!< Number of references.
+  int values;           //!< Number of parameters, -1 if variable.
+};
+
+static const RecordSyntax Syntax[int(Scene::Type::Types)] = {
+  { "sphere", true, 0, 4 },
+  { "box", true, 0, 6 },
+  { "planes", true, 0, 6 },
+  { "capsule", true, 0, 8 },
+  { "torus", true, 0, 5 },
+  { "union", true, 2, 0 },
+  { "intersection", true, 2, 0 },
+  { "diff", true, 2, 0 },
+  { "blend", true, 2, 1 },
+  { "translate", true, 1, 3 },
+  { "scale", true, 1, 3 },
+  { "replicate", true, 1, -1 },
+  { "bezier", true, 0, -1 },
+  { "revolution", true, 0, -1 },
+  { "polygonize", false, 1, 8 },
+  { "tessellate", false, 1, 1 },
+};
+
+//! Check if a type of record is an implicit node.
+static bool IsNode(Scene::Type type)
+{
+  return type < Scene::Type::Bezier;
+}
+
+//! Check if a type of record is a parametric surface.
+static bool IsSurface(Scene::Type type)
+{
+  return type == Scene::Type::Bezier || type == Scene::Type::Revolution;
+}
+
+//! Upper bound of the size of a node in the arena, with its alignment.
+template <typename T>
+static constexpr size_t ArenaSize()
+{
+  return (sizeof(T) + alignof(std::max_align_t) - 1) / alignof(std::max_align_t) * alignof(std::max_align_t);
+}
+
+//! Size of the node of a type of record in the arena.
+static size_t ArenaSize(Scene::Type type)
+{
+  switch (type)
+  {
+  case Scene::Type::Sphere: return ArenaSize<ImplicitTree::Sphere>();
+  case Scene::Type::Box: return ArenaSize<ImplicitTree::InigoBox>();
+  case Scene::Type::Planes: return ArenaSize<ImplicitTree::Box>();
+  case Scene::Type::Capsule: return ArenaSize<ImplicitTree::Capsule>();
+  case Scene::Type::Torus: return ArenaSize<ImplicitTree::InigoTore>();
+  case Scene::Type::Union: return ArenaSize<ImplicitTree::Union>();
+  case Scene::Type::Intersection: return ArenaSize<struct ImplicitTree::Intersection>();
+  case Scene::Type::Diff: return ArenaSize<ImplicitTree::Diff>();
+  case Scene::Type::Blend: return ArenaSize<ImplicitTree::Blend>();
+  case Scene::Type::Translate: return ArenaSize<ImplicitTree::Translate>();
+  case Scene::Type::Scale: return ArenaSize<ImplicitTree::Scale>();
+  case Scene::Type::Replicate: return ArenaSize<ImplicitTree::Replicate>();
+  default: return 0;
+  }
+}
+
+/*!
+\brief Create an empty scene.
+*/
+Scene::Scene()
+{
+}
+
+/*!
+\brief Load a scene, in text or binary form.
+\param filename File name.
+\return False if the file could not be read or has errors, see Error().
+*/
+bool Scene::Load(const std::string& filename)
+{
+  std::ifstream in(filename, std::ios::binary);
+  if (!in)
+  {
+    error = "Cannot read " + filename;
+    return false;
+  }
+  char magic[4] = {};
+  in.read(magic, 4);
+  in.clear();
+  in.seekg(0);
+  if (memcmp(magic, "TMSB", 4) == 0)
+    return ReadBinary(in);
+  return Read(in, filename);
+}
+
+/*!
+\brief Save the scene.
+\param filename File name.
+\param binary Binary form if true, text otherwise.
+*/
+bool Scene::Save(const std::string& filename, bool binary) const
+{
+  std::ofstream out(filename, binary ? std::ios::binary : std::ios::out);
+  if (!out)
+    return false;
+  if (binary)
+    WriteBinary(out);
+  else
+    Write(out);
+  return bool(out);
+}
+
+/*!
+\brief Check the references and parameters of a record.
+\param record The record, its references are indexes of the previous records.
+\param message Returned error message.
+*/
+bool Scene::Check(const Record& record, std::string& message) const
+{
+  const RecordSyntax& syntax = Syntax[int(record.type)];
+  if (int(record.refs.size()) != syntax.refs)
+  {
+    message = std::string(syntax.keyword) + " expects " + std::to_string(syntax.refs) + " references";
+    return false;
+  }
+  for (int r : record.refs)
+  {
+    if (r < 0 || r >= int(records.size()))
+    {
+      message = "invalid reference";
+      return false;
+    }
+    const bool surface = (record.type == Type::Tessellate);
+    if (surface ? !IsSurface(records[r].type) : !IsNode(records[r].type))
+    {
+      message = "reference " + records[r].name + " is not " + (surface ? "a surface" : "an implicit node");
+      return false;
+    }
+  }
+
+  const int n = int(record.values.size());
+  const std::vector<double>& v = record.values;
+  bool valid = (syntax.values < 0) || (n == syntax.values);
+  for (double x : v)
+    valid = valid && std::isfinite(x);
+
+  // Counts are checked before being converted, which is undefined out of the range of int
+  const auto Count = [](double x, int a, int b) { return x >= a && x <= b && x == std::floor(x); };
+  switch (record.type)
+  {
+  case Type::Bezier:
+    valid = valid && n >= 2 && Count(v[0], 2, 1 << 12) && Count(v[1], 2, 1 << 12) && n == 2 + 3 * int(v[0]) * int(v[1]);
+    break;
+  case Type::Revolution:
+    valid = valid && n >= 9 && (n - 3) % 3 == 0;
+    break;
+  case Type::Scale:
+    valid = valid && v[0] != 0.0 && v[1] != 0.0 && v[2] != 0.0;
+    break;
+  case Type::Replicate:
+    valid = valid && (n == 3 || n == 6) && v[0] > 0.0 && v[1] > 0.0 && v[2] > 0.0;
+    for (int k = 3; k < n; k++)
+      valid = valid && Count(v[k], 0, 1 << 20);
+    break;
+  case Type::Polygonize:
+    valid = valid && Count(v[0], 2, 1 << 16) && v[1] > 0.0 && v[2] < v[5] && v[3] < v[6] && v[4] < v[7];
+    break;
+  case Type::Tessellate:
+    valid = valid && Count(v[0], 2, 1 << 16);
+    break;
+  default:
+    break;
+  }
+  if (!valid)
+  {
+    message = std::string("invalid parameters of ") + syntax.keyword;
+    return false;
+  }
+  return true;
+}
+
+/*!
+\brief Read a scene in text form.
+\param in Stream.
+\param source Name of the source, for error messages.
+\return False if the scene has errors, see Error(); the scene is left empty.
+*/
+bool Scene::Read(std::istream& in, const std::string& source)
+{
+  records.clear();
+  std::map<std::string, int> names;
+
+  Record record;
+  int start = 0;
+  std::string message;
+  const auto Fail = [&](int l, const std::string& text)
+  {
+    error = source + ":" + std::to_string(l) + ": " + text;
+    records.clear();
+    Build();
+    return false;
+  };
+
+  std::string line, word;
+  for (int l = 1; ; l++)
+  {
+    const bool eof = !std::getline(in, line);
+    const size_t comment = line.find('#');
+    if (eof)
+      line.clear();
+    else if (comment != std::string::npos)
+      line.erase(comment);
+    std::istringstream words(line);
+    if (!eof && !(words >> word))
+      continue;
+
+    // Lines starting with a number continue the parameters of the previous record
+    char* end = nullptr;
+    const bool number = !eof && (strtod(word.c_str(), &end), *end == '\0');
+    if (number && start > 0 && Syntax[int(record.type)].values < 0)
+    {
+      words.seekg(0);
+    }
+    else if (number)
+    {
+      return Fail(l, "unexpected number " + word);
+    }
+    else
+    {
+      // Check and add the previous record
+      if (start > 0)
+      {
+        if (!Check(record, message))
+          return Fail(start, message);
+        if (!record.name.empty())
+          names[record.name] = int(records.size());
+        records.push_back(std::move(record));
+        start = 0;
+      }
+      if (eof)
+        break;
+
+      int type = 0;
+      while (type < int(Type::Types) && word != Syntax[type].keyword)
+        type++;
+      if (type == int(Type::Types))
+        return Fail(l, "unknown keyword " + word);
+
+      record = Record();
+      record.type = Type(type);
+      start = l;
+      const RecordSyntax& syntax = Syntax[type];
+      if (syntax.named)
+      {
+        if (!(words >> record.name))
+          return Fail(l, "missing name");
+        if (names.find(record.name) != names.end())
+          return Fail(l, "duplicate name " + record.name);
+      }
+      for (int r = 0; r < syntax.refs; r++)
+      {
+        if (!(words >> word))
+          return Fail(l, "missing reference");
+        const auto i = names.find(word);
+        if (i == names.end())
+          return Fail(l, "undefined reference " + word);
+        record.refs.push_back(i->second);
+      }
+    }
+
+    while (words >> word)
+    {
+      const double value = strtod(word.c_str(), &end);
+      if (*end != '\0')
+        return Fail(l, "invalid number " + word);
+      record.values.push_back(value);
+    }
+  }
+
+  error.clear();
+  Build();
+  return true;
+}
+
+/*!
+\brief Write a value with the shortest representation that reads back exactly.
+\param out Stream.
+\param v Value.
+*/
+static void WriteValue(std::ostream& out, double v)
+{
+  char text[32];
+  for (int precision = 6; precision <= 17; precision++)
+  {
+    snprintf(text, sizeof(text), "%.*g", precision, v);
+    if (strtod(text, nullptr) == v)
+      break;
+  }
+  out << text;
+}
+
+/*!
+\brief Write the scene in text form.
+\param out Stream.
+*/
+void Scene::Write(std::ostream& out) const
+{
+  out << "# TinyMesh scene\n";
+  for (const Record& record : records)
+  {
+    const RecordSyntax& syntax = Syntax[int(record.type)];
+    out << syntax.keyword;
+    if (syntax.named)
+      out << " " << record.name;
+    for (int r : record.refs)
+      out << " " << records[r].name;
+    // Control points of surfaces are written one per line
+    const int head = (record.type == Type::Bezier) ? 2 : (record.type == Type::Revolution) ? 3 : int(record.values.size());
+    for (int i = 0; i < int(record.values.size()); i++)
+    {
+      out << ((i >= head && (i - head) % 3 == 0) ? "\n " : " ");
+      WriteValue(out, record.values[i]);
+    }
+    out << "\n";
+  }
+}
+
+//! Header of binary scene files.
+struct SceneHeader
+{
+  char magic[4] = { 'T', 'M', 'S', 'B' };  //!< File identifier.
+  uint32_t version = 1;                     //!< Version of the format.
+  uint32_t records = 0;                     //!< Number of records.
+};
+
+//! Size of the smallest record of binary scene files: type, and sizes of the name, references and values.
+static const size_t MinimumRecord = sizeof(uint8_t) + 3 * sizeof(uint32_t);
+
+/*!
+\brief Compute the number of bytes left in a stream, the largest size if the stream cannot be sought.
+\param in Stream.
+*/
+static size_t Remaining(std::istream& in)
+{
+  const std::streampos position = in.tellg();
+  if (position == std::streampos(-1))
+  {
+    in.clear();
+    return size_t(-1);
+  }
+  in.seekg(0, std::ios::end);
+  const std::streampos end = in.tellg();
+  in.seekg(position);
+  return end > position ? size_t(end - position) : 0;
+}
+
+/*!
+\brief Read a scene in binary form.
+\param in Stream.
+\return False if the scene is invalid, see Error(); the scene is left empty.
+*/
+bool Scene::ReadBinary(std::istream& in)
+{
+  records.clear();
+
+  const auto Fail = [&](const std::string& message)
+  {
+    error = message;
+    records.clear();
+    Build();
+    return false;
+  };
+
+  SceneHeader header, expected;
+  if (!in.read(reinterpret_cast<char*>(&header), sizeof(header)) || memcmp(header.magic, expected.magic, 4) != 0 || header.version != expected.version)
+    return Fail("not a binary scene");
+
+  // Counts read from the file are checked against its size before allocating
+  if (header.records > Remaining(in) / MinimumRecord)
+    return Fail("invalid number of records");
+  records.reserve(header.records);
+  for (uint32_t i = 0; i < header.records; i++)
+  {
+    uint8_t type = 0;
+    uint32_t name = 0, refs = 0, values = 0;
+    in.read(reinterpret_cast<char*>(&type), sizeof(type));
+    in.read(reinterpret_cast<char*>(&name), sizeof(name));
+    if (!in || type >= uint8_t(Type::Types) || name > 1024)
+      return Fail("invalid record " + std::to_string(i));
+
+    Record record;
+    record.type = Type(type);
+    record.name.resize(name);
+    in.read(&record.name[0], name);
+    in.read(reinterpret_cast<char*>(&refs), sizeof(refs));
+    if (!in || refs > 2)
+      return Fail("invalid record " + std::to_string(i));
+    record.refs.resize(refs);
+    in.read(reinterpret_cast<char*>(record.refs.data()), sizeof(int) * refs);
+    in.read(reinterpret_cast<char*>(&values), sizeof(values));
+    if (!in || values > (1u << 24) || values > Remaining(in) / sizeof(double))
+      return Fail("invalid record " + std::to_string(i));
+    record.values.resize(values);
+    in.read(reinterpret_cast<char*>(record.values.data()), sizeof(double) * values);
+    if (!in)
+      return Fail("truncated scene");
+
+    std::string message;
+    if (!Check(record, message))
+      return Fail("record " + std::to_string(i) + ": " + message);
+    records.push_back(std::move(record));
+  }
+
+  error.clear();
+  Build();
+  return true;
+}
+
+/*!
+\brief Write the scene in binary form.
+\param out Stream.
+*/
+void Scene::WriteBinary(std::ostream& out) const
+{
+  SceneHeader header;
+  header.records = uint32_t(records.size());
+  out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  for (const Record& record : records)
+  {
+    const uint8_t type = uint8_t(record.type);
+    const uint32_t name = uint32_t(record.name.size());
+    const uint32_t refs = uint32_t(record.refs.size());
+    const uint32_t values = uint32_t(record.values.size());
+    out.write(reinterpret_cast<const char*>(&type), sizeof(type));
+    out.write(reinterpret_cast<const char*>(&name), sizeof(name));
+    out.write(record.name.data(), name);
+    out.write(reinterpret_cast<const char*>(&refs), sizeof(refs));
+    out.write(reinterpret_cast<const char*>(record.refs.data()), sizeof(int) * refs);
+    out.write(reinterpret_cast<const char*>(&values), sizeof(values));
+    out.write(reinterpret_cast<const char*>(record.values.data()), sizeof(double) * values);
+  }
+}
+
+/*!
+\brief Create the implicit nodes of the records in a single allocation.
+
+Nodes are created depth first from the polygonized roots, so that every subtree is stored
+contiguously in the order of its evaluation, and identical subtrees are shared, see NodeStore.
+*/
+void Scene::Build()
+{
+  nodes.assign(records.size(), nullptr);
+  size_t size = 0;
+  for (const Record& record : records)
+    size += ArenaSize(record.type);
+  store = std::make_shared<NodeStore>(std::max(size, size_t(1)));
+
+  std::function<Implicit*(int)> Create = [&](int i) -> Implicit*
+  {
+    if (nodes[i] != nullptr || !IsNode(records[i].type))
+      return nodes[i];
+
+    const Record& record = records[i];
+    const std::vector<double>& v = record.values;
+    Implicit* a = record.refs.size() > 0 ? Create(record.refs[0]) : nullptr;
+    Implicit* b = record.refs.size() > 1 ? Create(record.refs[1]) : nullptr;
+    const auto P = [&v](int k) { return Vector(v[k], v[k + 1], v[k + 2]); };
+
+    NodeStore& s = *store;
+    switch (record.type)
+    {
+    case Type::Sphere: nodes[i] = s.Create<ImplicitTree::Sphere>(P(0), v[3]); break;
+    case Type::Box: nodes[i] = s.Create<ImplicitTree::InigoBox>(P(0), P(3)); break;
+    case Type::Planes: nodes[i] = s.Create<ImplicitTree::Box>(P(0), P(3)); break;
+    case Type::Capsule: nodes[i] = s.Create<ImplicitTree::Capsule>(P(0), P(3), v[6], v[7]); break;
+    case Type::Torus: nodes[i] = s.Create<ImplicitTree::InigoTore>(P(0), Vector(v[3], v[4], 0.0)); break;
+    case Type::Union: nodes[i] = s.Create<ImplicitTree::Union>(*a, *b); break;
+    case Type::Intersection: nodes[i] = s.Create<struct ImplicitTree::Intersection>(*a, *b); break;
+    case Type::Diff: nodes[i] = s.Create<ImplicitTree::Diff>(*a, *b); break;
+    case Type::Blend: nodes[i] = s.Create<ImplicitTree::Blend>(*a, *b, v[0]); break;
+    case Type::Translate: nodes[i] = s.Create<ImplicitTree::Translate>(a, P(0)); break;
+    case Type::Scale: nodes[i] = s.Create<ImplicitTree::Scale>(a, P(0)); break;
+    case Type::Replicate: nodes[i] = (v.size() == 6) ? s.Create<ImplicitTree::Replicate>(a, P(0), int(v[3]), int(v[4]), int(v[5])) : s.Create<ImplicitTree::Replicate>(a, P(0)); break;
+    default: break;
+    }
+    return nodes[i];
+  };
+
+  for (const Record& record : records)
+  {
+    if (record.type == Type::Polygonize)
+      Create(record.refs[0]);
+  }
+  for (int i = 0; i < int(records.size()); i++)
+    Create(i);
+}
+
+/*!
+\brief Find an implicit node by name.
+\param name Name.
+\return The node, null if not found.
+*/
+Implicit* Scene::Node(const std::string& name) const
+{
+  for (int i = 0; i < int(records.size()); i++)
+  {
+    if (records[i].name == name && nodes[i] != nullptr)
+      return nodes[i];
+  }
+  return nullptr;
+}
+
+/*!
+\brief Generate the meshes of the scene, in the order of the polygonize and tessellate records.
+
+The resolution and precision of the settings, if set, override the ones of the scene.
+\param meshes Generated meshes are appended to this set.
+\param settings Settings.
+\param progress Progress callback, may be empty; the generation stops as soon as it returns false.
+\return False if the generation was cancelled.
+*/
+bool Scene::Generate(std::vector<CompactMesh>& meshes, const ExampleSettings& settings, const std::function<bool(double)>& progress) const
+{
+  int outputs = 0;
+  for (const Record& record : records)
+    outputs += (record.type == Type::Polygonize || record.type == Type::Tessellate) ? 1 : 0;
+
+  int k = 0;
+  for (const Record& record : records)
+  {
+    const std::vector<double>& v = record.values;
+    const std::function<bool(double)> step = [&progress, k, outputs](double t) { return !progress || progress((k + t) / outputs); };
+    const int n = settings.resolution > 0 ? settings.resolution : int(v.empty() ? 0 : v[0]);
+
+    if (record.type == Type::Polygonize)
+    {
+      ImplicitTree::Tree tree(nodes[record.refs[0]], store);
+      tree.SetCache(settings.cache);
+      Mesh mesh;
+      if (!tree.Polygonize(n, mesh, Box(Vector(v[2], v[3], v[4]), Vector(v[5], v[6], v[7])), settings.epsilon > 0.0 ? settings.epsilon : v[1], step))
+        return false;
+      meshes.push_back(CompactMesh(mesh));
+    }
+    else if (record.type == Type::Tessellate)
+    {
+      const Record& surface = records[record.refs[0]];
+      const std::vector<double>& s = surface.values;
+      if (surface.type == Type::Bezier)
+      {
+        const uint nu = uint(s[0]), nv = uint(s[1]);
+        std::vector<Vector> controls(nu * nv);
+        for (uint i = 0; i < nu * nv; i++)
+          controls[i] = Vector(s[2 + 3 * i], s[3 + 3 * i], s[4 + 3 * i]);
+        meshes.push_back(CompactMesh(mesh_bezier_surface(BezierSurface(nu, nv, std::move(controls)), uint(n), uint(n))));
+      }
+      else
+      {
+        std::vector<Vector> controls((s.size() - 3) / 3);
+        for (int i = 0; i < int(controls.size()); i++)
+          controls[i] = Vector(s[3 + 3 * i], s[4 + 3 * i], s[5 + 3 * i]);
+        BezierCurve curve(std::move(controls));
+
+        const double radius = s[0], amplitude = s[1], waves = s[2];
+        ExtrusionSurface ext(&curve, [radius, amplitude, waves](double a)
+        {
+          return (waves > 0.0) ? radius + amplitude * sin(std::fmod(a, 2.0 * M_PI / waves) / 2.0 * M_PI) : radius;
+        });
+        meshes.push_back(CompactMesh(mesh_extrusion_surface(ext, uint(n), uint(n))));
+      }
+      if (!step(1.0))
+        return false;
+    }
+    else
+    {
+      continue;
+    }
+    k++;
+  }
+  return true;
+}
@@ -57,11 +57,20 @@ std::string prepare_source(std::string file, const std::string& definitions)
     return std::string();
   }
 
+  // une directive #version au debut des definitions remplace celle du source
+  std::string defs = definitions;
+  if (defs.compare(0, 8, "#version") == 0)
+  {
+    size_t e = defs.find('\n');
+    version = defs.substr(0, e) + "\n";
+    defs.erase(0, e == std::string::npos ? e : e + 1);
+  }
+
   // reconstruit le source complet
   if (definitions.empty() == false)
   {
     source.append(version);                         // insere la version
-    source.append(definitions).append("\n");        // insere les definitions
+    source.append(defs).append("\n");               // insere les definitions
     source.append(file);                            // insere le source
   }
   else
@@ -395,3 +404,97 @@ int program_print_errors(const GLuint program)
     std::cout << errors.c_str() << std::endl;
   return code;
 }
+
+/*!
+\brief Create and link the program from a source file.
+\param file Source file.
+\param defs Definitions inserted in the source, a leading #version directive replaces the one of the source.
+\return True if the program has been linked.
+*/
+bool ShaderProgram::Load(const std::string& file, const std::string& defs)
+{
+  Release();
+  filename = file;
+  definitions = defs;
+  program = read_program(filename.c_str(), definitions.c_str());
+  Resolve();
+
+  GLint status = GL_FALSE;
+  glGetProgramiv(program, GL_LINK_STATUS, &status);
+  return status == GL_TRUE;
+}
+
+/*!
+\brief Compile and link the program again from its source file, and update the locations.
+\return True if the program has been linked.
+*/
+bool ShaderProgram::Reload()
+{
+  if (program == 0)
+    return false;
+
+  int error = reload_program(program, filename.c_str(), definitions.c_str());
+  program_print_errors(program);
+  Resolve();
+  return error == 0;
+}
+
+/*!
+\brief Delete the program. Registered uniforms are kept for the next Load().
+*/
+void ShaderProgram::Release()
+{
+  if (program != 0)
+    release_program(program);
+  program = 0;
+  std::fill(locations.begin(), locations.end(), -1);
+}
+
+/*!
+\brief Register a uniform.
+\param name Name of the uniform.
+\return The slot of the uniform, to be used with Location().
+*/
+int ShaderProgram::Uniform(const std::string& name)
+{
+  for (int i = 0; i < int(names.size()); i++)
+  {
+    if (names[i] == name)
+      return i;
+  }
+  names.push_back(name);
+  locations.push_back(program != 0 ? glGetUniformLocation(program, name.c_str()) : -1);
+  return int(names.size()) - 1;
+}
+
+/*!
+\brief Register a uniform block and bind it to a binding point.
+\param name Name of the uniform block.
+\param binding Binding point.
+*/
+void ShaderProgram::UniformBlock(const std::string& name, GLuint binding)
+{
+  blocks.push_back(name);
+  bindings.push_back(binding);
+  Resolve();
+}
+
+/*!
+\brief Update the locations of the registered uniforms and the bindings of the uniform blocks.
+*/
+void ShaderProgram::Resolve()
+{
+  if (program == 0)
+    return;
+
+  for (int i = 0; i < int(names.size()); i++)
+  {
+    locations[i] = glGetUniformLocation(program, names[i].c_str());
+  }
+  for (int i = 0; i < int(blocks.size()); i++)
+  {
+    GLuint index = glGetUniformBlockIndex(program, blocks[i].c_str());
+    if (index != GL_INVALID_INDEX)
+      glUniformBlockBinding(program, index, bindings[i]);
+  }
+}
@@ -0,0 +1,293 @@
+// Command line batch mesher, without any display or Qt dependency
+
+#include "examples.h"
+#include "fieldcache.h"
+#include "fieldprofiler.h"
+#include "jobqueue.h"
+#include "scene.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*!
+\brief Job of a batch file.
+*/
+struct BatchJob
+{
+  int line = 0;                 //!< Line of the batch file.
+  std::string example;          //!< Name of the example, or scene file.
+  std::shared_ptr<const Scene> scene; //!< Scene, null for examples.
+  ExampleSettings settings;     //!< Settings.
+  std::string output;           //!< Output file, .obj or binary .tmb.
+
+  // Results
+  bool done = false;            //!< Flag set if the meshes were generated and written.
+  int meshes = 0;               //!< Number of meshes.
+  int triangles = 0;            //!< Number of triangles.
+  int vertexes = 0;             //!< Number of vertices.
+  double generate = 0.0;        //!< Generation time, in seconds.
+  double write = 0.0;           //!< Writing time, in seconds.
+};
+
+/*!
+\brief Print the usage of the tool.
+*/
+static void Usage()
+{
+  std::cerr << "Usage: TinyMeshBatch [-j threads] [-o directory] [--profile prefix] [--list] batch.txt\n"
+    "       TinyMeshBatch --convert scene.tms|scene.tmsb output.tms|output.tmsb\n"
+    "\n"
+    "The batch file describes one job per line, blank lines and lines starting with # are ignored:\n"
+    "  example|scene.tms|scene.tmsb [n=resolution] [epsilon=precision] [out=file.obj|file.tmb]\n"
+    "Scene files, see Scene, are relative to the batch file; n and epsilon override the parameters\n"
+    "of the scene.\n"
+    "Outputs are .obj files, or binary .tmb files written by CompactMesh::Save(). Examples with\n"
+    "several meshes write one file per mesh, numbered from 1.\n"
+    "\n"
+    "With --profile, the evaluations of the implicit trees are reported and exported to\n"
+    "prefix.json (Chrome trace) and prefix.folded (flame graph), if the profiler is compiled in.\n";
+}
+
+/*!
+\brief Check if a string ends with a suffix.
+*/
+static bool EndsWith(const std::string& s, const std::string& suffix)
+{
+  return s.size() > suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+/*!
+\brief Parse a batch file.
+\param filename File name.
+\param jobs Returned jobs.
+\return False if the file could not be read or has errors, which are reported.
+*/
+static bool Parse(const std::string& filename, std::vector<BatchJob>& jobs)
+{
+  std::ifstream in(filename);
+  if (!in)
+  {
+    std::cerr << "Cannot read " << filename << "\n";
+    return false;
+  }
+
+  bool ok = true;
+  std::string line, word;
+  for (int l = 1; std::getline(in, line); l++)
+  {
+    std::istringstream words(line);
+    if (!(words >> word) || word[0] == '#')
+      continue;
+
+    BatchJob job;
+    job.line = l;
+    job.example = word;
+    job.output = word + ".obj";
+    if (EndsWith(word, ".tms") || EndsWith(word, ".tmsb"))
+    {
+      // Scenes are loaded once, and shared by the jobs of the line
+      const size_t slash = filename.find_last_of("/\\");
+      const std::string path = (word[0] == '/' || slash == std::string::npos) ? word : filename.substr(0, slash + 1) + word;
+      std::shared_ptr<Scene> scene = std::make_shared<Scene>();
+      if (!scene->Load(path))
+      {
+        std::cerr << scene->Error() << "\n";
+        ok = false;
+      }
+      job.scene = scene;
+      const size_t start = word.find_last_of("/\\") + 1;
+      job.output = word.substr(start, word.rfind('.') - start) + ".obj";
+    }
+    else
+    {
+      bool known = false;
+      for (const std::string& name : Examples::Names())
+        known = known || (name == word);
+      if (!known)
+      {
+        std::cerr << filename << ":" << l << ": unknown example " << word << "\n";
+        ok = false;
+      }
+    }
+
+    while (words >> word)
+    {
+      const size_t equal = word.find('=');
+      const std::string key = word.substr(0, equal);
+      const std::string value = (equal == std::string::npos) ? "" : word.substr(equal + 1);
+      if (key == "n" && atoi(value.c_str()) > 1)
+        job.settings.resolution = atoi(value.c_str());
+      else if (key == "epsilon" && atof(value.c_str()) > 0.0)
+        job.settings.epsilon = atof(value.c_str());
+      else if (key == "out" && !value.empty())
+        job.output = value;
+      else
+      {
+        std::cerr << filename << ":" << l << ": invalid setting " << word << "\n";
+        ok = false;
+      }
+    }
+    jobs.push_back(job);
+  }
+  return ok;
+}
+
+/*!
+\brief Name of the file of a mesh of a job, numbered if the job has several meshes.
+\param output Output file of the job.
+\param i Mesh.
+\param n Number of meshes.
+*/
+static std::string MeshFile(const std::string& output, int i, int n)
+{
+  if (n == 1)
+    return output;
+  const size_t dot = output.rfind('.');
+  return output.substr(0, dot) + "_" + std::to_string(i + 1) + output.substr(dot);
+}
+
+/*!
+\brief Generate the meshes of a job and write them.
+\param job The job.
+\param directory Output directory, may be empty.
+*/
+static void Run(BatchJob& job, const std::string& directory)
+{
+  typedef std::chrono::steady_clock Clock;
+
+  const Clock::time_point start = Clock::now();
+  std::vector<CompactMesh> meshes;
+  if (job.scene ? !job.scene->Generate(meshes, job.settings) : !Examples::Generate(job.example, meshes, job.settings))
+    return;
+  const Clock::time_point generated = Clock::now();
+
+  const bool binary = EndsWith(job.output, ".tmb");
+  job.done = true;
+  for (int i = 0; i < int(meshes.size()); i++)
+  {
+    const std::string file = (directory.empty() ? "" : directory + "/") + MeshFile(job.output, i, int(meshes.size()));
+    const bool written = binary ? meshes[i].Save(file) : meshes[i].ToMesh().SaveObj(file, job.example);
+    if (!written)
+    {
+      std::cerr << "Cannot write " << file << "\n";
+      job.done = false;
+    }
+    job.triangles += meshes[i].Triangles();
+    job.vertexes += meshes[i].Vertexes();
+  }
+  job.meshes = int(meshes.size());
+
+  job.generate = std::chrono::duration<double>(generated - start).count();
+  job.write = std::chrono::duration<double>(Clock::now() - generated).count();
+}
+
+int main(int argc, char* argv[])
+{
+  int threads = std::max(1, int(std::thread::hardware_concurrency()));
+  std::string directory;
+  std::string profile;
+  std::string batch;
+  for (int i = 1; i < argc; i++)
+  {
+    const std::string arg = argv[i];
+    if (arg == "-j" && i + 1 < argc)
+      threads = std::max(1, atoi(argv[++i]));
+    else if (arg == "-o" && i + 1 < argc)
+      directory = argv[++i];
+    else if (arg == "--profile" && i + 1 < argc)
+      profile = argv[++i];
+    else if (arg == "--convert" && i + 2 < argc)
+    {
+      Scene scene;
+      if (!scene.Load(argv[i + 1]))
+      {
+        std::cerr << scene.Error() << "\n";
+        return 1;
+      }
+      if (!scene.Save(argv[i + 2], EndsWith(argv[i + 2], ".tmsb")))
+      {
+        std::cerr << "Cannot write " << argv[i + 2] << "\n";
+        return 1;
+      }
+      return 0;
+    }
+    else if (arg == "--list")
+    {
+      for (const std::string& name : Examples::Names())
+        std::cout << name << "\n";
+      return 0;
+    }
+    else if (arg[0] != '-' && batch.empty())
+      batch = arg;
+    else
+    {
+      Usage();
+      return 1;
+    }
+  }
+  if (batch.empty())
+  {
+    Usage();
+    return 1;
+  }
+
+  std::vector<BatchJob> jobs;
+  if (!Parse(batch, jobs))
+    return 1;
+
+  // Jobs run in parallel and share the samples of identical implicit surfaces
+  FieldCache cache;
+  const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  {
+    JobQueue queue(std::min(threads, std::max(1, int(jobs.size()))));
+    for (BatchJob& job : jobs)
+    {
+      job.settings.cache = &cache;
+      queue.Push([&job, &directory](JobQueue::Job&) { Run(job, directory); });
+    }
+    queue.Wait();
+  }
+  const double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  // Statistics
+  int failed = 0;
+  long long triangles = 0;
+  double generate = 0.0, write = 0.0;
+  printf("%-6s %-18s %8s %10s %10s %10s %10s  %s\n", "line", "example", "meshes", "triangles", "generate", "write", "tri/s", "output");
+  for (const BatchJob& job : jobs)
+  {
+    if (!job.done)
+    {
+      printf("%-6d %-18s failed\n", job.line, job.example.c_str());
+      failed++;
+      continue;
+    }
+    printf("%-6d %-18s %8d %10d %9.3fs %9.3fs %10.0f  %s\n", job.line, job.example.c_str(), job.meshes, job.triangles, job.generate, job.write, job.triangles / std::max(job.generate, 1e-9), job.output.c_str());
+    triangles += job.triangles;
+    generate += job.generate;
+    write += job.write;
+  }
+  printf("%d jobs on %d threads: %.3fs wall, %.3fs generate, %.3fs write, %lld triangles, %.0f tri/s, cache %d hits %d misses\n",
+    int(jobs.size()), threads, wall, generate, write, triangles, triangles / std::max(wall, 1e-9), cache.Hits(), cache.Misses());
+
+  if (!profile.empty())
+  {
+    FieldProfiler::Report(std::cout);
+    if (FieldProfiler::Enabled() && !(FieldProfiler::SaveChromeTrace(profile + ".json") && FieldProfiler::SaveFolded(profile + ".folded")))
+    {
+      std::cerr << "Cannot write " << profile << ".json or " << profile << ".folded\n";
+      failed++;
+    }
+  }
+
+  return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,429 @@
+// Benchmarks of the geometry kernels, with JSON output and comparison against a baseline
+
+#include "examples.h"
+#include "tp_math.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/*!
+\brief Benchmark of a kernel.
+
+The function runs the kernel once and returns the amount of work done, in the unit of the
+benchmark, or a negative value if the kernel failed. Every repetition runs the kernel until a minimum time has elapsed, and the rate
+is the best ratio between the amount of work and the time over the repetitions.
+*/
+struct Benchmark
+{
+  std::string name;               //!< Name, group and scene separated by a slash.
+  std::string unit;               //!< Unit of the rate.
+  std::function<double()> run;    //!< Kernel.
+
+  // Results
+  double seconds = 0.0;           //!< Best time.
+  double work = 0.0;              //!< Amount of work.
+  double rate = 0.0;              //!< Work per second.
+  bool failed = false;            //!< Flag set if the kernel failed.
+};
+
+/*!
+\brief Random points in a box, always the same ones.
+\param box The box.
+\param n Number of points.
+*/
+static std::vector<Vector> Points(const Box& box, int n)
+{
+  std::mt19937 random(42);
+  std::uniform_real_distribution<double> u(0.0, 1.0);
+  std::vector<Vector> points(n);
+  for (Vector& p : points)
+  {
+    p = box[0] + Vector(u(random) * box.Diagonal()[0], u(random) * box.Diagonal()[1], u(random) * box.Diagonal()[2]);
+  }
+  return points;
+}
+
+/*!
+\brief Segments of a regular grid straddling the surface of a field.
+\param field The field.
+\param box Domain.
+\param n Number of samples along every axis.
+\param a, b Returned end points, the first one is inside.
+*/
+static void Straddling(const AnalyticScalarField& field, const Box& box, int n, std::vector<Vector>& a, std::vector<Vector>& b)
+{
+  const Vector d = box.Diagonal() / (n - 1);
+  for (int i = 0; i < n - 1; i++)
+  {
+    for (int j = 0; j < n; j++)
+    {
+      for (int k = 0; k < n; k++)
+      {
+        const Vector p = box[0] + Vector(i * d[0], j * d[1], k * d[2]);
+        const Vector q = p + Vector(d[0], 0.0, 0.0);
+        if ((field.Value(p) < 0.0) != (field.Value(q) < 0.0))
+        {
+          a.push_back(p);
+          b.push_back(q);
+        }
+      }
+    }
+  }
+}
+
+/*!
+\brief Size of a file in megabytes.
+\param file File name.
+*/
+static double Megabytes(const std::string& file)
+{
+  std::error_code error;
+  const std::uintmax_t size = std::filesystem::file_size(file, error);
+  return error ? 0.0 : double(size) / (1024.0 * 1024.0);
+}
+
+/*!
+\brief Create the benchmarks.
+
+Scenes are the example scenes of the application, at lower resolutions in quick mode.
+\param quick Quick mode.
+\param directory Directory for temporary files.
+*/
+static std::vector<Benchmark> Benchmarks(bool quick, const std::string& directory)
+{
+  std::vector<Benchmark> benchmarks;
+
+  // Field kernels, on the tree of the second implicit example
+  static ImplicitTable table;
+  const Box domain(30.0);
+  const int evaluations = quick ? 200000 : 2000000;
+  static std::vector<Vector> points;
+  points = Points(domain, evaluations);
+  static std::vector<Vector> sa, sb;
+  sa.clear();
+  sb.clear();
+  Straddling(table.tree, domain, quick ? 64 : 128, sa, sb);
+
+  benchmarks.push_back({ "value/implicit-b", "evaluations/s", []()
+  {
+    double s = 0.0;
+    for (const Vector& p : points)
+      s += table.tree.Value(p);
+    volatile double sink = s;
+    (void)sink;
+    return double(points.size());
+  } });
+  benchmarks.push_back({ "gradient/implicit-b", "gradients/s", []()
+  {
+    Vector s = Vector::Null;
+    for (size_t i = 0; i < points.size(); i += 6)
+      s += table.tree.Gradient(points[i]);
+    volatile double sink = s[0];
+    (void)sink;
+    return double((points.size() + 5) / 6);
+  } });
+  benchmarks.push_back({ "dichotomy/implicit-b", "dichotomies/s", []()
+  {
+    Vector s = Vector::Null;
+    const double length = Norm(sb[0] - sa[0]);
+    for (size_t i = 0; i < sa.size(); i++)
+      s += table.tree.Dichotomy(sa[i], sb[i], table.tree.Value(sa[i]), table.tree.Value(sb[i]), length, 1e-4);
+    volatile double sink = s[0];
+    (void)sink;
+    return double(sa.size());
+  } });
+
+  // Polygonization of the implicit examples
+  const int resolution = quick ? 64 : 200;
+  for (const std::string name : { "implicit-a", "implicit-b", "implicit-c", "implicit-d" })
+  {
+    benchmarks.push_back({ "polygonize/" + name, "triangles/s", [name, resolution]()
+    {
+      ExampleSettings settings;
+      settings.resolution = resolution;
+      std::vector<CompactMesh> meshes;
+      Examples::Generate(name, meshes, settings);
+      return double(meshes[0].Triangles());
+    } });
+  }
+
+  // Tessellation of parametric surfaces
+  for (const std::string name : { "bezier", "revolution" })
+  {
+    benchmarks.push_back({ "tessellate/" + name, "triangles/s", [name, quick]()
+    {
+      ExampleSettings settings;
+      settings.resolution = quick ? 100 : 400;
+      std::vector<CompactMesh> meshes;
+      Examples::Generate(name, meshes, settings);
+      int n = 0;
+      for (const CompactMesh& mesh : meshes)
+        n += mesh.Triangles();
+      return double(n);
+    } });
+  }
+
+  // Mesh kernels, on the mesh of the first implicit example
+  static Mesh mesh;
+  {
+    ExampleSettings settings;
+    settings.resolution = resolution;
+    std::vector<CompactMesh> meshes;
+    Examples::Generate("implicit-a", meshes, settings);
+    mesh = meshes[0].ToMesh();
+  }
+
+  benchmarks.push_back({ "intersect/triangle", "intersections/s", [quick]()
+  {
+    // Rays from random points towards random triangles
+    const int n = quick ? 200000 : 2000000;
+    std::mt19937 random(7);
+    std::uniform_int_distribution<int> t(0, mesh.Triangles() - 1);
+    const std::vector<Vector> origins = Points(Box(30.0), 1024);
+    int hits = 0;
+    for (int i = 0; i < n; i++)
+    {
+      const Triangle triangle = mesh.GetTriangle(t(random));
+      const Vector c = (triangle[0] + triangle[1] + triangle[2]) / 3.0;
+      const Vector& o = origins[i & 1023];
+      double d, u, v;
+      if (triangle.Intersect(Ray(o, Normalized(c - o)), d, u, v))
+        hits++;
+    }
+    volatile int sink = hits;
+    (void)sink;
+    return double(n);
+  } });
+  benchmarks.push_back({ "smoothnormals/implicit-a", "triangles/s", []()
+  {
+    Mesh m = mesh;
+    m.SmoothNormals();
+    return double(m.Triangles());
+  } });
+
+  // Input and output
+  const std::string obj = directory + "/tinymesh-benchmark.obj";
+  const std::string tmb = directory + "/tinymesh-benchmark.tmb";
+
+  // Files read by the load benchmarks, which may run without the save ones
+  mesh.SaveObj(obj, "benchmark");
+  CompactMesh(mesh).Save(tmb);
+
+  benchmarks.push_back({ "io/saveobj", "MB/s", [obj]()
+  {
+    if (!mesh.SaveObj(obj, "benchmark"))
+      return -1.0;
+    return Megabytes(obj);
+  } });
+  benchmarks.push_back({ "io/loadobj", "MB/s", [obj]()
+  {
+    Mesh m;
+    if (!m.Load(obj))
+      return -1.0;
+    return Megabytes(obj);
+  } });
+  benchmarks.push_back({ "io/savetmb", "MB/s", [tmb]()
+  {
+    if (!CompactMesh(mesh).Save(tmb))
+      return -1.0;
+    return Megabytes(tmb);
+  } });
+  benchmarks.push_back({ "io/loadtmb", "MB/s", [tmb]()
+  {
+    CompactMesh m;
+    if (!m.Load(tmb))
+      return -1.0;
+    return Megabytes(tmb);
+  } });
+
+  return benchmarks;
+}
+
+/*!
+\brief Write the results as JSON, one benchmark per line.
+
+Failed benchmarks are left out, so that they do not end up in a baseline.
+\param file File name.
+\param benchmarks Benchmarks.
+*/
+static bool WriteJson(const std::string& file, const std::vector<Benchmark>& benchmarks)
+{
+  std::ofstream out(file);
+  if (!out)
+    return false;
+  out.precision(9);
+  out << "{\n  \"benchmarks\": [\n";
+  bool first = true;
+  for (const Benchmark& b : benchmarks)
+  {
+    if (b.failed)
+      continue;
+    out << (first ? "" : ",\n") << "    { \"name\": \"" << b.name << "\", \"unit\": \"" << b.unit << "\", \"rate\": " << b.rate
+      << ", \"seconds\": " << b.seconds << ", \"work\": " << b.work << " }";
+    first = false;
+  }
+  out << (first ? "" : "\n");
+  out << "  ]\n}\n";
+  return bool(out);
+}
+
+/*!
+\brief Read the rates of the benchmarks from a JSON file written by WriteJson().
+\param file File name.
+\param rates Returned rates, by name.
+*/
+static bool ReadJson(const std::string& file, std::map<std::string, double>& rates)
+{
+  std::ifstream in(file);
+  if (!in)
+    return false;
+  std::string line;
+  while (std::getline(in, line))
+  {
+    const size_t name = line.find("\"name\": \"");
+    const size_t rate = line.find("\"rate\": ");
+    if (name == std::string::npos || rate == std::string::npos)
+      continue;
+    const size_t first = name + 9;
+    rates[line.substr(first, line.find('"', first) - first)] = atof(line.c_str() + rate + 8);
+  }
+  return true;
+}
+
+/*!
+\brief Print the usage of the tool.
+*/
+static void Usage()
+{
+  std::cerr << "Usage: TinyMeshBenchmark [--quick] [--repeat n] [--filter text] [--json results.json]\n"
+    "                         [--baseline baseline.json [--tolerance 0.1]]\n"
+    "\n"
+    "Rates are the best over the repetitions. With a baseline, the rates are\n"
+    "compared and the exit code is 2 if a rate dropped by more than the tolerance.\n"
+    "The exit code is 1 if a benchmark failed.\n";
+}
+
+int main(int argc, char* argv[])
+{
+  bool quick = false;
+  int repeat = 3;
+  std::string filter, json, baseline;
+  double tolerance = 0.1;
+  for (int i = 1; i < argc; i++)
+  {
+    const std::string arg = argv[i];
+    if (arg == "--quick")
+      quick = true;
+    else if (arg == "--repeat" && i + 1 < argc)
+      repeat = std::max(1, atoi(argv[++i]));
+    else if (arg == "--filter" && i + 1 < argc)
+      filter = argv[++i];
+    else if (arg == "--json" && i + 1 < argc)
+      json = argv[++i];
+    else if (arg == "--baseline" && i + 1 < argc)
+      baseline = argv[++i];
+    else if (arg == "--tolerance" && i + 1 < argc)
+      tolerance = atof(argv[++i]);
+    else
+    {
+      Usage();
+      return 1;
+    }
+  }
+
+  std::map<std::string, double> reference;
+  if (!baseline.empty() && !ReadJson(baseline, reference))
+  {
+    std::cerr << "Cannot read " << baseline << "\n";
+    return 1;
+  }
+
+  const std::string directory = std::filesystem::temp_directory_path().string();
+  std::vector<Benchmark> benchmarks = Benchmarks(quick, directory);
+  const double minimum = quick ? 0.05 : 0.25;
+  benchmarks.erase(std::remove_if(benchmarks.begin(), benchmarks.end(), [&filter](const Benchmark& b) { return b.name.find(filter) == std::string::npos; }), benchmarks.end());
+
+  int regressions = 0, failures = 0;
+  printf("%-26s %14s %-16s %10s", "benchmark", "rate", "unit", "time");
+  if (!reference.empty())
+    printf(" %14s %8s", "baseline", "ratio");
+  printf("\n");
+  for (Benchmark& b : benchmarks)
+  {
+    for (int r = 0; r < repeat; r++)
+    {
+      // Short kernels are run several times
+      const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      double work = 0.0, seconds = 0.0;
+      do
+      {
+        const double w = b.run();
+        if (w < 0.0)
+        {
+          b.failed = true;
+          break;
+        }
+        work += w;
+        seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+      } while (seconds < minimum);
+      if (b.failed)
+        break;
+
+      const double rate = work / std::max(seconds, 1e-12);
+      if (r == 0 || rate > b.rate)
+      {
+        b.seconds = seconds;
+        b.work = work;
+        b.rate = rate;
+      }
+    }
+
+    if (b.failed)
+    {
+      printf("%-26s %14s\n", b.name.c_str(), "FAILED");
+      failures++;
+      continue;
+    }
+    printf("%-26s %14.4g %-16s %9.4fs", b.name.c_str(), b.rate, b.unit.c_str(), b.seconds);
+    const auto r = reference.find(b.name);
+    if (r != reference.end() && r->second > 0.0)
+    {
+      const double ratio = b.rate / r->second;
+      const bool regression = ratio < 1.0 - tolerance;
+      regressions += regression ? 1 : 0;
+      printf(" %14.4g %7.3fx%s", r->second, ratio, regression ? "  REGRESSION" : "");
+    }
+    printf("\n");
+  }
+
+  std::filesystem::remove(directory + "/tinymesh-benchmark.obj");
+  std::filesystem::remove(directory + "/tinymesh-benchmark.tmb");
+
+  if (!json.empty() && !WriteJson(json, benchmarks))
+  {
+    std::cerr << "Cannot write " << json << "\n";
+    return 1;
+  }
+  if (failures > 0)
+  {
+    printf("%d benchmarks failed\n", failures);
+    return 1;
+  }
+  if (regressions > 0)
+  {
+    printf("%d regressions beyond %.0f%%\n", regressions, 100.0 * tolerance);
+    return 2;
+  }
+  return 0;
+}
@@ -12,29 +12,53 @@ VPATH += AppTinyMesh
 
 SOURCES += \
     AppTinyMesh/Source/box.cpp \
+    AppTinyMesh/Source/boxtree.cpp \
+    AppTinyMesh/Source/brickpolygonizer.cpp \
+    AppTinyMesh/Source/compactmesh.cpp \
     AppTinyMesh/Source/evector.cpp \
+    AppTinyMesh/Source/examples.cpp \
+    AppTinyMesh/Source/fieldcache.cpp \
+    AppTinyMesh/Source/fieldprofiler.cpp \
     AppTinyMesh/Source/implicits.cpp \
+    AppTinyMesh/Source/jobqueue.cpp \
     AppTinyMesh/Source/main.cpp \
     AppTinyMesh/Source/camera.cpp \
     AppTinyMesh/Source/mesh.cpp \
     AppTinyMesh/Source/meshcolor.cpp \
     AppTinyMesh/Source/mesh-widget.cpp \
+    AppTinyMesh/Source/meshpool.cpp \
+    AppTinyMesh/Source/meshtopology.cpp \
+    AppTinyMesh/Source/nodestore.cpp \
     AppTinyMesh/Source/qtemainwindow.cpp \
     AppTinyMesh/Source/ray.cpp \
+    AppTinyMesh/Source/scene.cpp \
     AppTinyMesh/Source/shader-api.cpp \
     AppTinyMesh/Source/triangle.cpp \
 
 HEADERS += \
+    AppTinyMesh/Include/arrayview.h \
     AppTinyMesh/Include/box.h \
+    AppTinyMesh/Include/boxtree.h \
+    AppTinyMesh/Include/brickpolygonizer.h \
     AppTinyMesh/Include/camera.h \
     AppTinyMesh/Include/color.h \
+    AppTinyMesh/Include/compactmesh.h \
+    AppTinyMesh/Include/examples.h \
+    AppTinyMesh/Include/fieldcache.h \
+    AppTinyMesh/Include/fieldprofiler.h \
     AppTinyMesh/Include/implicits.h \
+    AppTinyMesh/Include/jobqueue.h \
     AppTinyMesh/Include/mathematics.h \
     AppTinyMesh/Include/mesh.h \
     AppTinyMesh/Include/meshcolor.h \
+    AppTinyMesh/Include/meshpool.h \
+    AppTinyMesh/Include/meshtopology.h \
+    AppTinyMesh/Include/nodestore.h \
     AppTinyMesh/Include/qte.h \
     AppTinyMesh/Include/realtime.h \
+    AppTinyMesh/Include/scene.h \
     AppTinyMesh/Include/shader-api.h \
+    AppTinyMesh/Include/spline.h \
 
 FORMS += \
     AppTinyMesh/UI/interface.ui